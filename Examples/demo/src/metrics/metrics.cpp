@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "metrics.h"
+
+#include <inttypes.h>
+
+#include <algorithm>
+
+#include <base/files/file_util.h>
+#include <base/strings/stringprintf.h>
+
+namespace metrics {
+
+namespace {
+
+/* the rolling histograms report the last 6 minutes or so */
+const int64_t kRollingWindowUs = 60 * 1000000LL;
+
+std::string HistogramLine(const std::string& name, const Histogram& histogram)
+{
+	uint64_t count = histogram.count();
+	return base::StringPrintf(
+		"%s count=%" PRIu64 " mean=%" PRId64 "us p50=%" PRId64 "us p90=%" PRId64
+		"us p99=%" PRId64 "us max=%" PRId64 "us\n",
+		name.c_str(), count, count ? histogram.sum() / (int64_t)count : 0,
+		histogram.Percentile(50), histogram.Percentile(90),
+		histogram.Percentile(99), histogram.max());
+}
+
+}  // namespace
+
+int64_t NowUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int Histogram::BucketOf(int64_t value)
+{
+	if (value < (1 << kSubBucketBits))
+		return value < 0 ? 0 : value;
+	int exponent = 63 - __builtin_clzll(value);
+	int sub = (value >> (exponent - kSubBucketBits)) & ((1 << kSubBucketBits) - 1);
+	int bucket = ((exponent - kSubBucketBits + 1) << kSubBucketBits) | sub;
+	return bucket < kBuckets ? bucket : kBuckets - 1;
+}
+
+int64_t Histogram::BucketUpperBound(int bucket)
+{
+	if (bucket < (1 << kSubBucketBits))
+		return bucket;
+	int exponent = (bucket >> kSubBucketBits) + kSubBucketBits - 1;
+	int sub = bucket & ((1 << kSubBucketBits) - 1);
+	int shift = exponent - kSubBucketBits;
+	return (((int64_t)(1 << kSubBucketBits) + sub + 1) << shift) - 1;
+}
+
+void Histogram::Record(int64_t value)
+{
+	buckets_[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	sum_.fetch_add(value, std::memory_order_relaxed);
+	int64_t max = max_.load(std::memory_order_relaxed);
+	while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed))
+		;
+}
+
+int64_t Histogram::Percentile(double percentile) const
+{
+	uint64_t total = count();
+	if (total == 0)
+		return 0;
+	uint64_t rank = (uint64_t)(total * percentile / 100.0 + 0.5);
+	if (rank == 0)
+		rank = 1;
+	uint64_t seen = 0;
+	for (int i = 0; i < kBuckets; i++) {
+		seen += buckets_[i].load(std::memory_order_relaxed);
+		if (seen >= rank)
+			return std::min(BucketUpperBound(i), max());
+	}
+	return max();
+}
+
+void Histogram::Reset()
+{
+	for (auto& bucket : buckets_)
+		bucket.store(0, std::memory_order_relaxed);
+	count_.store(0, std::memory_order_relaxed);
+	sum_.store(0, std::memory_order_relaxed);
+	max_.store(0, std::memory_order_relaxed);
+}
+
+void Histogram::Merge(const Histogram& other)
+{
+	for (int i = 0; i < kBuckets; i++) {
+		uint32_t n = other.buckets_[i].load(std::memory_order_relaxed);
+		if (n != 0)
+			buckets_[i].fetch_add(n, std::memory_order_relaxed);
+	}
+	count_.fetch_add(other.count(), std::memory_order_relaxed);
+	sum_.fetch_add(other.sum(), std::memory_order_relaxed);
+	int64_t value = other.max();
+	int64_t max = max_.load(std::memory_order_relaxed);
+	while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed))
+		;
+}
+
+const int RollingHistogram::kWindows;
+
+RollingHistogram::RollingHistogram(int64_t windowUs)
+	: window_us_(windowUs)
+{
+	for (auto& epoch : epochs_)
+		epoch.store(-1, std::memory_order_relaxed);
+}
+
+void RollingHistogram::Record(int64_t value)
+{
+	int64_t epoch = NowUs() / window_us_;
+	int slot = epoch % kWindows;
+	int64_t held = epochs_[slot].load(std::memory_order_relaxed);
+	/* the first to come round resets the window */
+	if (held != epoch && epochs_[slot].compare_exchange_strong(held, epoch, std::memory_order_relaxed))
+		windows_[slot].Reset();
+	windows_[slot].Record(value);
+}
+
+void RollingHistogram::Collect(Histogram* out) const
+{
+	int64_t epoch = NowUs() / window_us_;
+	for (int i = 0; i < kWindows; i++) {
+		if (epochs_[i].load(std::memory_order_relaxed) > epoch - kWindows)
+			out->Merge(windows_[i]);
+	}
+}
+
+Registry* Registry::Get()
+{
+	static Registry* registry = new Registry();
+	return registry;
+}
+
+Counter* Registry::GetCounter(const std::string& name)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	std::unique_ptr<Counter>& counter = counters_[name];
+	if (!counter)
+		counter.reset(new Counter());
+	return counter.get();
+}
+
+Histogram* Registry::GetHistogram(const std::string& name)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	std::unique_ptr<Histogram>& histogram = histograms_[name];
+	if (!histogram)
+		histogram.reset(new Histogram());
+	return histogram.get();
+}
+
+RollingHistogram* Registry::GetRollingHistogram(const std::string& name)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	std::unique_ptr<RollingHistogram>& histogram = rolling_histograms_[name];
+	if (!histogram)
+		histogram.reset(new RollingHistogram(kRollingWindowUs));
+	return histogram.get();
+}
+
+std::string Registry::ToString() const
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	std::string out;
+	for (const auto& counter : counters_)
+		out += base::StringPrintf("%s %" PRIu64 "\n",
+			counter.first.c_str(), counter.second->value());
+	for (const auto& entry : histograms_)
+		out += HistogramLine(entry.first, *entry.second);
+	/* named after the span they cover, e.g. "playback.first_audio@360s" */
+	for (const auto& entry : rolling_histograms_) {
+		Histogram recent;
+		entry.second->Collect(&recent);
+		out += HistogramLine(base::StringPrintf("%s@%" PRId64 "s", entry.first.c_str(),
+		                                        entry.second->span_us() / 1000000),
+		                     recent);
+	}
+	return out;
+}
+
+void Registry::Dump(int fd) const
+{
+	std::string out = ToString();
+	base::WriteFileDescriptor(fd, out.data(), out.size());
+}
+
+}  // namespace metrics
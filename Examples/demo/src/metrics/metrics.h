@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEMO_METRICS_H_
+#define DEMO_METRICS_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace metrics {
+
+/* monotonic clock in microseconds */
+int64_t NowUs();
+
+class Counter final {
+public:
+	void Increment(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+	uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+private:
+	std::atomic<uint64_t> value_{0};
+};
+
+/* Log-linear histogram: every power of two is split into 8 linear buckets,
+ * which bounds the error of a reported percentile to 12.5%. Recording is
+ * lock free and allocation free. */
+class Histogram final {
+public:
+	void Record(int64_t value);
+
+	uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+	int64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+	int64_t max() const { return max_.load(std::memory_order_relaxed); }
+	/* upper bound of the bucket holding the given percentile (0-100) */
+	int64_t Percentile(double percentile) const;
+	void Reset();
+	/* adds the values of the other histogram */
+	void Merge(const Histogram& other);
+
+private:
+	static const int kSubBucketBits = 3;
+	static const int kBuckets = 320;
+	static int BucketOf(int64_t value);
+	static int64_t BucketUpperBound(int bucket);
+
+	std::atomic<uint32_t> buckets_[kBuckets] = {};
+	std::atomic<uint64_t> count_{0};
+	std::atomic<int64_t> sum_{0};
+	std::atomic<int64_t> max_{0};
+};
+
+/* A histogram of the recent values: they are recorded into windows of a
+ * fixed length, and only the last kWindows windows are reported, so that a
+ * change shows within minutes instead of drowning in the process lifetime.
+ * A window is reset by the first value recorded into it once it comes
+ * round again; a value recorded concurrently with that may be lost.
+ * Recording costs a clock read on top of a Histogram. */
+class RollingHistogram final {
+public:
+	explicit RollingHistogram(int64_t windowUs);
+
+	void Record(int64_t value);
+	/* adds the values of the current windows into the histogram */
+	void Collect(Histogram* out) const;
+	/* how far back the values go */
+	int64_t span_us() const { return window_us_ * kWindows; }
+
+private:
+	static const int kWindows = 6;
+
+	const int64_t window_us_;
+	Histogram windows_[kWindows];
+	/* the window of time each histogram holds, -1 before the first */
+	std::atomic<int64_t> epochs_[kWindows];
+};
+
+/* Process wide set of named counters and histograms. The instances live as
+ * long as the process, so the pointers can be cached. */
+class Registry final {
+public:
+	static Registry* Get();
+
+	Counter* GetCounter(const std::string& name);
+	Histogram* GetHistogram(const std::string& name);
+	/* over the last few minutes */
+	RollingHistogram* GetRollingHistogram(const std::string& name);
+
+	/* one line per metric, histograms in microseconds */
+	std::string ToString() const;
+	void Dump(int fd) const;
+
+private:
+	Registry() = default;
+
+	mutable std::mutex lock_;
+	std::map<std::string, std::unique_ptr<Counter>> counters_;
+	std::map<std::string, std::unique_ptr<Histogram>> histograms_;
+	std::map<std::string, std::unique_ptr<RollingHistogram>> rolling_histograms_;
+};
+
+/* records the lifetime of the object into a histogram */
+class ScopedTimer final {
+public:
+	explicit ScopedTimer(Histogram* histogram) : histogram_(histogram), start_(NowUs()) {}
+	~ScopedTimer() { histogram_->Record(NowUs() - start_); }
+private:
+	Histogram* histogram_;
+	int64_t start_;
+};
+
+}  // namespace metrics
+
+/* The lookup is done once per call site. */
+#define METRICS_COUNT(name) do { \
+		static ::metrics::Counter* const counter_ = \
+			::metrics::Registry::Get()->GetCounter(name); \
+		counter_->Increment(); \
+	} while (0)
+
+#define METRICS_RECORD(name, value) do { \
+		static ::metrics::Histogram* const histogram_ = \
+			::metrics::Registry::Get()->GetHistogram(name); \
+		histogram_->Record(value); \
+	} while (0)
+
+#define METRICS_RECORD_ROLLING(name, value) do { \
+		static ::metrics::RollingHistogram* const rolling_histogram_ = \
+			::metrics::Registry::Get()->GetRollingHistogram(name); \
+		rolling_histogram_->Record(value); \
+	} while (0)
+
+/* times the rest of the enclosing scope, at most once per scope */
+#define METRICS_SCOPED_TIMER(name) \
+	static ::metrics::Histogram* const scoped_timer_histogram_ = \
+		::metrics::Registry::Get()->GetHistogram(name); \
+	::metrics::ScopedTimer scoped_timer_(scoped_timer_histogram_)
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "startup_profile.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/strings/string_split.h>
+#include <base/strings/string_util.h>
+#include <base/strings/stringprintf.h>
+#include <cutils/properties.h>
+
+namespace startup {
+
+namespace {
+
+const char kEnableProperty[] = "persist.demo.bootprof";
+const char kMilestoneFile[] = "/data/misc/bootprof/milestones";
+
+struct Profile {
+	/* lets Milestone() skip the lock while recording is off */
+	std::atomic<bool> enabled{false};
+	std::mutex lock;
+	int fd = -1;
+	std::string boot_id;
+	std::string process;
+	std::set<std::string> recorded;
+};
+
+Profile* GetProfile()
+{
+	static Profile* profile = new Profile;
+	return profile;
+}
+
+int64_t BootTimeUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* the start time of this process since boot, -1 if unknown */
+int64_t ExecTimeUs()
+{
+	std::string stat;
+	if (!base::ReadFileToString(base::FilePath("/proc/self/stat"), &stat))
+		return -1;
+	/* the command name may contain spaces, the fields after it do not */
+	size_t comm_end = stat.rfind(')');
+	if (comm_end == std::string::npos)
+		return -1;
+	std::vector<std::string> fields = base::SplitString(stat.substr(comm_end + 2), " ",
+		base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL);
+	/* starttime is field 22, the fields here start from field 3 */
+	const size_t kStartTime = 22 - 3;
+	if (fields.size() <= kStartTime)
+		return -1;
+	int64_t ticks = strtoll(fields[kStartTime].c_str(), nullptr, 10);
+	return ticks * 1000000 / sysconf(_SC_CLK_TCK);
+}
+
+/* called with the lock held */
+void Record(Profile* profile, const char* name, int64_t us)
+{
+	if (!profile->recorded.insert(name).second)
+		return;
+	std::string line = base::StringPrintf("%s %s %s %" PRId64 "\n",
+		profile->boot_id.c_str(), profile->process.c_str(), name, us);
+	/* a single short append is not interleaved with the other daemons */
+	if (!base::WriteFileDescriptor(profile->fd, line.data(), line.size()))
+		PLOG(WARNING) << "Unable to record the startup milestone " << name;
+}
+
+}  // namespace
+
+void Init(const char* process)
+{
+	char value[PROPERTY_VALUE_MAX];
+	property_get(kEnableProperty, value, "0");
+	if (strcmp(value, "1") != 0)
+		return;
+
+	Profile* profile = GetProfile();
+	std::lock_guard<std::mutex> guard(profile->lock);
+	if (profile->fd >= 0)
+		return;
+	if (!base::ReadFileToString(base::FilePath("/proc/sys/kernel/random/boot_id"),
+	                            &profile->boot_id)) {
+		PLOG(WARNING) << "Unable to read the boot id";
+		return;
+	}
+	base::TrimWhitespaceASCII(profile->boot_id, base::TRIM_ALL, &profile->boot_id);
+	profile->fd = open(kMilestoneFile, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0660);
+	if (profile->fd < 0) {
+		PLOG(WARNING) << "Unable to open " << kMilestoneFile;
+		return;
+	}
+	profile->process = process;
+
+	int64_t exec_us = ExecTimeUs();
+	if (exec_us >= 0)
+		Record(profile, "exec", exec_us);
+	Record(profile, "main", BootTimeUs());
+	profile->enabled = true;
+}
+
+void Milestone(const char* name)
+{
+	Profile* profile = GetProfile();
+	if (!profile->enabled)
+		return;
+	std::lock_guard<std::mutex> guard(profile->lock);
+	Record(profile, name, BootTimeUs());
+}
+
+}  // namespace startup
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEMO_STARTUP_PROFILE_H_
+#define DEMO_STARTUP_PROFILE_H_
+
+/* Startup milestones of the demo daemons, for boot-to-ready profiling.
+ *
+ * Recording is off unless the persist.demo.bootprof property is 1. Each
+ * milestone is then appended once per process to
+ * /data/misc/bootprof/milestones as
+ *   <boot id> <process> <milestone> <CLOCK_BOOTTIME in us>
+ * so the lines of one boot line up across the processes. The start of the
+ * process is recorded as the "exec" milestone, with the 10 ms resolution of
+ * the kernel's process accounting. tools/bootprof.py aggregates the files
+ * pulled from many boots. */
+namespace startup {
+
+/* call once from main() */
+void Init(const char* process);
+
+/* records the first occurrence of a milestone, from any thread */
+void Milestone(const char* name);
+
+}  // namespace startup
+
+#endif
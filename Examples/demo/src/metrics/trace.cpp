@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "trace.h"
+
+#include <stdio.h>
+
+#include <atomic>
+
+namespace trace {
+
+int32_t NewId()
+{
+	static std::atomic<int32_t> next_id(1);
+	int32_t id = next_id++;
+	if (id <= 0) {
+		/* 0 is the id of untracked requests */
+		next_id = 2;
+		id = 1;
+	}
+	return id;
+}
+
+}  // namespace trace
+
+#ifndef DEMO_TRACE_DISABLED
+
+namespace trace {
+
+void Mark(const char* point, int32_t id)
+{
+	if (!Enabled())
+		return;
+	char name[64];
+	snprintf(name, sizeof(name), "%s #%d", point, id);
+	ATRACE_BEGIN(name);
+	ATRACE_END();
+}
+
+}  // namespace trace
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEMO_TRACE_H_
+#define DEMO_TRACE_H_
+
+#include <stdint.h>
+
+/* Trace points written to the ftrace trace_marker through atrace, so the
+ * path of a command through mydevice, mp3-player-service and on-off-service
+ * shows up on one systrace timeline. Every point of a command's path is
+ * tagged with the correlation id the command carries across the AIDL
+ * boundary.
+ *
+ * The points cost a single flag test while tracing is off. They are turned
+ * on at run time with
+ *   atrace --async_start -a /system/bin/mydevice,/system/bin/mp3-player-service,...
+ * and compiled out altogether when DEMO_TRACE_DISABLED is defined. */
+
+namespace trace {
+
+/* a new correlation id, positive and unique within the process */
+int32_t NewId();
+
+}  // namespace trace
+
+#ifndef DEMO_TRACE_DISABLED
+
+#ifndef ATRACE_TAG
+#define ATRACE_TAG ATRACE_TAG_APP
+#endif
+#include <cutils/trace.h>
+
+namespace trace {
+
+inline bool Enabled() { return ATRACE_ENABLED(); }
+
+/* a zero length slice named "<point> #<id>" */
+void Mark(const char* point, int32_t id);
+
+/* a slice spanning the enclosing scope */
+class ScopedTrace final {
+public:
+	explicit ScopedTrace(const char* name) { ATRACE_BEGIN(name); }
+	~ScopedTrace() { ATRACE_END(); }
+};
+
+/* a slice that may start and end on different threads */
+inline void AsyncBegin(const char* name, int32_t id) { ATRACE_ASYNC_BEGIN(name, id); }
+inline void AsyncEnd(const char* name, int32_t id) { ATRACE_ASYNC_END(name, id); }
+
+}  // namespace trace
+
+#define TRACE_SCOPE(name) ::trace::ScopedTrace scoped_trace_(name)
+
+#else
+
+namespace trace {
+
+inline bool Enabled() { return false; }
+inline void Mark(const char* point, int32_t id) {}
+inline void AsyncBegin(const char* name, int32_t id) {}
+inline void AsyncEnd(const char* name, int32_t id) {}
+
+}  // namespace trace
+
+#define TRACE_SCOPE(name)
+
+#endif
+
+#endif
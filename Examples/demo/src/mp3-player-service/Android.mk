@@ -22,7 +22,23 @@ LOCAL_REQUIRED_MODULES := mediaplayer.json volume.json
 LOCAL_CFLAGS := -Wall -Werror -Wno-unused-parameter
 
 LOCAL_SRC_FILES :=	\
+	decode_ahead_source.cpp	\
+	decoder_pool.cpp	\
+	gain_stage.cpp	\
+	instrumented_source.cpp	\
+	library_index.cpp	\
+	library_scanner.cpp	\
+	library_watcher.cpp	\
+	loudness_analyzer.cpp	\
+	mmap_source.cpp	\
 	mp3-player-service.cpp	\
+	mp3_frame_header.cpp	\
+	mp3_frame_source.cpp	\
+	mp3_scanner.cpp	\
+	play_queue.cpp	\
+	track_search.cpp	\
+	track_sequencer.cpp	\
+	track_table.cpp	\
 
 LOCAL_SHARED_LIBRARIES := \
 	libbinder \
@@ -31,6 +47,7 @@ LOCAL_SHARED_LIBRARIES := \
 	libbrillo-binder \
 	libbrillo-stream \
 	libchrome \
+	libcutils \
 	libhardware \
 	libmedia \
 	libstagefright \
@@ -38,6 +55,7 @@ LOCAL_SHARED_LIBRARIES := \
 	libutils \
 
 LOCAL_STATIC_LIBRARIES := \
+	libdemo-metrics \
 	libmp3-player-service \
 
 LOCAL_C_INCLUDES := \
@@ -72,7 +90,247 @@ LOCAL_C_INCLUDES := \
 	system/core/base/include \
 
 LOCAL_SRC_FILES := \
+	aidl/brillo/demo/IMp3PlayerListener.aidl \
 	aidl/brillo/demo/IMp3PlayerService.aidl \
 	binder_constants.cpp \
+	player_snapshot.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libbinder \
+	libutils \
 
 include $(BUILD_STATIC_LIBRARY)
+
+# Unit tests, run on the device with
+#   adb shell /data/nativetest/mp3-player-service_unittests/mp3-player-service_unittests
+# The MP3 files they read are written by tools/make_mp3_corpus.py and
+# installed in data/ next to the test.
+mp3_player_test_data := \
+	free_format.mp3 \
+	id3v2_padding.mp3 \
+	truncated.mp3 \
+	vbr_xing.mp3 \
+
+define mp3-player-test-data
+include $$(CLEAR_VARS)
+LOCAL_MODULE := mp3-player-service_unittests-$(1)
+LOCAL_MODULE_CLASS := DATA
+LOCAL_MODULE_TAGS := tests
+LOCAL_MODULE_STEM := $(1)
+LOCAL_MODULE_PATH := $$(TARGET_OUT_DATA_NATIVE_TESTS)/mp3-player-service_unittests/data
+LOCAL_SRC_FILES := tests/data/$(1)
+
+include $$(BUILD_PREBUILT)
+endef
+
+$(foreach file,$(mp3_player_test_data),$(eval $(call mp3-player-test-data,$(file))))
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := mp3-player-service_unittests
+LOCAL_REQUIRED_MODULES := $(addprefix mp3-player-service_unittests-,$(mp3_player_test_data))
+LOCAL_CFLAGS := -Wall -Werror -Wno-unused-parameter
+LOCAL_SRC_FILES := \
+	gain_stage.cpp \
+	library_index.cpp \
+	library_scanner.cpp \
+	mmap_source.cpp \
+	mp3_frame_header.cpp \
+	mp3_scanner.cpp \
+	tests/gain_stage_unittest.cpp \
+	tests/library_index_unittest.cpp \
+	tests/mmap_source_unittest.cpp \
+	tests/mp3_scanner_unittest.cpp \
+	tests/track_search_unittest.cpp \
+	tests/track_sequencer_unittest.cpp \
+	track_search.cpp \
+	track_sequencer.cpp \
+	track_table.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libchrome \
+	libcutils \
+	libstagefright \
+	libstagefright_foundation \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libdemo-metrics \
+
+include $(BUILD_NATIVE_TEST)
+
+# Benchmarks, run by hand on the device, e.g.
+#   adb shell /system/bin/mp3-player-mmap-benchmark
+include $(CLEAR_VARS)
+LOCAL_MODULE := mp3-player-mmap-benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -Wall -Werror -Wno-unused-parameter
+LOCAL_SRC_FILES := \
+	benchmarks/mmap_source_benchmark.cpp \
+	mmap_source.cpp \
+	mp3_frame_header.cpp \
+	mp3_frame_source.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libchrome \
+	libcutils \
+	libstagefright \
+	libstagefright_foundation \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libdemo-metrics \
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := mp3-player-seek-benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -Wall -Werror -Wno-unused-parameter
+LOCAL_SRC_FILES := \
+	benchmarks/frame_seek_benchmark.cpp \
+	mp3_frame_header.cpp \
+	mp3_frame_source.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libchrome \
+	libcutils \
+	libstagefright \
+	libstagefright_foundation \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libdemo-metrics \
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := mp3-player-gain-benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -Wall -Werror -Wno-unused-parameter
+LOCAL_SRC_FILES := \
+	benchmarks/gain_stage_benchmark.cpp \
+	gain_stage.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libchrome \
+	libcutils \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libdemo-metrics \
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := mp3-player-crossfade-benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -Wall -Werror -Wno-unused-parameter
+LOCAL_SRC_FILES := \
+	benchmarks/crossfade_benchmark.cpp \
+	gain_stage.cpp \
+	track_sequencer.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libchrome \
+	libcutils \
+	libstagefright \
+	libstagefright_foundation \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libdemo-metrics \
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := mp3-player-scan-benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -Wall -Werror -Wno-unused-parameter
+LOCAL_SRC_FILES := \
+	benchmarks/mp3_scanner_benchmark.cpp \
+	mp3_frame_header.cpp \
+	mp3_scanner.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libchrome \
+	libcutils \
+	libstagefright \
+	libstagefright_foundation \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libdemo-metrics \
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := mp3-player-footprint-benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -Wall -Werror -Wno-unused-parameter
+LOCAL_SRC_FILES := \
+	benchmarks/footprint_benchmark.cpp \
+	library_index.cpp \
+	library_scanner.cpp \
+	mp3_frame_header.cpp \
+	mp3_scanner.cpp \
+	play_queue.cpp \
+	track_table.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libchrome \
+	libcutils \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libdemo-metrics \
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := mp3-player-search-benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -Wall -Werror -Wno-unused-parameter
+LOCAL_SRC_FILES := \
+	benchmarks/track_search_benchmark.cpp \
+	library_index.cpp \
+	library_scanner.cpp \
+	mp3_frame_header.cpp \
+	mp3_scanner.cpp \
+	track_search.cpp \
+	track_table.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libchrome \
+	libcutils \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libdemo-metrics \
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := mp3-player-first-sample-benchmark
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -Wall -Werror -Wno-unused-parameter
+LOCAL_SRC_FILES := \
+	benchmarks/first_sample_benchmark.cpp \
+	decode_ahead_source.cpp \
+	decoder_pool.cpp \
+	gain_stage.cpp \
+	mp3_frame_header.cpp \
+	mp3_frame_source.cpp \
+	track_sequencer.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libchrome \
+	libcutils \
+	libmedia \
+	libstagefright \
+	libstagefright_foundation \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libdemo-metrics \
+
+include $(BUILD_EXECUTABLE)
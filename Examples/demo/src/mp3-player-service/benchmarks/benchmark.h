@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_BENCHMARK_H_
+#define MP3_PLAYER_BENCHMARK_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "metrics.h"
+
+/* The timing loop shared by the benchmarks of the service. Each benchmark
+ * is an executable that sets up its own data and prints one line per case,
+ * so runs on two builds or two settings can be diffed. */
+namespace bench {
+
+/* runs the workload, which does ops operations per call, until it took at
+   least minUs, and returns the time per operation in nanoseconds */
+template <typename Workload>
+double NsPerOp(Workload workload, uint64_t ops, int64_t minUs = 200000)
+{
+	/* once untimed, for the caches and the lazy setups */
+	workload();
+	uint64_t calls = 0;
+	int64_t startUs = metrics::NowUs();
+	int64_t elapsedUs;
+	do {
+		workload();
+		calls++;
+		elapsedUs = metrics::NowUs() - startUs;
+	} while (elapsedUs < minUs);
+	return elapsedUs * 1000.0 / (calls * ops);
+}
+
+inline void Report(const char* name, double nsPerOp)
+{
+	printf("%-40s %12.1f ns/op\n", name, nsPerOp);
+}
+
+/* with the throughput of bytesPerOp bytes per operation */
+inline void ReportBytes(const char* name, double nsPerOp, double bytesPerOp)
+{
+	printf("%-40s %12.1f ns/op %10.1f MB/s\n", name, nsPerOp, bytesPerOp * 1000.0 / nsPerOp);
+}
+
+/* with the operations per second, counted in units */
+inline void ReportRate(const char* name, double nsPerOp, const char* units)
+{
+	printf("%-40s %12.1f ns/op %10.0f %s/s\n", name, nsPerOp, 1e9 / nsPerOp, units);
+}
+
+}  // namespace bench
+
+#endif
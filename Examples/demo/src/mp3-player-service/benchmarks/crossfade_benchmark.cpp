@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Times the reads of TrackSequencer over two tracks of 16 bit stereo at
+ * 44.1 kHz, decoded ahead in memory: played one after the other, at unity
+ * and at a normalization gain, and with a crossfade of a second, during
+ * which every buffer of the outgoing track has one of the incoming track
+ * mixed in. The time is per 10 ms buffer handed to the AudioPlayer.
+ *
+ * usage: mp3-player-crossfade-benchmark */
+
+#include <string.h>
+
+#include <vector>
+
+#include <base/bind.h>
+#include <base/bind_helpers.h>
+#include <base/message_loop/message_loop.h>
+#include <base/run_loop.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaData.h>
+
+#include "benchmark.h"
+#include "track_sequencer.h"
+
+using android::MediaBuffer;
+using android::MediaSource;
+using android::MetaData;
+using android::sp;
+using android::status_t;
+
+namespace {
+
+const int kSampleRate = 44100;
+const int kChannels = 2;
+const size_t kBufferFrames = 441;
+const int64_t kTrackUs = 4000000;
+const size_t kTrackBuffers = kTrackUs / 10000;
+
+/* A decoded track, the same 10 ms of PCM over and over */
+class PcmSource : public MediaSource {
+public:
+	explicit PcmSource(const std::vector<int16_t>& pcm) : pcm_(pcm) {}
+
+	status_t start(MetaData* params) override { return android::OK; }
+	status_t stop() override { return android::OK; }
+	sp<MetaData> getFormat() override {
+		sp<MetaData> format = new MetaData;
+		format->setInt32(android::kKeySampleRate, kSampleRate);
+		format->setInt32(android::kKeyChannelCount, kChannels);
+		return format;
+	}
+	status_t read(MediaBuffer** buffer, const ReadOptions* options) override {
+		if (read_ == kTrackBuffers)
+			return android::ERROR_END_OF_STREAM;
+		size_t bytes = pcm_.size() * sizeof(int16_t);
+		*buffer = new MediaBuffer(bytes);
+		memcpy((*buffer)->data(), pcm_.data(), bytes);
+		(*buffer)->meta_data()->setInt64(android::kKeyTime, (int64_t)read_ * 10000);
+		read_++;
+		return android::OK;
+	}
+
+private:
+	const std::vector<int16_t>& pcm_;
+	size_t read_ = 0;
+};
+
+/* plays the two tracks through, and returns the buffers read */
+size_t Play(const std::vector<int16_t>& pcm, float gain, int64_t crossfadeUs)
+{
+	sp<MediaSource> first = new PcmSource(pcm);
+	sp<MediaSource> second = new PcmSource(pcm);
+	sp<TrackSequencer> sequencer =
+		new TrackSequencer(first, kTrackUs, gain, base::Bind(&base::DoNothing));
+	sequencer->SetCrossfade(crossfadeUs);
+	sequencer->start(nullptr);
+	MediaBuffer* buffer;
+	second->read(&buffer, nullptr);
+	sequencer->SetNext(second, kTrackUs, gain, buffer);
+
+	size_t buffers = 0;
+	while (sequencer->read(&buffer, nullptr) == android::OK) {
+		buffer->release();
+		buffers++;
+	}
+	sequencer->stop();
+	/* the stops of the finished tracks */
+	base::RunLoop().RunUntilIdle();
+	return buffers;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	base::MessageLoop message_loop;
+	std::vector<int16_t> pcm(kBufferFrames * kChannels);
+	for (size_t i = 0; i < pcm.size(); i++)
+		pcm[i] = (i * 7919) % 20000 - 10000;
+
+	size_t buffers = Play(pcm, 1.0f, 0);
+	double ns = bench::NsPerOp([&]() { Play(pcm, 1.0f, 0); }, buffers);
+	bench::Report("gapless, unity gain", ns);
+	ns = bench::NsPerOp([&]() { Play(pcm, 0.7f, 0); }, buffers);
+	bench::Report("gapless, track gain", ns);
+
+	/* a part of the last buffer of the outgoing track is left over */
+	buffers = Play(pcm, 0.7f, 1000000);
+	ns = bench::NsPerOp([&]() { Play(pcm, 0.7f, 1000000); }, buffers);
+	bench::Report("crossfade of 1 s, track gain", ns);
+	return 0;
+}
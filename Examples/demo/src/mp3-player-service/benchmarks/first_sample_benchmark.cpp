@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Times a track from the request to play it to its first sample taken by
+ * the sink, along the path of PlayStagefrightMp3() in the service: the
+ * extractor on the file held in memory, the frames read through
+ * Mp3FrameSource, a decoder from the DecoderPool, then the TrackSequencer
+ * and the DecodeAheadSource read by an AudioPlayer.
+ *
+ * With a new sink, as in a cold pipeline or once a parked one is
+ * released, each track sets up a codec, an AudioPlayer and its AudioTrack,
+ * and tears them down after. With the parked sink, as after a stop of a
+ * warm pipeline, the track takes the place of the last one in the
+ * sequencer with the codec that one left in the pool, and the sink
+ * resumes after a seek.
+ *
+ * The open of the extractor and the open to the first decoded buffer are
+ * timed on their own too, to tell where the time goes. The playback is
+ * muted.
+ *
+ * usage: mp3-player-first-sample-benchmark */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/bind_helpers.h>
+#include <base/message_loop/message_loop.h>
+#include <base/run_loop.h>
+#include <media/stagefright/AudioPlayer.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaExtractor.h>
+#include <media/stagefright/MetaData.h>
+
+#include "benchmark.h"
+#include "decode_ahead_source.h"
+#include "decoder_pool.h"
+#include "gain_stage.h"
+#include "mp3_frame_source.h"
+#include "synthetic_mp3.h"
+#include "track_sequencer.h"
+
+using android::AudioPlayer;
+using android::MediaBuffer;
+using android::MediaSource;
+using android::MetaData;
+using android::sp;
+
+namespace {
+
+const int kTrackSeconds = 240;
+/* as in the service */
+const int kDecodeAheadMs = 500;
+/* the timed plays of each sink */
+const int kPlays = 20;
+
+class MemorySource : public android::DataSource {
+public:
+	explicit MemorySource(const std::vector<uint8_t>& data) : data_(data) {}
+
+	android::status_t initCheck() const override { return android::OK; }
+	ssize_t readAt(off64_t offset, void* data, size_t size) override {
+		if (offset < 0 || (uint64_t)offset >= data_.size())
+			return 0;
+		size = std::min(size, data_.size() - (size_t)offset);
+		memcpy(data, &data_[offset], size);
+		return size;
+	}
+	android::status_t getSize(off64_t* size) override {
+		*size = data_.size();
+		return android::OK;
+	}
+
+private:
+	const std::vector<uint8_t>& data_;
+};
+
+/* the compressed frames of the track, as OpenTrack() of the service has them */
+sp<MediaSource> OpenFrames(const std::vector<uint8_t>& data)
+{
+	sp<android::DataSource> source = new MemorySource(data);
+	source->RegisterDefaultSniffers();
+	sp<android::MediaExtractor> extractor = reinterpret_cast<android::MediaExtractor*>(
+		android::MediaExtractor::Create(source, NULL).get());
+	if (extractor == nullptr) {
+		fprintf(stderr, "Could not extract the test track\n");
+		exit(1);
+	}
+	sp<MediaSource> track = reinterpret_cast<MediaSource*>(extractor->getTrack(0).get());
+	sp<MediaSource> frames = Mp3FrameSource::Create(source, track->getFormat());
+	return frames != nullptr ? frames : track;
+}
+
+/* opens the track and reads up to its first decoded buffer; the decoder is
+   released, to the pool if it keeps it, when the track goes */
+void FirstSample(const sp<DecoderPool>& pool, const std::vector<uint8_t>& data)
+{
+	sp<MediaSource> track = pool->Open(OpenFrames(data));
+	if (track == nullptr || track->start() != android::OK) {
+		fprintf(stderr, "Could not start a decoder\n");
+		exit(1);
+	}
+	MediaBuffer* buffer;
+	android::status_t status;
+	while ((status = track->read(&buffer, nullptr)) == android::INFO_FORMAT_CHANGED) {
+	}
+	if (status == android::OK)
+		buffer->release();
+	track->stop();
+}
+
+/* The source the sink reads, it tells when the sink took its first buffer */
+class FirstReadProbe : public MediaSource {
+public:
+	explicit FirstReadProbe(const sp<MediaSource>& source) : source_(source) {}
+
+	android::status_t start(MetaData* params) override { return source_->start(params); }
+	android::status_t stop() override { return source_->stop(); }
+	sp<MetaData> getFormat() override { return source_->getFormat(); }
+	android::status_t read(MediaBuffer** buffer, const ReadOptions* options) override {
+		android::status_t status = source_->read(buffer, options);
+		if (status == android::OK) {
+			std::lock_guard<std::mutex> guard(lock_);
+			if (!read_) {
+				read_ = true;
+				read_cond_.notify_all();
+			}
+		}
+		return status;
+	}
+	android::status_t pause() override { return source_->pause(); }
+
+	/* the next buffer read is the first one */
+	void Reset() {
+		std::lock_guard<std::mutex> guard(lock_);
+		read_ = false;
+	}
+	void WaitFirstRead() {
+		std::unique_lock<std::mutex> guard(lock_);
+		if (!read_cond_.wait_for(guard, std::chrono::seconds(5), [this]() { return read_; })) {
+			fprintf(stderr, "The sink did not read\n");
+			exit(1);
+		}
+	}
+
+private:
+	const sp<MediaSource> source_;
+	std::mutex lock_;
+	std::condition_variable read_cond_;
+	bool read_ = false;
+};
+
+/* The playback of the service, with a warm pipeline or a cold one */
+class Pipeline {
+public:
+	Pipeline(bool warm, const std::vector<uint8_t>& data)
+		: warm_(warm), data_(data), decoders_(new DecoderPool(warm)) {
+		gain_.SetGain(0.0f);
+	}
+	~Pipeline() { Release(); }
+
+	/* the microseconds from the request to the first sample at the sink */
+	int64_t Play() {
+		int64_t startUs = metrics::NowUs();
+		sp<MediaSource> track = decoders_->Open(OpenFrames(data_));
+		if (track == nullptr) {
+			fprintf(stderr, "Could not open a decoder\n");
+			exit(1);
+		}
+		int64_t durationUs = (int64_t)kTrackSeconds * 1000000;
+		if (parked_) {
+			probe_->Reset();
+			/* the seek flushes the sink of what was left of the last track */
+			if (!sequencer_->Replace(track, durationUs, 1.0f) || player_->seekTo(0) != android::OK) {
+				fprintf(stderr, "Could not resume the parked sink\n");
+				exit(1);
+			}
+			parked_ = false;
+			player_->resume();
+		} else {
+			sequencer_ = new TrackSequencer(track, durationUs, 1.0f, base::Bind(&base::DoNothing));
+			probe_ = new FirstReadProbe(new DecodeAheadSource(sequencer_, kDecodeAheadMs, &gain_));
+			player_ = new AudioPlayer(nullptr);
+			player_->setSource(probe_);
+			if (player_->start() != android::OK) {
+				fprintf(stderr, "Could not start the sink\n");
+				exit(1);
+			}
+		}
+		probe_->WaitFirstRead();
+		return metrics::NowUs() - startUs;
+	}
+	/* parks the sink as StopPlayback() does, or releases it if cold */
+	void Stop() {
+		if (!warm_) {
+			Release();
+			return;
+		}
+		player_->pause();
+		sequencer_->Clear();
+		/* the stops posted by the sequencer hand the decoder back to the pool */
+		base::RunLoop().RunUntilIdle();
+		parked_ = true;
+	}
+
+private:
+	void Release() {
+		delete player_;
+		player_ = nullptr;
+		sequencer_ = nullptr;
+		probe_ = nullptr;
+		parked_ = false;
+		base::RunLoop().RunUntilIdle();
+		decoders_->Trim();
+	}
+
+	const bool warm_;
+	const std::vector<uint8_t>& data_;
+	const sp<DecoderPool> decoders_;
+	GainStage gain_;
+	AudioPlayer* player_ = nullptr;
+	sp<TrackSequencer> sequencer_;
+	sp<FirstReadProbe> probe_;
+	bool parked_ = false;
+};
+
+/* the mean time to the first sample over kPlays, after one untimed play */
+double NsPerPlay(Pipeline* pipeline)
+{
+	pipeline->Play();
+	pipeline->Stop();
+	int64_t totalUs = 0;
+	for (int i = 0; i < kPlays; i++) {
+		totalUs += pipeline->Play();
+		pipeline->Stop();
+	}
+	return totalUs * 1000.0 / kPlays;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	base::MessageLoop message_loop;
+	std::vector<uint8_t> data = bench::SyntheticMp3(kTrackSeconds, false);
+
+	double ns = bench::NsPerOp([&]() { OpenFrames(data); }, 1);
+	bench::Report("extractor open", ns);
+
+	sp<DecoderPool> cold = new DecoderPool(false);
+	ns = bench::NsPerOp([&]() { FirstSample(cold, data); }, 1);
+	bench::Report("first buffer, new decoder", ns);
+
+	sp<DecoderPool> warm = new DecoderPool(true);
+	ns = bench::NsPerOp([&]() { FirstSample(warm, data); }, 1);
+	bench::Report("first buffer, pooled decoder", ns);
+	warm->Trim();
+
+	Pipeline cold_pipeline(false, data);
+	bench::Report("first sample, new sink", NsPerPlay(&cold_pipeline));
+	Pipeline warm_pipeline(true, data);
+	bench::Report("first sample, parked sink", NsPerPlay(&warm_pipeline));
+	return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Measures the memory the playlist takes per track: TrackTable and
+ * PlayQueue as the service keeps them after the warmup, and the vector of
+ * TrackInfo they replaced. Each is measured twice, as it accounts for
+ * itself in MemoryBytes(), which is what library.bytesPerTrack records,
+ * and as the growth of the heap, which includes the overhead of the
+ * allocator for the size of each block. The libraries are synthetic, 10
+ * tracks to an album and 5 albums to an artist, with paths and tags of
+ * usual lengths. The load time includes formatting the tracks.
+ *
+ * usage: mp3-player-footprint-benchmark */
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "library_index.h"
+#include "metrics.h"
+#include "play_queue.h"
+#include "track_table.h"
+
+namespace {
+
+const size_t kLibrarySizes[] = { 1000, 10000, 100000 };
+
+/* the blocks allocated with new, at the size the allocator gave them */
+std::atomic<size_t> heap_bytes{0};
+
+size_t HeapBytes()
+{
+	return heap_bytes.load();
+}
+
+TrackInfo Track(size_t i)
+{
+	char buffer[128];
+	TrackInfo info;
+	snprintf(buffer, sizeof(buffer), "/data/media/music/Artist %04zu/Album %02zu/%02zu - Title %zu.mp3",
+	         i / 50, i / 10 % 5, i % 10 + 1, i);
+	info.path = buffer;
+	snprintf(buffer, sizeof(buffer), "Title %zu", i);
+	info.title = buffer;
+	snprintf(buffer, sizeof(buffer), "Artist %04zu", i / 50);
+	info.artist = buffer;
+	info.size = 4000000 + i;
+	info.mtimeNs = 1440000000000000000LL + i;
+	info.durationMs = 240000;
+	info.bitrate = 128000;
+	return info;
+}
+
+/* the heap block of a string of the track, none if it is stored inline */
+size_t StringBytes(const TrackInfo& info, const std::string& value)
+{
+	const char* data = value.data();
+	bool inline_ = data >= reinterpret_cast<const char*>(&info) &&
+	               data < reinterpret_cast<const char*>(&info + 1);
+	return inline_ ? 0 : value.capacity() + 1;
+}
+
+void Report(const char* name, size_t tracks, size_t accounted, size_t heap)
+{
+	printf("%-24s %7zu tracks %8.1f bytes/track, %8.1f on the heap\n", name, tracks,
+	       (double)accounted / tracks, (double)heap / tracks);
+}
+
+void Measure(size_t count)
+{
+	/* the vector, sized exactly; the heap holds its strings besides */
+	size_t before = HeapBytes();
+	std::unique_ptr<std::vector<TrackInfo>> infos(new std::vector<TrackInfo>);
+	infos->reserve(count);
+	size_t strings = 0;
+	for (size_t i = 0; i < count; i++) {
+		infos->push_back(Track(i));
+		const TrackInfo& info = infos->back();
+		strings += StringBytes(info, info.path) + StringBytes(info, info.title) +
+		           StringBytes(info, info.artist);
+	}
+	Report("vector<TrackInfo>", count, count * sizeof(TrackInfo) + strings, HeapBytes() - before);
+	infos.reset();
+
+	/* loaded as at the warmup, in path order */
+	before = HeapBytes();
+	int64_t startUs = metrics::NowUs();
+	std::unique_ptr<TrackTable> tracks(new TrackTable);
+	for (size_t i = 0; i < count; i++) {
+		bool added;
+		tracks->Put(Track(i), &added);
+	}
+	tracks->ShrinkToFit();
+	int64_t loadUs = metrics::NowUs() - startUs;
+	Report("TrackTable", count, tracks->MemoryBytes(), HeapBytes() - before);
+
+	before = HeapBytes();
+	std::unique_ptr<PlayQueue> queue(new PlayQueue(tracks.get()));
+	for (size_t i = 0; i < count; i++)
+		queue->OnAdded(tracks->At(i));
+	queue->SetCurrent(tracks->At(0));
+	queue->SetShuffle(true);
+	for (int i = 0; i < 100; i++)
+		queue->Next();
+	Report("PlayQueue, shuffled", count, queue->MemoryBytes(), HeapBytes() - before);
+	printf("%-24s %7zu tracks %8.1f ns/track to load\n", "TrackTable", count,
+	       loadUs * 1000.0 / count);
+}
+
+}  // namespace
+
+void* operator new(size_t size)
+{
+	void* p = malloc(size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	heap_bytes += malloc_usable_size(p);
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	if (p != nullptr)
+		heap_bytes -= malloc_usable_size(p);
+	free(p);
+}
+
+int main(int argc, char** argv)
+{
+	for (size_t count : kLibrarySizes)
+		Measure(count);
+	return 0;
+}
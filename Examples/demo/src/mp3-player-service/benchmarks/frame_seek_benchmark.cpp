@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Times the seeks of Mp3FrameSource in a 10 minute track held in memory:
+ * the first seek of a constant bitrate stream, which scans the frame
+ * headers up to the target, the seeks within the frame table built by
+ * then, and the jumps through the Xing table of contents of a variable
+ * bitrate stream. Reading the frames from the start up to the target, as
+ * a source without an index has to, is the baseline; it does not even
+ * count the decoding that would go with it.
+ *
+ * usage: mp3-player-seek-benchmark */
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MetaData.h>
+
+#include "benchmark.h"
+#include "mp3_frame_source.h"
+#include "synthetic_mp3.h"
+
+using android::MediaBuffer;
+using android::MediaSource;
+using android::MetaData;
+using android::sp;
+
+namespace {
+
+const int kTrackSeconds = 600;
+const int kSeeks = 64;
+
+class MemorySource : public android::DataSource {
+public:
+	explicit MemorySource(const std::vector<uint8_t>& data) : data_(data) {}
+
+	android::status_t initCheck() const override { return android::OK; }
+	ssize_t readAt(off64_t offset, void* data, size_t size) override {
+		if (offset < 0 || (uint64_t)offset >= data_.size())
+			return 0;
+		size = std::min(size, data_.size() - (size_t)offset);
+		memcpy(data, &data_[offset], size);
+		return size;
+	}
+	android::status_t getSize(off64_t* size) override {
+		*size = data_.size();
+		return android::OK;
+	}
+
+private:
+	const std::vector<uint8_t>& data_;
+};
+
+/* the position of the i-th seek, spread over the track */
+int64_t SeekTimeUs(int i)
+{
+	return (int64_t)kTrackSeconds * 1000000 * ((i * 37) % kSeeks + 1) / (kSeeks + 2);
+}
+
+sp<Mp3FrameSource> Open(const std::vector<uint8_t>& data)
+{
+	sp<Mp3FrameSource> frames = Mp3FrameSource::Create(new MemorySource(data), new MetaData);
+	frames->start(nullptr);
+	return frames;
+}
+
+void SeekAndRead(const sp<Mp3FrameSource>& frames, int64_t timeUs)
+{
+	MediaSource::ReadOptions options;
+	options.setSeekTo(timeUs);
+	MediaBuffer* buffer;
+	if (frames->read(&buffer, &options) == android::OK)
+		buffer->release();
+}
+
+void ReadUpTo(const sp<Mp3FrameSource>& frames, int64_t timeUs)
+{
+	MediaBuffer* buffer;
+	while (frames->read(&buffer, nullptr) == android::OK) {
+		int64_t frameUs = 0;
+		buffer->meta_data()->findInt64(android::kKeyTime, &frameUs);
+		buffer->release();
+		if (frameUs >= timeUs)
+			break;
+	}
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	std::vector<uint8_t> cbr = bench::SyntheticMp3(kTrackSeconds, false);
+	std::vector<uint8_t> vbr = bench::SyntheticMp3(kTrackSeconds, true);
+
+	/* a new source each time, the time to open it included */
+	double ns = bench::NsPerOp([&]() {
+		for (int i = 0; i < kSeeks; i++)
+			SeekAndRead(Open(cbr), SeekTimeUs(i));
+	}, kSeeks);
+	bench::Report("first seek, header scan", ns);
+
+	sp<Mp3FrameSource> indexed = Open(cbr);
+	SeekAndRead(indexed, (int64_t)kTrackSeconds * 1000000 - 1000000);
+	ns = bench::NsPerOp([&]() {
+		for (int i = 0; i < kSeeks; i++)
+			SeekAndRead(indexed, SeekTimeUs(i));
+	}, kSeeks);
+	bench::Report("seek, frame table", ns);
+
+	ns = bench::NsPerOp([&]() {
+		for (int i = 0; i < kSeeks; i++)
+			SeekAndRead(Open(vbr), SeekTimeUs(i));
+	}, kSeeks);
+	bench::Report("first seek, Xing table of contents", ns);
+
+	ns = bench::NsPerOp([&]() {
+		for (int i = 0; i < kSeeks; i++)
+			ReadUpTo(Open(cbr), SeekTimeUs(i));
+	}, kSeeks);
+	bench::Report("baseline, reading up to the target", ns);
+	return 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Compares MmapSource with FileSource on what playback costs per minute
+ * of audio: a 10 minute 128 kbit/s track read frame by frame through
+ * Mp3FrameSource, as the decoder pulls it. Each line gives the CPU time of
+ * the process, the wall time and the syscalls per minute of the track,
+ * the file read from the page cache and once more after it was dropped
+ * from it. The decoding itself is the same for both sources and is left
+ * out.
+ *
+ * The read syscalls are counted by syscr of /proc/self/io; MmapSource adds
+ * an fstat() and an madvise() per readahead window, counted by
+ * mmap.readahead.
+ *
+ * usage: mp3-player-mmap-benchmark [directory for the test track] */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <media/stagefright/FileSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MetaData.h>
+
+#include "benchmark.h"
+#include "mmap_source.h"
+#include "mp3_frame_source.h"
+#include "synthetic_mp3.h"
+
+using android::DataSource;
+using android::MediaBuffer;
+using android::sp;
+
+namespace {
+
+const int kTrackSeconds = 600;
+const double kTrackMinutes = kTrackSeconds / 60.0;
+/* the cached passes are repeated for at least this much CPU time */
+const int64_t kMinCpuUs = 500000;
+
+struct Usage {
+	int64_t cpuUs;
+	int64_t wallUs;
+	uint64_t syscalls;
+};
+
+int64_t CpuUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t ReadSyscalls()
+{
+	FILE* io = fopen("/proc/self/io", "re");
+	if (io == nullptr)
+		return 0;
+	char line[128];
+	unsigned long long syscr = 0;
+	while (fgets(line, sizeof(line), io) != nullptr) {
+		if (sscanf(line, "syscr: %llu", &syscr) == 1)
+			break;
+	}
+	fclose(io);
+	return syscr;
+}
+
+uint64_t ReadaheadWindows()
+{
+	return metrics::Registry::Get()->GetCounter("mmap.readahead")->value();
+}
+
+/* the syscalls of the process so far, less the reads of /proc/self/io
+   made to count them */
+uint64_t Syscalls()
+{
+	static uint64_t countingReads = 0;
+	if (countingReads == 0) {
+		uint64_t first = ReadSyscalls();
+		countingReads = ReadSyscalls() - first;
+	}
+	return ReadSyscalls() + 2 * ReadaheadWindows() - countingReads;
+}
+
+Usage Now()
+{
+	return Usage{ CpuUs(), metrics::NowUs(), Syscalls() };
+}
+
+std::string CreateTrack(const std::string& directory)
+{
+	std::string path = directory + "/mmap-benchmark.mp3";
+	std::vector<uint8_t> track = bench::SyntheticMp3(kTrackSeconds, false);
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0 || write(fd, track.data(), track.size()) != (ssize_t)track.size()) {
+		perror(path.c_str());
+		exit(1);
+	}
+	fsync(fd);
+	close(fd);
+	return path;
+}
+
+void DropFromPageCache(const std::string& path)
+{
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+/* the frames of the whole track, as the decoder reads them */
+void Play(const sp<DataSource>& source)
+{
+	sp<Mp3FrameSource> frames = Mp3FrameSource::Create(source, new android::MetaData);
+	if (frames == nullptr) {
+		fprintf(stderr, "No MPEG audio in the test track\n");
+		exit(1);
+	}
+	frames->start(nullptr);
+	MediaBuffer* buffer;
+	while (frames->read(&buffer, nullptr) == android::OK)
+		buffer->release();
+	frames->stop();
+}
+
+void Report(const char* name, const Usage& start, const Usage& end, int plays)
+{
+	double minutes = kTrackMinutes * plays;
+	printf("%-32s %10.1f us cpu/min %10.1f us/min %10.1f syscalls/min\n", name,
+	       (end.cpuUs - start.cpuUs) / minutes, (end.wallUs - start.wallUs) / minutes,
+	       (end.syscalls - start.syscalls) / minutes);
+}
+
+void Run(const char* name, const std::string& path,
+         sp<DataSource> (*open)(const std::string& path))
+{
+	std::string prefix(name);
+	/* once untimed, for the page cache and the lazy setups */
+	Play(open(path));
+	int plays = 0;
+	Usage start = Now();
+	do {
+		Play(open(path));
+		plays++;
+	} while (CpuUs() - start.cpuUs < kMinCpuUs);
+	Report((prefix + ", cached").c_str(), start, Now(), plays);
+
+	DropFromPageCache(path);
+	start = Now();
+	Play(open(path));
+	Report((prefix + ", cold").c_str(), start, Now(), 1);
+}
+
+sp<DataSource> OpenFileSource(const std::string& path)
+{
+	return new android::FileSource(path.c_str());
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	std::string path = CreateTrack(argc > 1 ? argv[1] : "/data/local/tmp");
+	Run("FileSource", path, &OpenFileSource);
+	Run("MmapSource", path, &MmapSource::Open);
+	unlink(path.c_str());
+	return 0;
+}
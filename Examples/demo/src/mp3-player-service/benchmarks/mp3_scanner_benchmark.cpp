@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Times the probe of a library track: Mp3Scanner, as LibraryIndex uses
+ * it, against the MediaExtractor it replaced. The library is 128 files of
+ * 10 s, half at a constant bitrate after a 4 KB ID3v2 tag and half
+ * variable with a Xing header, scanned from the page cache, and once more
+ * after they were dropped from it.
+ *
+ * usage: mp3-player-scan-benchmark [directory for the test files] */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <media/stagefright/FileSource.h>
+#include <media/stagefright/MediaExtractor.h>
+#include <media/stagefright/MetaData.h>
+
+#include "benchmark.h"
+#include "mp3_scanner.h"
+#include "synthetic_mp3.h"
+
+namespace {
+
+const int kFiles = 128;
+const int kTrackSeconds = 10;
+
+std::vector<std::string> CreateLibrary(const std::string& directory)
+{
+	std::vector<uint8_t> cbr = bench::SyntheticMp3(kTrackSeconds, false, 4096);
+	std::vector<uint8_t> vbr = bench::SyntheticMp3(kTrackSeconds, true);
+	std::vector<std::string> paths;
+	for (int i = 0; i < kFiles; i++) {
+		char name[64];
+		snprintf(name, sizeof(name), "/scan-benchmark-%03d.mp3", i);
+		std::string path = directory + name;
+		const std::vector<uint8_t>& data = i % 2 ? vbr : cbr;
+		int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		if (fd < 0 || write(fd, data.data(), data.size()) != (ssize_t)data.size()) {
+			perror(path.c_str());
+			exit(1);
+		}
+		fsync(fd);
+		close(fd);
+		paths.push_back(path);
+	}
+	return paths;
+}
+
+void DropFromPageCache(const std::vector<std::string>& paths)
+{
+	for (const auto& path : paths) {
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+
+void Scan(const std::vector<std::string>& paths)
+{
+	static Mp3Scanner scanner;
+	Mp3ScanResult result;
+	for (const auto& path : paths)
+		scanner.Scan(path.c_str(), &result);
+}
+
+/* the probe of LibraryIndex before Mp3Scanner */
+void Extract(const std::vector<std::string>& paths)
+{
+	for (const auto& path : paths) {
+		android::sp<android::FileSource> source = new android::FileSource(path.c_str());
+		if (source->initCheck() != android::OK)
+			continue;
+		source->RegisterDefaultSniffers();
+		android::sp<android::MediaExtractor> extractor =
+			reinterpret_cast<android::MediaExtractor*>(
+				android::MediaExtractor::Create(source, NULL).get());
+		if (extractor == nullptr || extractor->countTracks() == 0)
+			continue;
+		android::sp<android::MetaData> format = extractor->getTrackMetaData(0);
+		int64_t durationUs;
+		if (format != nullptr)
+			format->findInt64(android::kKeyDuration, &durationUs);
+		android::sp<android::MetaData> meta = extractor->getMetaData();
+		const char* title;
+		if (meta != nullptr)
+			meta->findCString(android::kKeyTitle, &title);
+	}
+}
+
+void Run(const char* name, const std::vector<std::string>& paths,
+         void (*probe)(const std::vector<std::string>& paths))
+{
+	std::string prefix(name);
+	double ns = bench::NsPerOp([&]() { probe(paths); }, paths.size());
+	bench::ReportRate((prefix + ", warm cache").c_str(), ns, "files");
+
+	/* from the storage, timed once */
+	DropFromPageCache(paths);
+	int64_t startUs = metrics::NowUs();
+	probe(paths);
+	ns = (metrics::NowUs() - startUs) * 1000.0 / paths.size();
+	bench::ReportRate((prefix + ", cold").c_str(), ns, "files");
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> paths = CreateLibrary(argc > 1 ? argv[1] : "/data/local/tmp");
+	Run("Mp3Scanner", paths, &Scan);
+	Run("MediaExtractor", paths, &Extract);
+	for (const auto& path : paths)
+		unlink(path.c_str());
+	return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_SYNTHETIC_MP3_H_
+#define MP3_PLAYER_SYNTHETIC_MP3_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+/* MPEG-1 layer III streams at 44.1 kHz for the benchmarks, with valid
+ * frame headers and silent payloads: what the header-only readers of the
+ * service look at, at the size of real tracks. */
+namespace bench {
+
+/* the bitrate indices a VBR stream goes through, 128 to 256 kbit/s */
+const int kVbrBitrateIndices[] = { 9, 11, 13, 10, 12, 9, 14, 11 };
+
+inline size_t FrameBytes(int bitrateIndex)
+{
+	static const int kKbps[] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+	return 144 * kKbps[bitrateIndex] * 1000 / 44100;
+}
+
+inline void AppendFrame(int bitrateIndex, std::vector<uint8_t>* out)
+{
+	size_t offset = out->size();
+	out->resize(offset + FrameBytes(bitrateIndex));
+	(*out)[offset] = 0xff;
+	(*out)[offset + 1] = 0xfb;
+	(*out)[offset + 2] = bitrateIndex << 4;
+	(*out)[offset + 3] = 0x00;
+}
+
+inline void PutBE32(uint8_t* p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+}
+
+/* a stream of the given length, constant at 128 kbit/s or variable with a
+   Xing header and its table of contents, after an ID3v2 tag of tagBytes
+   (10 at least) if tagBytes is not 0 */
+inline std::vector<uint8_t> SyntheticMp3(int seconds, bool vbr, size_t tagBytes = 0)
+{
+	std::vector<uint8_t> out;
+	if (tagBytes >= 10) {
+		out.resize(tagBytes);
+		memcpy(out.data(), "ID3\x03\x00\x00", 6);
+		size_t length = tagBytes - 10;
+		for (int i = 0; i < 4; i++)
+			out[9 - i] = (length >> (7 * i)) & 0x7f;
+	}
+	uint32_t frames = (uint64_t)seconds * 44100 / 1152;
+	if (!vbr) {
+		for (uint32_t i = 0; i < frames; i++)
+			AppendFrame(9, &out);
+		return out;
+	}
+
+	size_t xing = out.size();
+	AppendFrame(9, &out);
+	std::vector<uint64_t> offsets;
+	for (uint32_t i = 0; i < frames; i++) {
+		offsets.push_back(out.size() - xing);
+		AppendFrame(kVbrBitrateIndices[i % 8], &out);
+	}
+	uint8_t* tag = &out[xing + 4 + 32];
+	memcpy(tag, "Xing", 4);
+	PutBE32(tag + 4, 7);
+	PutBE32(tag + 8, frames);
+	PutBE32(tag + 12, out.size() - xing);
+	for (int i = 0; i < 100; i++)
+		tag[16 + i] = offsets[(uint64_t)frames * i / 100] * 256 / (out.size() - xing);
+	return out;
+}
+
+}  // namespace bench
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Times TrackSearch over a synthetic library of 100000 tracks, titles and
+ * artists made of words from a short list: the rebuild of the index and its
+ * size, then each kind of query, from the exact title down to the fuzzy
+ * match of a typo and a miss. The scan of every display name for the query,
+ * as the service searched without an index, is the baseline.
+ *
+ * usage: mp3-player-search-benchmark [tracks] */
+
+#include <ctype.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+
+#include "benchmark.h"
+#include "library_index.h"
+#include "track_search.h"
+#include "track_table.h"
+
+namespace {
+
+const char* const kWords[] = {
+	"love", "night", "blue", "heart", "river", "dream", "fire", "summer", "rain", "road",
+	"light", "home", "golden", "wild", "moon", "city", "shadow", "dance", "star", "ocean",
+	"silver", "angel", "storm", "paper", "morning", "stone", "glass", "winter", "echo",
+	"velvet", "thunder", "garden", "mirror", "highway", "sugar", "diamond", "lonely",
+	"electric", "yellow", "midnight",
+};
+const size_t kWordCount = sizeof(kWords) / sizeof(kWords[0]);
+
+std::string Words(uint32_t* seed, int count)
+{
+	std::string words;
+	for (int i = 0; i < count; i++) {
+		*seed = *seed * 1103515245 + 12345;
+		if (i > 0)
+			words += ' ';
+		words += kWords[(*seed >> 16) % kWordCount];
+	}
+	return words;
+}
+
+void Fill(TrackTable* tracks, size_t count)
+{
+	uint32_t seed = 1;
+	for (size_t i = 0; i < count; i++) {
+		TrackInfo info;
+		info.path = "/data/music/" + std::to_string(i / 100) + "/" + std::to_string(i) + ".mp3";
+		/* the title and artist are unique through their number */
+		info.title = Words(&seed, 1 + i % 3) + " " + std::to_string(i);
+		info.artist = Words(&seed, 2) + " " + std::to_string(i % 2000);
+		info.size = i;
+		bool added;
+		tracks->Put(info, &added);
+	}
+}
+
+std::string Lower(std::string text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+	return text;
+}
+
+/* the first display name holding the query, for the baseline */
+TrackTable::TrackId Scan(const TrackTable& tracks, const std::string& query)
+{
+	std::string lower = Lower(query);
+	for (size_t i = 0; i < tracks.size(); i++) {
+		if (Lower(tracks.DisplayName(tracks.At(i))).find(lower) != std::string::npos)
+			return tracks.At(i);
+	}
+	return TrackTable::kNoTrack;
+}
+
+void Query(const TrackSearch& search, const char* name, const std::string& query)
+{
+	double ns = bench::NsPerOp([&]() { search.Find(query); }, 1);
+	bench::Report(name, ns);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+	TrackTable tracks;
+	Fill(&tracks, count);
+
+	TrackSearch search(&tracks);
+	double ns = bench::NsPerOp([&]() { search.Rebuild(); }, count, 1000000);
+	bench::Report("rebuild, per track", ns);
+	search.ShrinkToFit();
+	printf("%-40s %12.1f bytes/track\n", "index", (double)search.MemoryBytes() / count);
+
+	TrackTable::TrackId middle = tracks.At(count / 2);
+	std::string title = tracks.Title(middle);
+	std::string artist = tracks.Artist(middle);
+	Query(search, "exact title", title);
+	Query(search, "title prefix", title.substr(0, title.size() - 2));
+	Query(search, "artist", artist);
+	Query(search, "title and artist words apart",
+	      title.substr(0, title.find(' ')) + " " + artist.substr(artist.rfind(' ') + 1));
+	Query(search, "2 letter word", "mo");
+	/* in "night", "light" and "midnight" but starting no word, every
+	   match is read */
+	Query(search, "common substring", "ight");
+	Query(search, "typo, fuzzy", "midnite " + artist);
+	Query(search, "miss", "qwertzuiop");
+
+	/* a track added then removed, as the library scanner does */
+	TrackInfo info;
+	info.path = "/data/music/new.mp3";
+	info.title = "velvet thunder new";
+	info.artist = "nobody";
+	ns = bench::NsPerOp([&]() {
+		bool added;
+		TrackTable::TrackId id = tracks.Put(info, &added);
+		search.Add(id);
+		search.Remove(id);
+		tracks.Remove(id);
+	}, 1);
+	bench::Report("re-index one track", ns);
+
+	ns = bench::NsPerOp([&]() { Scan(tracks, artist); }, 1);
+	bench::Report("baseline, scan of the display names", ns);
+	return 0;
+}
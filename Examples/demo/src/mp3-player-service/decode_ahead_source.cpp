@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "decode_ahead_source.h"
+
+#include <base/logging.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaData.h>
+
+#include "metrics.h"
+
+using android::MediaBuffer;
+using android::MediaSource;
+using android::MetaData;
+using android::sp;
+using android::status_t;
+
+namespace {
+
+/* how long a side sleeps at most before checking the ring again */
+const std::chrono::milliseconds kPollInterval(10);
+/* the AudioPlayer gets the PCM in chunks of this length */
+const int kChunkMs = 20;
+
+}  // namespace
+
+DecodeAheadSource::DecodeAheadSource(const sp<MediaSource>& source, int bufferMs,
+                                     GainStage* gain)
+	: source_(source), format_(source->getFormat()), gain_(gain)
+{
+	if (format_ != nullptr && format_->findInt32(android::kKeyChannelCount, &channels_))
+		frame_bytes_ = channels_ * sizeof(int16_t);
+	if (format_ != nullptr)
+		format_->findInt32(android::kKeySampleRate, &sample_rate_);
+	size_t frames_per_ms = (sample_rate_ + 999) / 1000;
+	ring_.reset(new PcmRingBuffer(frames_per_ms * bufferMs * frame_bytes_));
+	chunk_bytes_ = frames_per_ms * kChunkMs * frame_bytes_;
+	/* one chunk with the AudioPlayer, one being filled */
+	group_.add_buffer(new MediaBuffer(chunk_bytes_));
+	group_.add_buffer(new MediaBuffer(chunk_bytes_));
+}
+
+DecodeAheadSource::~DecodeAheadSource()
+{
+	if (started_)
+		stop();
+}
+
+status_t DecodeAheadSource::start(MetaData* params)
+{
+	status_t status = source_->start(params);
+	if (status != android::OK)
+		return status;
+	started_ = true;
+	gain_->Reset();
+	thread_ = std::thread(&DecodeAheadSource::DecodeLoop, this);
+	return android::OK;
+}
+
+status_t DecodeAheadSource::stop()
+{
+	if (!started_)
+		return android::OK;
+	started_ = false;
+	stopping_ = true;
+	cond_.notify_all();
+	thread_.join();
+	return source_->stop();
+}
+
+sp<MetaData> DecodeAheadSource::getFormat()
+{
+	return format_;
+}
+
+status_t DecodeAheadSource::read(MediaBuffer** buffer, const ReadOptions* options)
+{
+	int64_t seekTimeUs;
+	ReadOptions::SeekMode seekMode;
+	if (options && options->getSeekTo(&seekTimeUs, &seekMode))
+		Seek(seekTimeUs, seekMode);
+
+	size_t readable = ring_->readable();
+	if (readable < frame_bytes_ && !eos_) {
+		/* the ring is empty before the first buffer too, that is no underrun */
+		if (delivered_) {
+			METRICS_COUNT("decode.underruns");
+			underruns_.fetch_add(1, std::memory_order_relaxed);
+		}
+		std::unique_lock<std::mutex> guard(lock_);
+		while ((readable = ring_->readable()) < frame_bytes_ && !eos_ && !stopping_)
+			cond_.wait_for(guard, kPollInterval);
+	}
+	if (readable < frame_bytes_) {
+		/* the ring is drained only after the decoder thread set eos_ */
+		readable = ring_->readable();
+		if (readable < frame_bytes_)
+			return final_status_;
+	}
+	METRICS_RECORD("decode.fill_ms", readable * 1000 / (frame_bytes_ * sample_rate_));
+
+	MediaBuffer* out;
+	status_t status = group_.acquire_buffer(&out);
+	if (status != android::OK)
+		return status;
+	uint64_t position = ring_->read_position();
+	size_t size = std::min(readable, chunk_bytes_);
+	size -= size % frame_bytes_;
+	ring_->Read(static_cast<uint8_t*>(out->data()), size);
+	gain_->Process(static_cast<int16_t*>(out->data()), size / frame_bytes_, channels_, sample_rate_);
+	out->set_range(0, size);
+	out->meta_data()->clear();
+	out->meta_data()->setInt64(android::kKeyTime, MediaTimeUs(position));
+	/* there is space for the decoder thread now */
+	cond_.notify_one();
+	delivered_ = true;
+	if (start_us_.load(std::memory_order_relaxed) != 0) {
+		int64_t startUs = start_us_.exchange(0, std::memory_order_relaxed);
+		if (startUs != 0)
+			METRICS_RECORD_ROLLING("playback.first_audio", metrics::NowUs() - startUs);
+	}
+	*buffer = out;
+	return android::OK;
+}
+
+/* the time of the PCM at a ring position, from the marks of the decoder */
+int64_t DecodeAheadSource::MediaTimeUs(uint64_t position)
+{
+	TimeMark mark;
+	while (marks_.Peek(&mark) && mark.position <= position) {
+		time_base_ = mark;
+		marks_.Pop();
+	}
+	return time_base_.timeUs +
+		(int64_t)((position - time_base_.position) / frame_bytes_) * 1000000 / sample_rate_;
+}
+
+/* hands the seek to the decoder thread and waits until it flushed the ring */
+void DecodeAheadSource::Seek(int64_t timeUs, ReadOptions::SeekMode mode)
+{
+	std::unique_lock<std::mutex> guard(lock_);
+	seek_pending_ = true;
+	seek_time_us_ = timeUs;
+	seek_mode_ = mode;
+	cond_.notify_all();
+	while (seek_pending_ && !stopping_)
+		cond_.wait_for(guard, kPollInterval);
+	time_base_ = { 0, timeUs };
+	/* the ring is empty after a seek, and that is no underrun either */
+	delivered_ = false;
+}
+
+void DecodeAheadSource::DecodeLoop()
+{
+	ReadOptions options;
+	while (!stopping_) {
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			if (seek_pending_) {
+				/* read() is waiting for the seek, so the ring is ours */
+				ring_->Reset();
+				marks_.Reset();
+				eos_ = false;
+				final_status_ = android::OK;
+				options.setSeekTo(seek_time_us_, seek_mode_);
+				seek_pending_ = false;
+				cond_.notify_all();
+			}
+		}
+		if (eos_) {
+			/* wait for a seek or the stop */
+			std::unique_lock<std::mutex> guard(lock_);
+			cond_.wait_for(guard, kPollInterval);
+			continue;
+		}
+
+		MediaBuffer* buffer;
+		int64_t readUs = metrics::NowUs();
+		status_t status = source_->read(&buffer, &options);
+		options.clearSeekTo();
+		if (status == android::INFO_FORMAT_CHANGED)
+			continue;
+		if (status != android::OK) {
+			std::lock_guard<std::mutex> guard(lock_);
+			final_status_ = status;
+			eos_ = true;
+			cond_.notify_all();
+			continue;
+		}
+		METRICS_RECORD_ROLLING("decode.buffer_us", metrics::NowUs() - readUs);
+		int64_t timeUs;
+		if (buffer->meta_data()->findInt64(android::kKeyTime, &timeUs))
+			marks_.Push({ ring_->write_position(), timeUs });
+		Produce(static_cast<const uint8_t*>(buffer->data()) + buffer->range_offset(),
+		        buffer->range_length());
+		buffer->release();
+	}
+}
+
+bool DecodeAheadSource::Produce(const uint8_t* data, size_t size)
+{
+	while (size > 0) {
+		size_t written = ring_->Write(data, std::min(size, ring_->writable() / frame_bytes_ * frame_bytes_));
+		data += written;
+		size -= written;
+		if (written > 0)
+			cond_.notify_one();
+		if (size == 0)
+			break;
+		std::unique_lock<std::mutex> guard(lock_);
+		if (stopping_ || seek_pending_)
+			return false;
+		cond_.wait_for(guard, kPollInterval);
+	}
+	return true;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_DECODE_AHEAD_SOURCE_H_
+#define MP3_PLAYER_DECODE_AHEAD_SOURCE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <media/stagefright/MediaBufferGroup.h>
+#include <media/stagefright/MediaSource.h>
+
+#include "gain_stage.h"
+#include "pcm_ring_buffer.h"
+
+/* Decodes ahead of the AudioPlayer on a thread of its own.
+ *
+ * The decoder thread keeps a PCM ring of the given length filled, and
+ * read() hands the AudioPlayer what is in the ring, so a decoder stall is
+ * absorbed by the buffered audio instead of starving the sink. Each read
+ * records the fill level in decode.fill_ms; a read that finds the ring
+ * empty before the end of stream is counted in decode.underruns, and in
+ * the underruns of the track taken by TakeUnderruns(). The decode time of
+ * each buffer goes into the rolling decode.buffer_us, and the time from
+ * MarkStart() to the next buffer handed out into playback.first_audio.
+ *
+ * The gain is applied as the PCM leaves the ring, so a volume change is
+ * heard after a chunk instead of after the whole decoded-ahead length. */
+class DecodeAheadSource : public android::MediaSource {
+public:
+	/* the gain stage outlives the source */
+	DecodeAheadSource(const android::sp<android::MediaSource>& source, int bufferMs,
+	                  GainStage* gain);
+
+	android::status_t start(android::MetaData* params) override;
+	android::status_t stop() override;
+	android::sp<android::MetaData> getFormat() override;
+	android::status_t read(android::MediaBuffer** buffer,
+	                       const ReadOptions* options) override;
+
+	/* the playback was asked for at startUs, from NowUs() */
+	void MarkStart(int64_t startUs) { start_us_.store(startUs, std::memory_order_relaxed); }
+	/* the underruns since the last call */
+	uint32_t TakeUnderruns() { return underruns_.exchange(0, std::memory_order_relaxed); }
+
+private:
+	/* the media time of the PCM from a ring position on */
+	struct TimeMark {
+		uint64_t position;
+		int64_t timeUs;
+	};
+
+	~DecodeAheadSource() override;
+	void DecodeLoop();
+	/* false if the copy was abandoned for a stop or a seek */
+	bool Produce(const uint8_t* data, size_t size);
+	void Seek(int64_t timeUs, ReadOptions::SeekMode mode);
+	int64_t MediaTimeUs(uint64_t position);
+
+	const android::sp<android::MediaSource> source_;
+	const android::sp<android::MetaData> format_;
+	GainStage* const gain_;
+	int32_t channels_ = 2;
+	size_t frame_bytes_ = 4;
+	int32_t sample_rate_ = 44100;
+	std::unique_ptr<PcmRingBuffer> ring_;
+	SpscQueue<TimeMark, 64> marks_;
+	android::MediaBufferGroup group_;
+	size_t chunk_bytes_;
+	bool started_ = false;
+
+	/* wakes the side waiting for data or space */
+	std::mutex lock_;
+	std::condition_variable cond_;
+	std::thread thread_;
+	std::atomic<bool> stopping_{false};
+	std::atomic<bool> eos_{false};
+	android::status_t final_status_ = android::OK;
+	/* a seek handed to the decoder thread, guarded by lock_ */
+	bool seek_pending_ = false;
+	int64_t seek_time_us_ = 0;
+	ReadOptions::SeekMode seek_mode_ = ReadOptions::SEEK_CLOSEST_SYNC;
+
+	/* read() side */
+	TimeMark time_base_ = { 0, 0 };
+	/* since the start or the last seek */
+	bool delivered_ = false;
+	/* 0 once the first buffer after it is out */
+	std::atomic<int64_t> start_us_{0};
+	std::atomic<uint32_t> underruns_{0};
+};
+
+#endif
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "decoder_pool.h"
+
+#include <base/logging.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaData.h>
+#include <media/stagefright/SimpleDecodingSource.h>
+
+#include "metrics.h"
+
+using android::MediaBuffer;
+using android::MediaSource;
+using android::MetaData;
+using android::sp;
+using android::status_t;
+
+/* The compressed source of a pooled codec, switched from track to track */
+class DecoderPool::Input : public MediaSource {
+public:
+	explicit Input(const sp<MediaSource>& source)
+		: format_(source->getFormat()), source_(source) {}
+
+	/* starts the source and stops the one it replaces */
+	status_t Switch(const sp<MediaSource>& source) {
+		status_t status = source->start();
+		if (status != android::OK)
+			return status;
+		sp<MediaSource> old;
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			old = source_;
+			source_ = source;
+		}
+		old->stop();
+		return android::OK;
+	}
+
+	status_t start(MetaData* params) override { return Source()->start(params); }
+	status_t stop() override { return Source()->stop(); }
+	/* the codec stays set up for the format of the first source */
+	sp<MetaData> getFormat() override { return format_; }
+	status_t read(MediaBuffer** buffer, const ReadOptions* options) override {
+		return Source()->read(buffer, options);
+	}
+
+private:
+	sp<MediaSource> Source() {
+		std::lock_guard<std::mutex> guard(lock_);
+		return source_;
+	}
+
+	const sp<MetaData> format_;
+	/* read by the codec, switched by the message loop */
+	std::mutex lock_;
+	sp<MediaSource> source_;
+};
+
+/* A decoder lent to one track */
+class DecoderPool::Track : public MediaSource {
+public:
+	Track(const sp<DecoderPool>& pool, const Decoder& decoder, bool reused, int64_t openUs)
+		: pool_(pool), decoder_(decoder), reused_(reused), open_us_(openUs) {}
+
+	status_t start(MetaData* params) override {
+		if (started_)
+			return android::OK;
+		/* a reused codec is running already */
+		status_t status = reused_ ? android::OK : decoder_.codec->start(params);
+		if (status != android::OK) {
+			healthy_ = false;
+			return status;
+		}
+		started_ = true;
+		if (reused_)
+			METRICS_RECORD("decoder.setup_reused", metrics::NowUs() - open_us_);
+		else
+			METRICS_RECORD("decoder.setup_new", metrics::NowUs() - open_us_);
+		return android::OK;
+	}
+	/* the codec goes on running for the pool */
+	status_t stop() override { return android::OK; }
+	sp<MetaData> getFormat() override { return decoder_.codec->getFormat(); }
+	status_t read(MediaBuffer** buffer, const ReadOptions* options) override {
+		ReadOptions flush;
+		if (reused_ && !flushed_) {
+			flushed_ = true;
+			int64_t seekTimeUs;
+			ReadOptions::SeekMode seekMode;
+			if (options == nullptr || !options->getSeekTo(&seekTimeUs, &seekMode)) {
+				flush.setSeekTo(0);
+				options = &flush;
+			}
+		}
+		status_t status = decoder_.codec->read(buffer, options);
+		if (status != android::OK && status != android::ERROR_END_OF_STREAM &&
+		    status != android::INFO_FORMAT_CHANGED)
+			healthy_ = false;
+		return status;
+	}
+
+private:
+	~Track() override {
+		if (started_ && healthy_) {
+			pool_->Release(decoder_);
+		} else if (started_) {
+			decoder_.codec->stop();
+		}
+	}
+
+	const sp<DecoderPool> pool_;
+	const Decoder decoder_;
+	const bool reused_;
+	const int64_t open_us_;
+	bool started_ = false;
+	/* a codec that failed is not lent again */
+	bool healthy_ = true;
+	/* read() runs on one thread at a time */
+	bool flushed_ = false;
+};
+
+namespace {
+
+bool FindKey(const sp<MetaData>& format, const char** mime, int32_t* sampleRate,
+             int32_t* channels)
+{
+	return format != nullptr && format->findCString(android::kKeyMIMEType, mime) &&
+	       format->findInt32(android::kKeySampleRate, sampleRate) &&
+	       format->findInt32(android::kKeyChannelCount, channels);
+}
+
+}  // namespace
+
+const size_t DecoderPool::kMaxIdle;
+
+DecoderPool::DecoderPool(bool enabled)
+	: enabled_(enabled)
+{
+}
+
+DecoderPool::~DecoderPool()
+{
+	Trim();
+}
+
+sp<MediaSource> DecoderPool::Open(const sp<MediaSource>& input)
+{
+	int64_t openUs = metrics::NowUs();
+	Decoder decoder;
+	const char* mime;
+	if (FindKey(input->getFormat(), &mime, &decoder.sampleRate, &decoder.channels))
+		decoder.mime = mime;
+
+	bool reused = false;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		for (auto it = idle_.begin(); it != idle_.end(); ++it) {
+			if (!decoder.mime.empty() && it->mime == decoder.mime &&
+			    it->sampleRate == decoder.sampleRate && it->channels == decoder.channels) {
+				decoder = *it;
+				idle_.erase(it);
+				reused = true;
+				break;
+			}
+		}
+	}
+	if (reused) {
+		if (decoder.input->Switch(input) == android::OK) {
+			METRICS_COUNT("decoder.reused");
+			return new Track(this, decoder, true, openUs);
+		}
+		LOG(WARNING) << "Could not switch a pooled decoder to the new track";
+		decoder.codec->stop();
+	}
+
+	decoder.input = new Input(input);
+	decoder.codec = android::SimpleDecodingSource::Create(decoder.input);
+	if (decoder.codec == nullptr) {
+		LOG(ERROR) << "No decoder for " << (decoder.mime.empty() ? "the track" : decoder.mime);
+		return nullptr;
+	}
+	METRICS_COUNT("decoder.created");
+	return new Track(this, decoder, false, openUs);
+}
+
+void DecoderPool::Trim()
+{
+	std::vector<Decoder> idle;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		idle.swap(idle_);
+	}
+	for (auto& decoder : idle)
+		decoder.codec->stop();
+}
+
+void DecoderPool::Release(const Decoder& decoder)
+{
+	if (enabled_ && !decoder.mime.empty()) {
+		std::lock_guard<std::mutex> guard(lock_);
+		if (idle_.size() < kMaxIdle) {
+			idle_.push_back(decoder);
+			return;
+		}
+	}
+	decoder.codec->stop();
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_DECODER_POOL_H_
+#define MP3_PLAYER_DECODER_POOL_H_
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <media/stagefright/MediaSource.h>
+#include <utils/RefBase.h>
+
+/* Keeps decoders set up across tracks, so that starting a track costs a
+ * flush of the codec instead of a new one.
+ *
+ * Open() hands out a decoder for a compressed source: an idle one set up
+ * for the same format when there is one, its input switched to the new
+ * source, or else a new one. The decoder goes back to the pool, still
+ * started, once the last reference to the track is dropped. The first read
+ * of a reused decoder seeks to the start of its new input, which flushes
+ * what the codec held of the previous track.
+ *
+ * The playing track and the one pre-rolled after it each hold a decoder,
+ * so the pool keeps two at most; Trim() releases them. Disabled, the pool
+ * sets up a decoder per track and stops it after the track, as without
+ * a pool. The time from Open() to a decoder ready is recorded in
+ * decoder.setup_new or decoder.setup_reused, and the decoders are counted
+ * in decoder.created and decoder.reused. */
+class DecoderPool : public android::RefBase {
+public:
+	explicit DecoderPool(bool enabled);
+
+	/* the source decoded, not started yet; nullptr if no codec takes it */
+	android::sp<android::MediaSource> Open(const android::sp<android::MediaSource>& input);
+	/* stops the idle decoders */
+	void Trim();
+
+private:
+	class Input;
+	class Track;
+	struct Decoder {
+		android::sp<Input> input;
+		android::sp<android::MediaSource> codec;
+		/* what the codec was set up for */
+		std::string mime;
+		int32_t sampleRate = 0;
+		int32_t channels = 0;
+	};
+
+	static const size_t kMaxIdle = 2;
+
+	~DecoderPool() override;
+	/* takes a decoder back from a track, or stops it */
+	void Release(const Decoder& decoder);
+
+	const bool enabled_;
+	std::mutex lock_;
+	std::vector<Decoder> idle_;
+};
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gain_stage.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "metrics.h"
+
+namespace {
+
+#if defined(__SSE2__)
+/* the gain of the first 4 samples and the growth over 4 samples, for mono
+   or stereo */
+void InitGainVector(int channels, float gain, float step, __m128* g, __m128* inc)
+{
+	if (channels == 2) {
+		*g = _mm_setr_ps(gain, gain, gain + step, gain + step);
+		*inc = _mm_set1_ps(2 * step);
+	} else {
+		*g = _mm_setr_ps(gain, gain + step, gain + 2 * step, gain + 3 * step);
+		*inc = _mm_set1_ps(4 * step);
+	}
+}
+#endif
+
+}  // namespace
+
+void ApplyGain(int16_t* samples, size_t frames, int channels, float gain, float step)
+{
+	size_t i = 0;
+#if defined(__SSE2__)
+	if (channels <= 2) {
+		size_t count = frames * channels;
+		__m128 g_lo, g_hi, inc;
+		InitGainVector(channels, gain, step, &g_lo, &inc);
+		g_hi = _mm_add_ps(g_lo, inc);
+		inc = _mm_add_ps(inc, inc);
+		for (; i + 8 <= count; i += 8) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+			/* sign extended to 32 bits */
+			__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+			__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+			lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(lo), g_lo));
+			hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(hi), g_hi));
+			/* saturated back to 16 bits */
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(samples + i), _mm_packs_epi32(lo, hi));
+			g_lo = _mm_add_ps(g_lo, inc);
+			g_hi = _mm_add_ps(g_hi, inc);
+		}
+	}
+#endif
+	for (size_t frame = i / channels; frame < frames; frame++) {
+		float g = gain + frame * step;
+		for (int c = 0; c < channels; c++, i++) {
+			long v = lrintf(samples[i] * g);
+			samples[i] = std::min<long>(std::max<long>(v, INT16_MIN), INT16_MAX);
+		}
+	}
+}
+
+void ApplyGain(float* samples, size_t frames, int channels, float gain, float step)
+{
+	size_t i = 0;
+#if defined(__SSE2__)
+	if (channels <= 2) {
+		size_t count = frames * channels;
+		__m128 g, inc;
+		InitGainVector(channels, gain, step, &g, &inc);
+		for (; i + 4 <= count; i += 4) {
+			_mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), g));
+			g = _mm_add_ps(g, inc);
+		}
+	}
+#endif
+	for (size_t frame = i / channels; frame < frames; frame++) {
+		float g = gain + frame * step;
+		for (int c = 0; c < channels; c++, i++)
+			samples[i] *= g;
+	}
+}
+
+void MixWithGain(int16_t* dst, const int16_t* src, size_t frames, int channels,
+                 float dstGain, float dstStep, float srcGain, float srcStep)
+{
+	size_t i = 0;
+#if defined(__SSE2__)
+	if (channels <= 2) {
+		size_t count = frames * channels;
+		__m128 d_lo, d_hi, d_inc, s_lo, s_hi, s_inc;
+		InitGainVector(channels, dstGain, dstStep, &d_lo, &d_inc);
+		InitGainVector(channels, srcGain, srcStep, &s_lo, &s_inc);
+		d_hi = _mm_add_ps(d_lo, d_inc);
+		d_inc = _mm_add_ps(d_inc, d_inc);
+		s_hi = _mm_add_ps(s_lo, s_inc);
+		s_inc = _mm_add_ps(s_inc, s_inc);
+		for (; i + 8 <= count; i += 8) {
+			__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+			__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			__m128 lo = _mm_add_ps(
+				_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(d, d), 16)), d_lo),
+				_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16)), s_lo));
+			__m128 hi = _mm_add_ps(
+				_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(d, d), 16)), d_hi),
+				_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16)), s_hi));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+			                 _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+			d_lo = _mm_add_ps(d_lo, d_inc);
+			d_hi = _mm_add_ps(d_hi, d_inc);
+			s_lo = _mm_add_ps(s_lo, s_inc);
+			s_hi = _mm_add_ps(s_hi, s_inc);
+		}
+	}
+#endif
+	for (size_t frame = i / channels; frame < frames; frame++) {
+		float dg = dstGain + frame * dstStep;
+		float sg = srcGain + frame * srcStep;
+		for (int c = 0; c < channels; c++, i++) {
+			long v = lrintf(dst[i] * dg + src[i] * sg);
+			dst[i] = std::min<long>(std::max<long>(v, INT16_MIN), INT16_MAX);
+		}
+	}
+}
+
+void GainStage::Reset()
+{
+	current_ = ramp_target_ = gain();
+	ramp_frames_ = 0;
+}
+
+void GainStage::Process(int16_t* samples, size_t frames, int channels, int sampleRate)
+{
+	ProcessSamples(samples, frames, channels, sampleRate);
+}
+
+void GainStage::Process(float* samples, size_t frames, int channels, int sampleRate)
+{
+	ProcessSamples(samples, frames, channels, sampleRate);
+}
+
+template <typename T>
+void GainStage::ProcessSamples(T* samples, size_t frames, int channels, int sampleRate)
+{
+	float target = gain();
+	if (target != ramp_target_) {
+		/* from wherever the previous ramp got to */
+		METRICS_COUNT("gain.ramps");
+		ramp_target_ = target;
+		ramp_frames_ = std::max(sampleRate * kRampMs / 1000, 1);
+		step_ = (target - current_) / ramp_frames_;
+	}
+	if (ramp_frames_ > 0) {
+		size_t n = std::min(frames, ramp_frames_);
+		ApplyGain(samples, n, channels, current_ + step_, step_);
+		current_ += n * step_;
+		ramp_frames_ -= n;
+		if (ramp_frames_ == 0)
+			current_ = ramp_target_;
+		samples += n * channels;
+		frames -= n;
+	}
+	if (frames == 0 || current_ == 1.0f)
+		return;
+	if (current_ == 0.0f)
+		memset(samples, 0, frames * channels * sizeof(T));
+	else
+		ApplyGain(samples, frames, channels, current_, 0.0f);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_GAIN_STAGE_H_
+#define MP3_PLAYER_GAIN_STAGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+/* multiply interleaved samples in place, frame i by gain + i * step */
+void ApplyGain(int16_t* samples, size_t frames, int channels, float gain, float step);
+void ApplyGain(float* samples, size_t frames, int channels, float gain, float step);
+/* dst = dst * (dstGain + i * dstStep) + src * (srcGain + i * srcStep) for frame i */
+void MixWithGain(int16_t* dst, const int16_t* src, size_t frames, int channels,
+                 float dstGain, float dstStep, float srcGain, float srcStep);
+
+/* The volume of the player's own stream.
+ *
+ * The gain is set from any thread and applied on the audio thread, which
+ * moves to a new gain along a linear ramp of kRampMs instead of jumping,
+ * so volume changes and mute do not click. At a gain of 1 the samples
+ * are left alone. */
+class GainStage final {
+public:
+	void SetGain(float gain) { target_.store(gain, std::memory_order_relaxed); }
+	float gain() const { return target_.load(std::memory_order_relaxed); }
+
+	/* the audio thread: the next samples start at the gain, without a ramp */
+	void Reset();
+	void Process(int16_t* samples, size_t frames, int channels, int sampleRate);
+	void Process(float* samples, size_t frames, int channels, int sampleRate);
+
+private:
+	static const int kRampMs = 20;
+
+	template <typename T>
+	void ProcessSamples(T* samples, size_t frames, int channels, int sampleRate);
+
+	std::atomic<float> target_{1.0f};
+	/* audio thread */
+	float current_ = 1.0f;
+	float ramp_target_ = 1.0f;
+	float step_ = 0.0f;
+	size_t ramp_frames_ = 0;
+};
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "instrumented_source.h"
+
+#include "startup_profile.h"
+#include "trace.h"
+
+using android::MediaBuffer;
+using android::MetaData;
+using android::sp;
+using android::status_t;
+
+InstrumentedSource::InstrumentedSource(const sp<MediaSource>& source, int32_t trace_id)
+	: source_(source), trace_id_(trace_id)
+{
+}
+
+status_t InstrumentedSource::start(MetaData* params)
+{
+	return source_->start(params);
+}
+
+status_t InstrumentedSource::stop()
+{
+	return source_->stop();
+}
+
+sp<MetaData> InstrumentedSource::getFormat()
+{
+	return source_->getFormat();
+}
+
+status_t InstrumentedSource::read(MediaBuffer** buffer, const ReadOptions* options)
+{
+	status_t status = source_->read(buffer, options);
+	if (status == android::OK && !first_buffer_read_) {
+		first_buffer_read_ = true;
+		trace::Mark("audio.firstBuffer", trace_id_);
+		startup::Milestone("audio.firstSample");
+	}
+	return status;
+}
+
+status_t InstrumentedSource::pause()
+{
+	return source_->pause();
+}
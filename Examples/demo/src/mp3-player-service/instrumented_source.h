@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_INSTRUMENTED_SOURCE_H_
+#define MP3_PLAYER_INSTRUMENTED_SOURCE_H_
+
+#include <media/stagefright/MediaSource.h>
+
+/* Passes the decoded buffers to the AudioPlayer unchanged and marks the
+ * first one on the trace, tagged with the id of the request that started
+ * the playback. */
+class InstrumentedSource : public android::MediaSource {
+public:
+	InstrumentedSource(const android::sp<android::MediaSource>& source, int32_t trace_id);
+
+	android::status_t start(android::MetaData* params) override;
+	android::status_t stop() override;
+	android::sp<android::MetaData> getFormat() override;
+	android::status_t read(android::MediaBuffer** buffer,
+	                       const ReadOptions* options) override;
+	android::status_t pause() override;
+
+private:
+	android::sp<android::MediaSource> source_;
+	const int32_t trace_id_;
+	/* read() runs on one thread at a time */
+	bool first_buffer_read_ = false;
+};
+
+#endif
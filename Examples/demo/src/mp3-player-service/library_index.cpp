@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "library_index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iterator>
+
+#include <base/logging.h>
+
+#include "metrics.h"
+
+namespace {
+
+/* "MP3I", native byte order as the index never leaves the device */
+const uint32_t kMagic = 0x4933504d;
+const uint32_t kVersion = 1;
+
+struct Header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+};
+
+/* the fixed part of an entry, followed by the path, title and artist,
+   each as a uint16_t length and the bytes */
+struct Entry {
+	int64_t size;
+	int64_t mtimeNs;
+	int32_t durationMs;
+	int32_t bitrate;
+	int32_t gainMb;
+	/* kAnalyzed */
+	uint32_t flags;
+};
+
+const uint32_t kAnalyzed = 1;
+
+class Reader {
+public:
+	Reader(const uint8_t* data, size_t size) : data_(data), end_(data + size) {}
+	template <typename T>
+	bool Read(T* value) {
+		if ((size_t)(end_ - data_) < sizeof(T))
+			return false;
+		memcpy(value, data_, sizeof(T));
+		data_ += sizeof(T);
+		return true;
+	}
+	bool ReadString(std::string* value) {
+		uint16_t length;
+		if (!Read(&length) || end_ - data_ < length)
+			return false;
+		value->assign(reinterpret_cast<const char*>(data_), length);
+		data_ += length;
+		return true;
+	}
+private:
+	const uint8_t* data_;
+	const uint8_t* const end_;
+};
+
+template <typename T>
+void Append(std::string* out, const T& value)
+{
+	out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendString(std::string* out, const std::string& value)
+{
+	uint16_t length = value.size() < UINT16_MAX ? value.size() : UINT16_MAX;
+	Append(out, length);
+	out->append(value, 0, length);
+}
+
+bool WriteAll(int fd, const std::string& data)
+{
+	const char* p = data.data();
+	size_t left = data.size();
+	while (left > 0) {
+		ssize_t n = TEMP_FAILURE_RETRY(write(fd, p, left));
+		if (n <= 0)
+			return false;
+		p += n;
+		left -= n;
+	}
+	return true;
+}
+
+int64_t MtimeNs(const struct stat& st)
+{
+	return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+bool Probe(Mp3Scanner* scanner, TrackInfo* info)
+{
+	METRICS_SCOPED_TIMER("library.probe");
+	Mp3ScanResult result;
+	if (!scanner->Scan(info->path.c_str(), &result))
+		return false;
+	info->durationMs = result.durationMs;
+	info->bitrate = result.bitrate;
+	info->title = result.title;
+	info->artist = result.artist;
+	return true;
+}
+
+}  // namespace
+
+std::string TrackInfo::DisplayName() const
+{
+	if (title.empty())
+		return path.substr(path.rfind('/') + 1);
+	if (artist.empty())
+		return title;
+	return artist + " - " + title;
+}
+
+float TrackInfo::Gain() const
+{
+	return analyzed ? powf(10.0f, gainMb / 2000.0f) : 1.0f;
+}
+
+uint32_t TrackInfo::Stamp() const
+{
+	uint64_t value = (uint64_t)size * 0x9e3779b97f4a7c15ULL ^ (uint64_t)mtimeNs;
+	return (uint32_t)(value ^ value >> 32);
+}
+
+const int LibraryIndex::kSaveBatch;
+
+LibraryIndex::LibraryIndex(const std::vector<std::string>& roots, const std::string& indexFile,
+                           int maxThreads)
+	: roots_(roots), index_file_(indexFile), scanner_(maxThreads)
+{
+	for (int i = 0; i < scanner_.threads(); i++)
+		mp3_scanners_.emplace_back(new Mp3Scanner);
+}
+
+LibraryIndex::~LibraryIndex()
+{
+	Flush();
+}
+
+std::vector<TrackInfo> LibraryIndex::Update(std::vector<std::string>* directories,
+                                            std::vector<std::string>* removed)
+{
+	/* the entries of the file are the ones kept */
+	Flush();
+	std::map<std::string, TrackInfo> saved;
+	if (!Load(&saved))
+		LOG(INFO) << "No usable library index at " << index_file_ << ", building one";
+
+	int64_t startUs = metrics::NowUs();
+	int probed = 0;
+	std::map<std::string, TrackInfo> entries;
+	for (auto& info : Walk(roots_, saved, directories, &probed))
+		entries[info.path] = std::move(info);
+	int64_t elapsedUs = std::max<int64_t>(metrics::NowUs() - startUs, 1);
+	METRICS_RECORD("library.scan", elapsedUs);
+
+	bool changed = probed > 0 || entries.size() != saved.size();
+	LOG(INFO) << "Library: " << entries.size() << " tracks in " << directories->size()
+	          << " directories, " << probed << " probed in " << elapsedUs / 1000 << " ms ("
+	          << (int64_t)entries.size() * 1000000 / elapsedUs << " files/s on "
+	          << scanner_.threads() << " threads)";
+	metrics::Registry::Get()->GetCounter("library.probed")->Increment(probed);
+	if (changed && !Save(entries))
+		PLOG(WARNING) << "Unable to save the library index " << index_file_;
+	if (removed != nullptr) {
+		for (const auto& entry : entries_) {
+			if (entries.find(entry.first) == entries.end())
+				removed->push_back(entry.first);
+		}
+	}
+	entries_.swap(entries);
+
+	std::vector<TrackInfo> tracks;
+	tracks.reserve(entries_.size());
+	for (const auto& entry : entries_)
+		tracks.push_back(entry.second);
+	return tracks;
+}
+
+void LibraryIndex::Refresh(const std::set<std::string>& names, std::vector<TrackInfo>* changed,
+                           std::vector<std::string>* removed, std::vector<std::string>* directories)
+{
+	std::vector<std::string> moved_in;
+	for (const auto& path : names) {
+		struct stat st;
+		if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+			/* a directory moved or copied in, walked below */
+			moved_in.push_back(path + '/');
+			continue;
+		}
+		auto it = entries_.find(path);
+		if (!Examine(path, &st)) {
+			if (it != entries_.end()) {
+				entries_.erase(it);
+				removed->push_back(path);
+				continue;
+			}
+			/* a directory gone, with all its tracks */
+			std::string prefix = path + '/';
+			for (it = entries_.lower_bound(prefix);
+			     it != entries_.end() && it->first.compare(0, prefix.size(), prefix) == 0; ) {
+				removed->push_back(it->first);
+				it = entries_.erase(it);
+			}
+			continue;
+		}
+		int64_t mtimeNs = MtimeNs(st);
+		if (it != entries_.end() && it->second.size == st.st_size &&
+		    it->second.mtimeNs == mtimeNs)
+			continue;
+		TrackInfo info;
+		info.path = path;
+		info.size = st.st_size;
+		info.mtimeNs = mtimeNs;
+		Probe(mp3_scanners_[0].get(), &info);
+		entries_[path] = info;
+		changed->push_back(std::move(info));
+	}
+	if (!moved_in.empty()) {
+		int probed = 0;
+		for (auto& info : Walk(moved_in, entries_, directories, &probed)) {
+			auto it = entries_.find(info.path);
+			if (it != entries_.end() && it->second.size == info.size &&
+			    it->second.mtimeNs == info.mtimeNs)
+				continue;
+			entries_[info.path] = info;
+			changed->push_back(std::move(info));
+		}
+	}
+	if (changed->empty() && removed->empty())
+		return;
+	LOG(INFO) << "Library: " << changed->size() << " tracks added or changed, "
+	          << removed->size() << " removed";
+	metrics::Registry::Get()->GetCounter("library.probed")->Increment(changed->size());
+	if (!Save(entries_))
+		PLOG(WARNING) << "Unable to save the library index " << index_file_;
+	unsaved_ = 0;
+}
+
+void LibraryIndex::SetGain(const std::string& path, uint32_t stamp, int32_t gainMb)
+{
+	auto it = entries_.find(path);
+	if (it == entries_.end() || it->second.Stamp() != stamp)
+		return;
+	it->second.gainMb = gainMb;
+	it->second.analyzed = true;
+	if (++unsaved_ >= kSaveBatch)
+		Flush();
+}
+
+void LibraryIndex::Flush()
+{
+	if (unsaved_ == 0)
+		return;
+	/* retried with the next batch or flush, not with every result */
+	unsaved_ = 0;
+	if (!Save(entries_))
+		PLOG(WARNING) << "Unable to save the library index " << index_file_;
+}
+
+bool LibraryIndex::Examine(const std::string& path, struct stat* st) const
+{
+	return LibraryScanner::IsTrack(path.c_str()) && stat(path.c_str(), st) == 0 &&
+	       S_ISREG(st->st_mode);
+}
+
+std::vector<TrackInfo> LibraryIndex::Walk(const std::vector<std::string>& directories,
+                                          const std::map<std::string, TrackInfo>& known,
+                                          std::vector<std::string>* found, int* probed)
+{
+	/* each worker fills its own lists, merged once the walk is done */
+	const int threads = scanner_.threads();
+	std::vector<std::vector<TrackInfo>> tracks(threads);
+	std::vector<std::vector<std::string>> walked(threads);
+	std::vector<int> probes(threads);
+	scanner_.Scan(directories,
+		[&](int worker, const std::string& path, const struct stat& st) {
+			auto it = known.find(path);
+			if (it != known.end() && it->second.size == st.st_size &&
+			    it->second.mtimeNs == MtimeNs(st)) {
+				tracks[worker].push_back(it->second);
+				return;
+			}
+			TrackInfo info;
+			info.path = path;
+			info.size = st.st_size;
+			info.mtimeNs = MtimeNs(st);
+			/* an unreadable file is still listed, the player skips it */
+			Probe(mp3_scanners_[worker].get(), &info);
+			probes[worker]++;
+			tracks[worker].push_back(std::move(info));
+		},
+		[&](int worker, const std::string& path) { walked[worker].push_back(path); });
+
+	std::vector<TrackInfo> result;
+	for (int i = 0; i < threads; i++) {
+		std::move(tracks[i].begin(), tracks[i].end(), std::back_inserter(result));
+		found->insert(found->end(), walked[i].begin(), walked[i].end());
+		*probed += probes[i];
+	}
+	return result;
+}
+
+bool LibraryIndex::Load(std::map<std::string, TrackInfo>* entries) const
+{
+	int fd = open(index_file_.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)) {
+		close(fd);
+		return false;
+	}
+	void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	Reader reader(static_cast<const uint8_t*>(map), st.st_size);
+	Header header;
+	bool ok = reader.Read(&header) && header.magic == kMagic && header.version == kVersion;
+	for (uint32_t i = 0; ok && i < header.count; i++) {
+		Entry entry;
+		TrackInfo info;
+		ok = reader.Read(&entry) && reader.ReadString(&info.path) &&
+		     reader.ReadString(&info.title) && reader.ReadString(&info.artist);
+		if (!ok)
+			break;
+		info.size = entry.size;
+		info.mtimeNs = entry.mtimeNs;
+		info.durationMs = entry.durationMs;
+		info.bitrate = entry.bitrate;
+		info.gainMb = entry.gainMb;
+		info.analyzed = entry.flags & kAnalyzed;
+		(*entries)[info.path] = std::move(info);
+	}
+	munmap(map, st.st_size);
+	if (!ok)
+		entries->clear();
+	return ok;
+}
+
+bool LibraryIndex::Save(const std::map<std::string, TrackInfo>& entries) const
+{
+	METRICS_COUNT("library.indexSaves");
+	std::string data;
+	Header header = { kMagic, kVersion, (uint32_t)entries.size() };
+	Append(&data, header);
+	for (const auto& it : entries) {
+		const TrackInfo& info = it.second;
+		Entry entry = { info.size, info.mtimeNs, info.durationMs, info.bitrate, info.gainMb,
+		                info.analyzed ? kAnalyzed : 0 };
+		Append(&data, entry);
+		AppendString(&data, info.path);
+		AppendString(&data, info.title);
+		AppendString(&data, info.artist);
+	}
+
+	/* replaced atomically, a crash leaves either index intact */
+	std::string temp = index_file_ + ".tmp";
+	int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return false;
+	bool ok = WriteAll(fd, data) && fsync(fd) == 0;
+	close(fd);
+	if (!ok || rename(temp.c_str(), index_file_.c_str()) != 0) {
+		unlink(temp.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_LIBRARY_INDEX_H_
+#define MP3_PLAYER_LIBRARY_INDEX_H_
+
+#include <stdint.h>
+
+#include <sys/stat.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+
+#include "library_scanner.h"
+#include "mp3_scanner.h"
+
+/* What the player knows about a file of the music library */
+struct TrackInfo {
+	/* absolute, under one of the library roots */
+	std::string path;
+	int64_t size = 0;
+	int64_t mtimeNs = 0;
+	int32_t durationMs = 0;
+	/* bits per second */
+	int32_t bitrate = 0;
+	/* from the ID3 tag, empty if untagged */
+	std::string title;
+	std::string artist;
+	/* the loudness normalization gain in millibels (1/100 dB), valid once
+	   the track has been analyzed */
+	int32_t gainMb = 0;
+	bool analyzed = false;
+
+	/* "artist - title" when tagged, the file name otherwise */
+	std::string DisplayName() const;
+	/* the normalization gain as a factor, 1 until analyzed */
+	float Gain() const;
+	/* changes with the size and the mtime, tells apart versions of a file */
+	uint32_t Stamp() const;
+};
+
+/* The tracks of the music library, kept in an index file across restarts.
+ *
+ * Update() loads the saved index with mmap, walks the library roots on a
+ * LibraryScanner and probes only the files that are new or whose size or
+ * mtime changed, so its cost follows the changes rather than the library
+ * size. Refresh() does the same for a few named files or directories. The
+ * index is rewritten only if something changed. The loudness analysis
+ * results are kept with the entries, so the analysis resumes where it
+ * stopped after a restart. They are saved kSaveBatch at a time, or by
+ * Flush(), rather than rewriting the whole index for each track; a crash
+ * loses the analysis of a batch at most.
+ *
+ * Not thread safe, it is meant to be used from a single worker thread. */
+class LibraryIndex final {
+public:
+	/* the roots end with '/', the scans use up to maxThreads */
+	LibraryIndex(const std::vector<std::string>& roots, const std::string& indexFile,
+	             int maxThreads);
+	/* saves the analysis results not saved yet */
+	~LibraryIndex();
+
+	/* the tracks ordered by path, the directories they were found in and,
+	   if removed is not null, the paths of the previous update that are
+	   gone */
+	std::vector<TrackInfo> Update(std::vector<std::string>* directories,
+	                              std::vector<std::string>* removed);
+	/* re-examines the named files and directories, returns the new or
+	   changed tracks, the paths no longer in the library and the
+	   directories found under the named ones */
+	void Refresh(const std::set<std::string>& names, std::vector<TrackInfo>* changed,
+	             std::vector<std::string>* removed, std::vector<std::string>* directories);
+	/* records the analysis of the track, unless the file changed since the
+	   stamp was taken */
+	void SetGain(const std::string& path, uint32_t stamp, int32_t gainMb);
+	/* saves the analysis results recorded since the last save, if any */
+	void Flush();
+
+private:
+	static const int kSaveBatch = 32;
+
+	/* false if the file is not a track of the library */
+	bool Examine(const std::string& path, struct stat* st) const;
+	/* the tracks under the directories, those in known with the same size
+	   and mtime are taken from there, the others are probed */
+	std::vector<TrackInfo> Walk(const std::vector<std::string>& directories,
+	                            const std::map<std::string, TrackInfo>& known,
+	                            std::vector<std::string>* found, int* probed);
+	bool Load(std::map<std::string, TrackInfo>* entries) const;
+	bool Save(const std::map<std::string, TrackInfo>& entries) const;
+
+	const std::vector<std::string> roots_;
+	const std::string index_file_;
+	/* the library as last saved, by path */
+	std::map<std::string, TrackInfo> entries_;
+	/* the analysis results in entries_ but not in the file */
+	int unsaved_ = 0;
+	LibraryScanner scanner_;
+	/* one for each worker of the scanner */
+	std::vector<std::unique_ptr<Mp3Scanner>> mp3_scanners_;
+
+	DISALLOW_COPY_AND_ASSIGN(LibraryIndex);
+};
+
+#endif
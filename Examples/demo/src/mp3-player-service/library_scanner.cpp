@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "library_scanner.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <base/logging.h>
+
+namespace {
+
+/* as the kernel fills it in, there is no libc wrapper for it */
+struct LinuxDirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+/* a few hundred entries per system call */
+const size_t kDirentBufferBytes = 32 * 1024;
+/* how long an idle worker waits before looking for work again */
+const std::chrono::microseconds kIdleWait(200);
+/* below the decoder, above the loudness analysis */
+const int kWorkerNice = 10;
+
+}  // namespace
+
+bool LibraryScanner::IsTrack(const char* name)
+{
+	size_t length = strlen(name);
+	return length > 4 && strcasecmp(name + length - 4, ".mp3") == 0;
+}
+
+LibraryScanner::LibraryScanner(int maxThreads)
+	: threads_(std::max(1, std::min<int>(maxThreads, std::thread::hardware_concurrency() - 1)))
+{
+	for (int i = 0; i < threads_; i++)
+		workers_.emplace_back(new Worker);
+}
+
+void LibraryScanner::Scan(const std::vector<std::string>& directories, const FileCallback& onFile,
+                          const DirectoryCallback& onDirectory)
+{
+	on_file_ = &onFile;
+	on_directory_ = &onDirectory;
+	for (const auto& directory : directories)
+		Push(0, { directory, true });
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < threads_; i++) {
+		threads.emplace_back([this, i] {
+			setpriority(PRIO_PROCESS, 0, kWorkerNice);
+			Run(i);
+		});
+	}
+	Run(0);
+	for (auto& thread : threads)
+		thread.join();
+	on_file_ = nullptr;
+	on_directory_ = nullptr;
+}
+
+void LibraryScanner::Run(int worker)
+{
+	Job job;
+	for (;;) {
+		if (Take(worker, &job)) {
+			if (job.directory) {
+				ListDirectory(worker, job.path);
+			} else {
+				struct stat st;
+				if (stat(job.path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+					(*on_file_)(worker, job.path, st);
+			}
+			/* after the job queued its children */
+			pending_--;
+		} else if (pending_ == 0) {
+			return;
+		} else {
+			std::this_thread::sleep_for(kIdleWait);
+		}
+	}
+}
+
+/* the newest job of the worker, or else the oldest of another one */
+bool LibraryScanner::Take(int worker, Job* job)
+{
+	for (int i = 0; i < threads_; i++) {
+		Worker* victim = workers_[(worker + i) % threads_].get();
+		std::lock_guard<std::mutex> guard(victim->lock);
+		if (victim->jobs.empty())
+			continue;
+		if (i == 0) {
+			*job = std::move(victim->jobs.back());
+			victim->jobs.pop_back();
+		} else {
+			*job = std::move(victim->jobs.front());
+			victim->jobs.pop_front();
+		}
+		return true;
+	}
+	return false;
+}
+
+void LibraryScanner::Push(int worker, Job job)
+{
+	pending_++;
+	std::lock_guard<std::mutex> guard(workers_[worker]->lock);
+	workers_[worker]->jobs.push_back(std::move(job));
+}
+
+void LibraryScanner::ListDirectory(int worker, const std::string& path)
+{
+	(*on_directory_)(worker, path);
+	int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+	if (fd < 0) {
+		PLOG(ERROR) << "Unable to open directory '" << path << "'";
+		return;
+	}
+	char buffer[kDirentBufferBytes] __attribute__((aligned(__alignof__(LinuxDirent64))));
+	for (;;) {
+		long length = syscall(__NR_getdents64, fd, buffer, sizeof(buffer));
+		if (length <= 0) {
+			if (length < 0)
+				PLOG(ERROR) << "Unable to read directory '" << path << "'";
+			break;
+		}
+		for (long offset = 0; offset < length; ) {
+			const LinuxDirent64* entry = reinterpret_cast<LinuxDirent64*>(buffer + offset);
+			offset += entry->d_reclen;
+			if (entry->d_name[0] == '.')
+				continue;
+			unsigned char type = entry->d_type;
+			if (type == DT_UNKNOWN) {
+				/* some file systems leave the type out */
+				struct stat st;
+				if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+					continue;
+				type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : DT_REG;
+			}
+			if (type == DT_DIR)
+				Push(worker, { path + entry->d_name + '/', true });
+			else if ((type == DT_REG || type == DT_LNK) && IsTrack(entry->d_name))
+				Push(worker, { path + entry->d_name, false });
+		}
+	}
+	close(fd);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_LIBRARY_SCANNER_H_
+#define MP3_PLAYER_LIBRARY_SCANNER_H_
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+
+/* Walks directory trees of the music library on a small pool of threads.
+ *
+ * Each worker owns a deque of jobs, a directory to list or a file to hand
+ * to the callback. A worker takes its own jobs from the back, so it goes
+ * depth first and stays with the directories it just read; an idle worker
+ * steals from the front of another deque, where the oldest and largest
+ * subtrees wait. Directories are read with getdents64 into a large buffer,
+ * which returns hundreds of entries per system call along with their
+ * types, so only the tracks themselves are stat()ed.
+ *
+ * Hidden entries are skipped, and so are symbolic links to directories,
+ * which could loop. The threads started for a scan run below the normal
+ * priority and there are at most as many workers as cores less one, so
+ * the decoder is not slowed down by a scan. */
+class LibraryScanner final {
+public:
+	/* called on a worker for each .mp3 regular file; worker is from 0 to
+	   threads() - 1, for the state the callback keeps per thread */
+	using FileCallback =
+		std::function<void(int worker, const std::string& path, const struct stat& st)>;
+	/* called on a worker for each directory, the roots included; path
+	   ends with '/' */
+	using DirectoryCallback = std::function<void(int worker, const std::string& path)>;
+
+	explicit LibraryScanner(int maxThreads);
+
+	/* whether the file name is one of a track */
+	static bool IsTrack(const char* name);
+
+	int threads() const { return threads_; }
+	/* returns once every file under the directories, which end with '/',
+	   went to the callbacks; the calling thread is one of the workers */
+	void Scan(const std::vector<std::string>& directories, const FileCallback& onFile,
+	          const DirectoryCallback& onDirectory);
+
+private:
+	struct Job {
+		std::string path;
+		bool directory;
+	};
+	struct Worker {
+		std::mutex lock;
+		std::deque<Job> jobs;
+	};
+
+	void Run(int worker);
+	bool Take(int worker, Job* job);
+	void Push(int worker, Job job);
+	void ListDirectory(int worker, const std::string& path);
+
+	const int threads_;
+	std::vector<std::unique_ptr<Worker>> workers_;
+	/* the jobs queued or running, the scan is over when none are left */
+	std::atomic<int> pending_{0};
+	const FileCallback* on_file_ = nullptr;
+	const DirectoryCallback* on_directory_ = nullptr;
+
+	DISALLOW_COPY_AND_ASSIGN(LibraryScanner);
+};
+
+#endif
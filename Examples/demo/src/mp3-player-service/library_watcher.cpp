@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "library_watcher.h"
+
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <base/bind.h>
+#include <base/location.h>
+#include <base/logging.h>
+
+namespace {
+
+/* a pushed file shows up once it is closed, not while it is being written;
+   the creation only matters for directories */
+const uint32_t kWatchedEvents =
+	IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR;
+
+}  // namespace
+
+LibraryWatcher::LibraryWatcher(const ChangedCallback& callback)
+	: callback_(callback),
+	  fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+	if (fd_ < 0) {
+		PLOG(ERROR) << "Unable to initialize inotify, library changes need a restart";
+		return;
+	}
+	watch_task_ = brillo::MessageLoop::current()->WatchFileDescriptor(
+		FROM_HERE, fd_, brillo::MessageLoop::kWatchRead, true,
+		base::Bind(&LibraryWatcher::OnReadable, base::Unretained(this)));
+}
+
+LibraryWatcher::~LibraryWatcher()
+{
+	if (watch_task_ != brillo::MessageLoop::kTaskIdNull)
+		brillo::MessageLoop::current()->CancelTask(watch_task_);
+	if (fd_ >= 0)
+		close(fd_);
+}
+
+bool LibraryWatcher::AddDirectory(const std::string& directory)
+{
+	if (fd_ < 0)
+		return false;
+	/* a directory watched already keeps its descriptor */
+	int wd = inotify_add_watch(fd_, directory.c_str(), kWatchedEvents);
+	if (wd < 0) {
+		PLOG(ERROR) << "Unable to watch " << directory;
+		return false;
+	}
+	directories_[wd] = directory;
+	return true;
+}
+
+void LibraryWatcher::OnReadable()
+{
+	std::set<std::string> names;
+	bool overflow = false;
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	for (;;) {
+		ssize_t length = TEMP_FAILURE_RETRY(read(fd_, buffer, sizeof(buffer)));
+		if (length <= 0) {
+			if (length < 0 && errno != EAGAIN)
+				PLOG(ERROR) << "Unable to read the inotify events";
+			break;
+		}
+		for (char* p = buffer; p < buffer + length; ) {
+			const struct inotify_event* event = reinterpret_cast<struct inotify_event*>(p);
+			p += sizeof(struct inotify_event) + event->len;
+			if (event->mask & IN_Q_OVERFLOW) {
+				overflow = true;
+				continue;
+			}
+			if (event->mask & IN_IGNORED) {
+				/* the directory is gone */
+				directories_.erase(event->wd);
+				continue;
+			}
+			auto it = directories_.find(event->wd);
+			if (it == directories_.end() || event->len == 0)
+				continue;
+			std::string path = it->second + event->name;
+			if (event->mask & IN_ISDIR) {
+				if (event->mask & (IN_CREATE | IN_MOVED_TO))
+					AddDirectory(path + '/');
+			} else if (event->mask & IN_CREATE) {
+				/* the file is reported once it is written */
+				continue;
+			}
+			names.insert(path);
+		}
+	}
+	if (!names.empty() || overflow)
+		callback_.Run(names, overflow);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_LIBRARY_WATCHER_H_
+#define MP3_PLAYER_LIBRARY_WATCHER_H_
+
+#include <map>
+#include <set>
+#include <string>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <brillo/message_loops/message_loop.h>
+
+/* Reports the files and directories added, rewritten, renamed or deleted
+ * in the library directories, from inotify on the message loop.
+ *
+ * The paths of a batch of events are coalesced and reported; what actually
+ * changed is left to LibraryIndex. A directory created in a watched one is
+ * watched right away, before it is reported, so no file put into it is
+ * missed. When the kernel queue overflows the batch is flagged, since only
+ * a full scan can tell what was missed. */
+class LibraryWatcher final {
+public:
+	using ChangedCallback =
+		base::Callback<void(const std::set<std::string>& names, bool overflow)>;
+
+	explicit LibraryWatcher(const ChangedCallback& callback);
+	~LibraryWatcher();
+
+	/* watches the directory, whose path ends with '/' */
+	bool AddDirectory(const std::string& directory);
+
+private:
+	void OnReadable();
+
+	const ChangedCallback callback_;
+	int fd_;
+	brillo::MessageLoop::TaskId watch_task_ = brillo::MessageLoop::kTaskIdNull;
+	/* the directory of each watch descriptor */
+	std::map<int, std::string> directories_;
+
+	DISALLOW_COPY_AND_ASSIGN(LibraryWatcher);
+};
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "loudness_analyzer.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include <base/logging.h>
+#include <media/stagefright/FileSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaExtractor.h>
+#include <media/stagefright/MediaSource.h>
+#include <media/stagefright/MetaData.h>
+#include <media/stagefright/SimpleDecodingSource.h>
+
+#include "metrics.h"
+
+using android::MediaBuffer;
+using android::MediaSource;
+using android::MetaData;
+using android::sp;
+
+namespace {
+
+/* the ReplayGain 2.0 reference level */
+const double kTargetLufs = -18.0;
+/* the gain is kept within these, in dB */
+const double kMinGainDb = -24.0;
+const double kMaxGainDb = 12.0;
+
+/* the mean square of a loudness */
+double MeanSquare(double lufs)
+{
+	return pow(10.0, (lufs + 0.691) / 10.0);
+}
+
+double Lufs(double meanSquare)
+{
+	return -0.691 + 10.0 * log10(meanSquare);
+}
+
+}  // namespace
+
+constexpr double LoudnessMeter::kSilenceLufs;
+
+LoudnessMeter::LoudnessMeter(int sampleRate, int channels)
+	: channels_(channels), sub_block_frames_(std::max(sampleRate / 10, 1)),
+	  state_(channels * 2), sub_block_left_(sub_block_frames_)
+{
+	/* the K-weighting of BS.1770 for any sample rate: a high shelf
+	   modelling the head, then the RLB high pass */
+	double f0 = 1681.974450955533;
+	double gain = 3.999843853973347;
+	double q = 0.7071752369554196;
+	double k = tan(M_PI * f0 / sampleRate);
+	double vh = pow(10.0, gain / 20.0);
+	double vb = pow(vh, 0.4996667741545416);
+	double a0 = 1.0 + k / q + k * k;
+	shelf_ = { (vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0,
+	           (vh - vb * k / q + k * k) / a0, 2.0 * (k * k - 1.0) / a0,
+	           (1.0 - k / q + k * k) / a0 };
+
+	f0 = 38.13547087602444;
+	q = 0.5003270373238773;
+	k = tan(M_PI * f0 / sampleRate);
+	a0 = 1.0 + k / q + k * k;
+	high_pass_ = { 1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+}
+
+double LoudnessMeter::Filter(const Biquad& f, FilterState* s, double x)
+{
+	double y = f.b0 * x + f.b1 * s->x1 + f.b2 * s->x2 - f.a1 * s->y1 - f.a2 * s->y2;
+	s->x2 = s->x1;
+	s->x1 = x;
+	s->y2 = s->y1;
+	s->y1 = y;
+	return y;
+}
+
+void LoudnessMeter::Process(const int16_t* samples, size_t frames)
+{
+	for (size_t i = 0; i < frames; i++) {
+		for (int c = 0; c < channels_; c++) {
+			double x = *samples++ / 32768.0;
+			peak_ = std::max(peak_, fabs(x));
+			double y = Filter(shelf_, &state_[2 * c], x);
+			y = Filter(high_pass_, &state_[2 * c + 1], y);
+			sub_block_sum_ += y * y;
+		}
+		if (--sub_block_left_ > 0)
+			continue;
+		sub_blocks_[sub_block_count_++ % 4] = sub_block_sum_ / sub_block_frames_;
+		sub_block_sum_ = 0;
+		sub_block_left_ = sub_block_frames_;
+		if (sub_block_count_ >= 4)
+			blocks_.push_back((sub_blocks_[0] + sub_blocks_[1] + sub_blocks_[2] + sub_blocks_[3]) / 4);
+	}
+}
+
+double LoudnessMeter::Loudness() const
+{
+	const double absolute = MeanSquare(kSilenceLufs);
+	double sum = 0;
+	size_t count = 0;
+	for (float block : blocks_) {
+		if (block > absolute) {
+			sum += block;
+			count++;
+		}
+	}
+	if (count == 0)
+		return kSilenceLufs;
+	/* 10 LU below the loudness of the blocks above the absolute gate */
+	const double relative = std::max(absolute, sum / count / 10.0);
+	sum = 0;
+	count = 0;
+	for (float block : blocks_) {
+		if (block > relative) {
+			sum += block;
+			count++;
+		}
+	}
+	return count > 0 ? Lufs(sum / count) : kSilenceLufs;
+}
+
+bool AnalyzeLoudness(const std::string& path, const std::atomic<bool>& cancel, int32_t* gainMb)
+{
+	METRICS_SCOPED_TIMER("loudness.analyze");
+	sp<android::FileSource> file = new android::FileSource(path.c_str());
+	if (file->initCheck() != android::OK)
+		return false;
+	file->RegisterDefaultSniffers();
+	sp<android::MediaExtractor> extractor =
+		reinterpret_cast<android::MediaExtractor*>(
+			android::MediaExtractor::Create(file, NULL).get());
+	if (extractor == nullptr || extractor->countTracks() == 0)
+		return false;
+	sp<MediaSource> track =
+		reinterpret_cast<android::MediaSource*>(extractor->getTrack(0).get());
+	sp<MediaSource> decoder = android::SimpleDecodingSource::Create(track);
+	if (decoder == nullptr || decoder->start() != android::OK)
+		return false;
+
+	int32_t sampleRate = 44100, channels = 2;
+	sp<MetaData> format = decoder->getFormat();
+	format->findInt32(android::kKeySampleRate, &sampleRate);
+	format->findInt32(android::kKeyChannelCount, &channels);
+	LoudnessMeter meter(sampleRate, channels);
+	android::status_t status = android::OK;
+	MediaBuffer* buffer;
+	while (!cancel && (status = decoder->read(&buffer)) != android::ERROR_END_OF_STREAM) {
+		if (status == android::INFO_FORMAT_CHANGED)
+			continue;
+		if (status != android::OK)
+			break;
+		meter.Process(reinterpret_cast<const int16_t*>(
+				static_cast<const uint8_t*>(buffer->data()) + buffer->range_offset()),
+			buffer->range_length() / (channels * sizeof(int16_t)));
+		buffer->release();
+	}
+	decoder->stop();
+	if (cancel || status != android::ERROR_END_OF_STREAM)
+		return false;
+
+	double loudness = meter.Loudness();
+	double gainDb = 0;
+	if (loudness > LoudnessMeter::kSilenceLufs) {
+		gainDb = std::min(std::max(kTargetLufs - loudness, kMinGainDb), kMaxGainDb);
+		/* the peak stays below full scale */
+		if (meter.Peak() > 0)
+			gainDb = std::min(gainDb, -20.0 * log10(meter.Peak()));
+	}
+	LOG(INFO) << path << ": " << loudness << " LUFS, peak " << meter.Peak()
+	          << ", gain " << gainDb << " dB";
+	*gainMb = lrint(gainDb * 100);
+	return true;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_LOUDNESS_ANALYZER_H_
+#define MP3_PLAYER_LOUDNESS_ANALYZER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/* Loudness of 16-bit PCM as ITU-R BS.1770 measures it for EBU R128: the
+ * K-weighted mean square over 400 ms blocks taken every 100 ms, gated at
+ * -70 LUFS and then at 10 LU below the loudness of the blocks left. */
+class LoudnessMeter final {
+public:
+	LoudnessMeter(int sampleRate, int channels);
+
+	void Process(const int16_t* samples, size_t frames);
+	/* in LUFS, kSilenceLufs if every block was gated away */
+	double Loudness() const;
+	/* the largest sample magnitude, 1 for full scale */
+	double Peak() const { return peak_; }
+
+	static constexpr double kSilenceLufs = -70.0;
+
+private:
+	struct Biquad {
+		double b0, b1, b2, a1, a2;
+	};
+	struct FilterState {
+		double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+	};
+	static double Filter(const Biquad& f, FilterState* s, double x);
+
+	const int channels_;
+	const size_t sub_block_frames_;
+	Biquad shelf_;
+	Biquad high_pass_;
+	/* two filters per channel */
+	std::vector<FilterState> state_;
+	double sub_block_sum_ = 0;
+	size_t sub_block_left_;
+	/* the mean squares of the last 4 sub-blocks of 100 ms */
+	double sub_blocks_[4] = {};
+	size_t sub_block_count_ = 0;
+	/* the mean square of each 400 ms block */
+	std::vector<float> blocks_;
+	double peak_ = 0;
+};
+
+/* Decodes the file and computes the gain that brings it to kTargetLufs, in
+ * millibels (1/100 dB), lowered if needed so the peak does not clip.
+ * False if the track could not be decoded or cancel was set meanwhile. */
+bool AnalyzeLoudness(const std::string& path, const std::atomic<bool>& cancel, int32_t* gainMb);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mmap_source.h"
+
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <mutex>
+
+#include <base/logging.h>
+#include <media/stagefright/FileSource.h>
+
+#include "metrics.h"
+
+using android::DataSource;
+using android::String8;
+using android::sp;
+using android::status_t;
+
+namespace {
+
+/* where a fault of the copy running on this thread returns to, if any */
+thread_local sigjmp_buf* copy_recovery = nullptr;
+struct sigaction previous_sigbus;
+
+void OnSigbus(int signal, siginfo_t* info, void* context)
+{
+	if (copy_recovery != nullptr)
+		siglongjmp(*copy_recovery, 1);
+	/* not a fault of a copy, the handler installed before takes it */
+	if (previous_sigbus.sa_flags & SA_SIGINFO) {
+		previous_sigbus.sa_sigaction(signal, info, context);
+	} else if (previous_sigbus.sa_handler != SIG_DFL && previous_sigbus.sa_handler != SIG_IGN) {
+		previous_sigbus.sa_handler(signal);
+	} else {
+		sigaction(SIGBUS, &previous_sigbus, nullptr);
+		raise(SIGBUS);
+	}
+}
+
+void InstallSigbusHandler()
+{
+	static std::once_flag installed;
+	std::call_once(installed, []() {
+		struct sigaction action = {};
+		action.sa_sigaction = &OnSigbus;
+		action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGBUS, &action, &previous_sigbus);
+	});
+}
+
+/* copies from the mapping; false if a page of it is gone, the file having
+   been truncated under it */
+bool CopyMapped(void* to, const void* from, size_t size)
+{
+	sigjmp_buf recovery;
+	if (sigsetjmp(recovery, 1) != 0) {
+		copy_recovery = nullptr;
+		return false;
+	}
+	copy_recovery = &recovery;
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+	memcpy(to, from, size);
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+	copy_recovery = nullptr;
+	return true;
+}
+
+}  // namespace
+
+sp<DataSource> MmapSource::Open(const std::string& path)
+{
+	InstallSigbusHandler();
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		struct stat st;
+		void* data = MAP_FAILED;
+		if (fstat(fd, &st) == 0 && st.st_size > 0 && (uint64_t)st.st_size <= SIZE_MAX)
+			data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (data != MAP_FAILED)
+			return new MmapSource(path, fd, data, st.st_size);
+		close(fd);
+	}
+	PLOG(WARNING) << "Unable to map " << path << ", reading it with FileSource";
+	return new android::FileSource(path.c_str());
+}
+
+MmapSource::MmapSource(const std::string& path, int fd, void* data, size_t size)
+	: path_(path.c_str()), fd_(fd), data_(static_cast<uint8_t*>(data)), size_(size)
+{
+	madvise(data_, size_, MADV_SEQUENTIAL);
+}
+
+MmapSource::~MmapSource()
+{
+	munmap(data_, size_);
+	close(fd_);
+}
+
+bool MmapSource::Truncated() const
+{
+	struct stat st;
+	return fstat(fd_, &st) != 0 || (uint64_t)st.st_size < size_;
+}
+
+status_t MmapSource::initCheck() const
+{
+	return android::OK;
+}
+
+ssize_t MmapSource::readAt(off64_t offset, void* data, size_t size)
+{
+	if (offset < 0)
+		return android::UNKNOWN_ERROR;
+	if ((uint64_t)offset >= size_)
+		return 0;
+	size_t start = offset;
+	if (size > size_ - start)
+		size = size_ - start;
+
+	if (truncated_.load(std::memory_order_relaxed))
+		return TEMP_FAILURE_RETRY(pread64(fd_, data, size, offset));
+
+	/* keep a window ahead of the reader, renewed once it is half consumed */
+	size_t end = readahead_end_.load(std::memory_order_relaxed);
+	if (start + size + kReadaheadBytes / 2 > end && end < size_) {
+		size_t from = std::max(end, start) & ~(size_t)(getpagesize() - 1);
+		size_t to = std::min(start + size + kReadaheadBytes, size_);
+		if (readahead_end_.compare_exchange_strong(end, to)) {
+			if (Truncated()) {
+				LOG(WARNING) << path_.string() << " was truncated, reading it with pread";
+				truncated_ = true;
+				return TEMP_FAILURE_RETRY(pread64(fd_, data, size, offset));
+			}
+			madvise(data_ + from, to - from, MADV_WILLNEED);
+			METRICS_COUNT("mmap.readahead");
+		}
+	}
+
+	if (!CopyMapped(data, data_ + start, size)) {
+		LOG(WARNING) << path_.string() << " was truncated while mapped, reading it with pread";
+		METRICS_COUNT("mmap.sigbus");
+		truncated_ = true;
+		return TEMP_FAILURE_RETRY(pread64(fd_, data, size, offset));
+	}
+	return size;
+}
+
+status_t MmapSource::getSize(off64_t* size)
+{
+	*size = size_;
+	return android::OK;
+}
+
+uint32_t MmapSource::flags()
+{
+	return kIsLocalFileSource;
+}
+
+String8 MmapSource::toString()
+{
+	return String8::format("MmapSource(%s)", path_.string());
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_MMAP_SOURCE_H_
+#define MP3_PLAYER_MMAP_SOURCE_H_
+
+#include <atomic>
+
+#include <media/stagefright/DataSource.h>
+
+/* A DataSource over a memory mapped local file.
+ *
+ * Reads are plain copies from the page cache instead of a pread() each.
+ * The mapping is advised as sequential, and a readahead window of
+ * kReadaheadBytes is requested with MADV_WILLNEED ahead of the read
+ * position, so the pages are in before the decoder asks for them.
+ *
+ * Touching a page past the end of a file truncated under the mapping, as
+ * when a track is pushed again while it plays, raises SIGBUS. The copies
+ * run under a SIGBUS handler that returns the fault to the copy, which then
+ * reads with pread(); the size is also checked again with every window.
+ * Once the file has shrunk, all reads go through pread(). */
+class MmapSource : public android::DataSource {
+public:
+	/* an MmapSource, or a FileSource if the file cannot be mapped */
+	static android::sp<android::DataSource> Open(const std::string& path);
+
+	android::status_t initCheck() const override;
+	ssize_t readAt(off64_t offset, void* data, size_t size) override;
+	android::status_t getSize(off64_t* size) override;
+	uint32_t flags() override;
+	android::String8 toString() override;
+
+private:
+	static const size_t kReadaheadBytes = 256 * 1024;
+
+	MmapSource(const std::string& path, int fd, void* data, size_t size);
+	~MmapSource() override;
+	bool Truncated() const;
+
+	const android::String8 path_;
+	const int fd_;
+	uint8_t* const data_;
+	const size_t size_;
+	/* where the current readahead window ends */
+	std::atomic<size_t> readahead_end_{0};
+	std::atomic<bool> truncated_{false};
+};
+
+#endif
@@ -13,115 +13,789 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <sched.h>
+#include <strings.h>
+#include <sys/resource.h>
 #include <unistd.h>
-#include <dirent.h>
 #include <sysexits.h>
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <set>
+
 #include <base/logging.h>
 #include <base/command_line.h>
 #include <base/macros.h>
 #include <base/bind.h>
+#include <base/bind_helpers.h>
+#include <base/strings/string_split.h>
+#include <base/threading/thread.h>
 #include <binderwrapper/binder_wrapper.h>
 #include <brillo/binder_watcher.h>
 #include <brillo/daemons/daemon.h>
 #include <brillo/syslog_logging.h>
+#include <cutils/properties.h>
 #include <media/stagefright/AudioPlayer.h>
 #include <media/stagefright/DataSource.h>
 #include <media/stagefright/FileSource.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MediaExtractor.h>
+#include <media/stagefright/MediaErrors.h>
 #include <media/stagefright/MetaData.h>
 #include <media/stagefright/OMXClient.h>
-#include <media/stagefright/SimpleDecodingSource.h>
 #include <media/stagefright/ACodec.h>
 #include <media/stagefright/foundation/AMessage.h>
-#include <media/AudioSystem.h>
 #include <include/MP3Extractor.h>
 
 #include "brillo/demo/BnMp3PlayerService.h"
+#include "brillo/demo/IMp3PlayerListener.h"
+#include "decode_ahead_source.h"
+#include "decoder_pool.h"
+#include "gain_stage.h"
+#include "instrumented_source.h"
+#include "library_index.h"
+#include "library_watcher.h"
+#include "loudness_analyzer.h"
+#include "metrics.h"
+#include "mmap_source.h"
+#include "mp3_frame_source.h"
 #include "mp3-player-service.h"
+#include "play_queue.h"
+#include "player_snapshot.h"
+#include "startup_profile.h"
+#include "trace.h"
+#include "track_search.h"
+#include "track_sequencer.h"
+#include "track_table.h"
 
 using namespace android;
+using brillo::demo::IMp3PlayerListener;
+using brillo::demo::PlayerSnapshot;
 
 class Mp3PlayerService : public brillo::demo::BnMp3PlayerService {
-	const std::string SOUNDTRACKS_FORDER = "/data/soundtracks/";
+	/* the library roots, separated by ':', e.g. the internal storage and a
+	   USB stick */
+	const std::string LIBRARY_ROOTS_PROPERTY = "mp3_player.library_roots";
+	const std::string DEFAULT_LIBRARY_ROOTS = "/data/soundtracks/";
+	const std::string LIBRARY_INDEX_FILE = "/data/misc/mp3-player/library.idx";
+	/* keeps the decoders and the sink set up between tracks, on by default;
+	   off, each play sets them up anew, which is what it is compared with */
+	const std::string WARM_PIPELINE_PROPERTY = "mp3_player.warm_pipeline";
+	/* a stopped pipeline is kept that long for the next play */
+	const int WARM_PIPELINE_MS = 30000;
+	/* the library scan leaves a core to the decoder in any case */
+	const int MAX_SCAN_THREADS = 4;
+	/* EOS is checked in-process, so a short interval costs no IPC */
+	const int EOS_WATCH_INTERVAL_MS = 50;
+	/* the PCM decoded ahead of the sink, rides out storage and CPU stalls */
+	const int DECODE_AHEAD_MS = 500;
+	const int MAX_CROSSFADE_MS = 10000;
+	/* the analysis yields between two tracks */
+	const int LOUDNESS_PAUSE_MS = 1000;
+	/* the longest the analysis results wait to be saved in the index */
+	const int INDEX_SAVE_MS = 60000;
 	enum PlayerState {
+		Warming,
 		Idle,
 		Playing,
 		Paused,
 	};
 public:
-	Mp3PlayerService() : player(nullptr), state(Idle) {
-		status_t status = client.connect();
-		if (status == OK)
-			reloadPlaylist();
-	}
+	Mp3PlayerService() : player(nullptr), state(Warming),
+	                     libraryRoots(LibraryRoots()),
+	                     library(libraryRoots, LIBRARY_INDEX_FILE, MAX_SCAN_THREADS),
+	                     libraryThread("mp3-library"), analysisThread("mp3-loudness"),
+	                     prerollThread("mp3-preroll"),
+	                     warmPipeline(property_get_bool(WARM_PIPELINE_PROPERTY.c_str(), true)),
+	                     decoders(new DecoderPool(warmPipeline)) {}
 	~Mp3PlayerService() {
+		analysisCancel = true;
+		analysisThread.Stop();
+		libraryThread.Stop();
+		prerollThread.Stop();
 		if (player) delete player;
+		decoders->Trim();
 	}
+	/* connects the codec and scans the library in the background, the
+	   service is usable right after registration */
+	void StartWarmup();
 	android::binder::Status play();
 	android::binder::Status pause();
 	android::binder::Status stop();
 	android::binder::Status reachedEOS(bool* pEOS);
 	android::binder::Status status(String16* pInfo);
 	android::binder::Status getVolume(float* pVol) {
-		if (AudioSystem::getMasterVolume(pVol) != NO_ERROR)
-			*pVol = 0.0f;
+		METRICS_SCOPED_TIMER("binder.getVolume");
+		*pVol = volume;
 		return android::binder::Status::ok();
 	}
 	android::binder::Status setVolume(float vol) {
-		AudioSystem::setMasterVolume(vol);
+		METRICS_SCOPED_TIMER("binder.setVolume");
+		if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::setVolume),
+		                                   ::base::Unretained(this), vol)))
+			return android::binder::Status::ok();
+		volume = vol;
+		UpdateGain();
+		NotifyStateChanged();
 		return android::binder::Status::ok();
 	}
 	android::binder::Status isMuted(bool* pState) {
-		AudioSystem::getMasterMute(pState);
+		METRICS_SCOPED_TIMER("binder.isMuted");
+		*pState = muted;
 		return android::binder::Status::ok();
 	}
 	android::binder::Status mute(bool state) {
-		AudioSystem::setMasterMute(state);
+		METRICS_SCOPED_TIMER("binder.mute");
+		if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::mute),
+		                                   ::base::Unretained(this), state)))
+			return android::binder::Status::ok();
+		muted = state;
+		UpdateGain();
+		NotifyStateChanged();
+		return android::binder::Status::ok();
+	}
+	android::binder::Status getSnapshot(PlayerSnapshot* pSnapshot);
+	android::binder::Status applyVolume(float vol, bool state);
+	android::binder::Status getPosition(int32_t* pPositionMs);
+	android::binder::Status getDuration(int32_t* pDurationMs);
+	android::binder::Status seek(int32_t positionMs);
+	android::binder::Status getCrossfade(int32_t* pDurationMs) {
+		METRICS_SCOPED_TIMER("binder.getCrossfade");
+		*pDurationMs = crossfadeMs;
+		return android::binder::Status::ok();
+	}
+	android::binder::Status setCrossfade(int32_t durationMs);
+	android::binder::Status next();
+	android::binder::Status previous();
+	android::binder::Status getShuffle(bool* pEnabled) {
+		METRICS_SCOPED_TIMER("binder.getShuffle");
+		*pEnabled = queue.shuffle();
+		return android::binder::Status::ok();
+	}
+	android::binder::Status setShuffle(bool enabled);
+	android::binder::Status playByName(const String16& query);
+	status_t dump(int fd, const Vector<String16>& args) override {
+		metrics::Registry::Get()->Dump(fd);
+		return NO_ERROR;
+	}
+	android::binder::Status registerListener(const sp<IMp3PlayerListener>& listener);
+	android::binder::Status unregisterListener(const sp<IMp3PlayerListener>& listener);
+	android::binder::Status playAsync(int32_t requestId, const sp<IMp3PlayerListener>& listener) {
+		METRICS_SCOPED_TIMER("binder.playAsync");
+		if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::playAsync),
+		                                   ::base::Unretained(this), requestId, listener)))
+			return android::binder::Status::ok();
+		BeginRequest(requestId);
+		ReportCompletion(requestId, listener, play());
+		return android::binder::Status::ok();
+	}
+	android::binder::Status pauseAsync(int32_t requestId, const sp<IMp3PlayerListener>& listener) {
+		METRICS_SCOPED_TIMER("binder.pauseAsync");
+		if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::pauseAsync),
+		                                   ::base::Unretained(this), requestId, listener)))
+			return android::binder::Status::ok();
+		BeginRequest(requestId);
+		ReportCompletion(requestId, listener, pause());
+		return android::binder::Status::ok();
+	}
+	android::binder::Status stopAsync(int32_t requestId, const sp<IMp3PlayerListener>& listener) {
+		METRICS_SCOPED_TIMER("binder.stopAsync");
+		if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::stopAsync),
+		                                   ::base::Unretained(this), requestId, listener)))
+			return android::binder::Status::ok();
+		BeginRequest(requestId);
+		ReportCompletion(requestId, listener, stop());
+		return android::binder::Status::ok();
+	}
+	android::binder::Status applyVolumeAsync(int32_t requestId, const sp<IMp3PlayerListener>& listener,
+	                                         float vol, bool state) {
+		METRICS_SCOPED_TIMER("binder.applyVolumeAsync");
+		if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::applyVolumeAsync),
+		                                   ::base::Unretained(this), requestId, listener, vol, state)))
+			return android::binder::Status::ok();
+		BeginRequest(requestId);
+		ReportCompletion(requestId, listener, applyVolume(vol, state));
+		return android::binder::Status::ok();
+	}
+	android::binder::Status seekAsync(int32_t requestId, const sp<IMp3PlayerListener>& listener,
+	                                  int32_t positionMs) {
+		METRICS_SCOPED_TIMER("binder.seekAsync");
+		if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::seekAsync),
+		                                   ::base::Unretained(this), requestId, listener, positionMs)))
+			return android::binder::Status::ok();
+		BeginRequest(requestId);
+		ReportCompletion(requestId, listener, seek(positionMs));
+		return android::binder::Status::ok();
+	}
+	android::binder::Status setCrossfadeAsync(int32_t requestId, const sp<IMp3PlayerListener>& listener,
+	                                          int32_t durationMs) {
+		METRICS_SCOPED_TIMER("binder.setCrossfadeAsync");
+		if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::setCrossfadeAsync),
+		                                   ::base::Unretained(this), requestId, listener, durationMs)))
+			return android::binder::Status::ok();
+		BeginRequest(requestId);
+		ReportCompletion(requestId, listener, setCrossfade(durationMs));
+		return android::binder::Status::ok();
+	}
+	android::binder::Status nextAsync(int32_t requestId, const sp<IMp3PlayerListener>& listener) {
+		METRICS_SCOPED_TIMER("binder.nextAsync");
+		if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::nextAsync),
+		                                   ::base::Unretained(this), requestId, listener)))
+			return android::binder::Status::ok();
+		BeginRequest(requestId);
+		ReportCompletion(requestId, listener, next());
+		return android::binder::Status::ok();
+	}
+	android::binder::Status previousAsync(int32_t requestId, const sp<IMp3PlayerListener>& listener) {
+		METRICS_SCOPED_TIMER("binder.previousAsync");
+		if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::previousAsync),
+		                                   ::base::Unretained(this), requestId, listener)))
+			return android::binder::Status::ok();
+		BeginRequest(requestId);
+		ReportCompletion(requestId, listener, previous());
+		return android::binder::Status::ok();
+	}
+	android::binder::Status setShuffleAsync(int32_t requestId, const sp<IMp3PlayerListener>& listener,
+	                                        bool enabled) {
+		METRICS_SCOPED_TIMER("binder.setShuffleAsync");
+		if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::setShuffleAsync),
+		                                   ::base::Unretained(this), requestId, listener, enabled)))
+			return android::binder::Status::ok();
+		BeginRequest(requestId);
+		ReportCompletion(requestId, listener, setShuffle(enabled));
+		return android::binder::Status::ok();
+	}
+	android::binder::Status playByNameAsync(int32_t requestId, const sp<IMp3PlayerListener>& listener,
+	                                        const String16& query) {
+		METRICS_SCOPED_TIMER("binder.playByNameAsync");
+		if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::playByNameAsync),
+		                                   ::base::Unretained(this), requestId, listener, query)))
+			return android::binder::Status::ok();
+		BeginRequest(requestId);
+		ReportCompletion(requestId, listener, playByName(query));
 		return android::binder::Status::ok();
 	}
 private:
-	void reloadPlaylist();
+	/* the outcome of the warmup, handed from the warmup thread to the loop */
+	struct WarmupResult {
+		status_t status = NO_INIT;
+		/* the library and its search index, taken over by the loop */
+		TrackTable tracks;
+		TrackSearch search{&tracks};
+		/* the ids in the order of the scan, for the play queue */
+		std::vector<TrackTable::TrackId> added;
+		std::vector<std::string> directories;
+		int64_t startUs = 0;
+	};
+	void Warmup(WarmupResult* result);
+	void OnWarmupDone(WarmupResult* result);
+	/* the changes of the library, applied to the playlist on the loop */
+	struct LibraryChanges {
+		std::set<std::string> names;
+		/* a full scan is needed, tracks then holds the whole library */
+		bool full = false;
+		std::vector<TrackInfo> tracks;
+		std::vector<std::string> removed;
+		/* to be watched */
+		std::vector<std::string> directories;
+	};
+	/* the loudness analysis of a track, handed from the analysis thread to the loop */
+	struct LoudnessResult {
+		TrackTable::TrackId id = TrackTable::kNoTrack;
+		std::string path;
+		uint32_t stamp = 0;
+		bool ok = false;
+		int32_t gainMb = 0;
+	};
+	/* the next track opened and decoded up to its first buffer, handed from
+	   the preroll thread to the loop */
+	struct PrerollResult {
+		~PrerollResult() {
+			if (firstBuffer != nullptr)
+				firstBuffer->release();
+			if (source != nullptr)
+				source->stop();
+		}
+		TrackTable::TrackId id = TrackTable::kNoTrack;
+		std::string path;
+		int32_t traceId = 0;
+		sp<MediaSource> source;
+		MediaBuffer* firstBuffer = nullptr;
+	};
+	void OpenPreroll(PrerollResult* result);
+	void OnPrerollDone(PrerollResult* result);
+	void ScheduleAnalysis();
+	void StartAnalysis();
+	void AnalyzeTrack(LoudnessResult* result);
+	void OnTrackAnalyzed(LoudnessResult* result);
+	void SaveLibraryIndex();
+	void OnLibraryFilesChanged(const std::set<std::string>& names, bool overflow);
+	void RefreshLibrary(LibraryChanges* changes);
+	void OnLibraryChanged(LibraryChanges* changes);
+	void PostLibraryTask(const ::base::Closure& task, const ::base::Closure& reply);
+	void PostThreadTask(::base::Thread* thread, const ::base::Closure& task,
+	                    const ::base::Closure& reply);
+	std::vector<std::string> LibraryRoots() const;
+	void WatchDirectories(const std::vector<std::string>& directories);
+	void RemoveTrack(TrackTable::TrackId id);
+	bool DropRemovedCurrent();
+	/* queues a request that changes the player until the warmup is done,
+	   all of them in order of arrival */
+	bool DeferWhileWarming(const ::base::Closure& request);
 	status_t PlayStagefrightMp3(std::string filename);
+	sp<MediaSource> OpenTrack(const std::string& filename, int32_t correlationId);
+	void StopPlayback();
+	void ReleasePlayback();
+	void RecordTrackUnderruns();
+	void ChangeTrack(bool start);
+	void SchedulePreroll();
+	void RequeuePreroll();
+	void Preroll();
+	void OnTrackAdvanced();
+	const String16& CurrentName() const;
+	String16 StatusString() const;
+	void FillSnapshot(PlayerSnapshot* pSnapshot) const;
+	void SetState(PlayerState new_state);
+	void UpdateGain();
+	void NotifyStateChanged();
+	void StartEOSWatch();
+	void WatchEOS();
+	void OnListenerDied(sp<IBinder> binder);
+	void BeginRequest(int32_t requestId);
+	void ReportCompletion(int32_t requestId, const sp<IMp3PlayerListener>& listener,
+	                      const android::binder::Status& result);
 
 	OMXClient client;
 	AudioPlayer* player;
+	/* the source of the player, switches to the pre-rolled track at EOS */
+	sp<TrackSequencer> sequencer;
+	/* reads the sequencer ahead of the player, and measures what reaches it */
+	sp<DecodeAheadSource> decodeAhead;
+	/* the underruns of the playing track are still to be recorded */
+	bool trackUnderrunsPending = false;
+	/* the track queued in the sequencer */
+	TrackTable::TrackId prerollId = TrackTable::kNoTrack;
+	brillo::MessageLoop::TaskId preroll_task = brillo::MessageLoop::kTaskIdNull;
+	/* a track is being opened on the preroll thread */
+	bool prerollRunning = false;
+	/* the player and the sequencer are kept, paused and without a track,
+	   for the next play */
+	bool parked = false;
+	brillo::MessageLoop::TaskId release_task = brillo::MessageLoop::kTaskIdNull;
 	PlayerState state;
-	std::vector<std::string> playList;
-	size_t playIndex;
+	/* the volume of the player's own stream, the other clients are not affected */
+	float volume = 1.0f;
+	bool muted = false;
+	GainStage gain;
+	/* the overlap of consecutive tracks, 0 for gapless transitions */
+	int32_t crossfadeMs = 0;
+	/* the playlist: the tracks of the library by path, and the order they
+	   play in */
+	TrackTable tracks;
+	PlayQueue queue{&tracks};
+	/* finds tracks by title, artist or file name */
+	TrackSearch search{&tracks};
+	/* the display name of the current track, built once per track rather
+	   than by every status() */
+	mutable TrackTable::TrackId nameId = TrackTable::kNoTrack;
+	mutable String16 currentName;
+	/* the current track left the library, it is dropped once it ends */
+	bool currentRemoved = false;
+	const std::vector<std::string> libraryRoots;
+	/* used by the library thread only */
+	LibraryIndex library;
+	std::unique_ptr<LibraryWatcher> watcher;
+
+	/* clients to be notified of state changes and end of stream */
+	std::vector<sp<IMp3PlayerListener>> listeners;
+	brillo::MessageLoop::TaskId eos_watch_task = brillo::MessageLoop::kTaskIdNull;
+	/* the correlation id of the request being served, tags its trace points */
+	int32_t traceId = 0;
+	/* requests that arrived before the warmup finished, in order */
+	std::vector<::base::Closure> deferredRequests;
+	/* runs the warmup and the library updates off the message loop */
+	::base::Thread libraryThread;
+	/* analyzes the loudness of one track at a time, at idle priority and
+	   only while nothing plays */
+	::base::Thread analysisThread;
+	std::atomic<bool> analysisCancel{false};
+	bool analysisRunning = false;
+	/* where the search for a track to analyze resumes */
+	size_t analysisPosition = 0;
+	brillo::MessageLoop::TaskId analysis_task = brillo::MessageLoop::kTaskIdNull;
+	/* pending while analysis results may be unsaved */
+	brillo::MessageLoop::TaskId index_save_task = brillo::MessageLoop::kTaskIdNull;
+	/* opens the next track, the file, extractor and decoder setups stay off
+	   the loop */
+	::base::Thread prerollThread;
+	const bool warmPipeline;
+	/* the decoders of the playing and the pre-rolled track, and those kept
+	   for the next ones */
+	sp<DecoderPool> decoders;
+
+	::base::WeakPtrFactory<Mp3PlayerService> weak_ptr_factory_{this};
 };
 
-void Mp3PlayerService::reloadPlaylist()
+/* runs first on the analysis thread */
+static void LowerThreadPriority()
+{
+	struct sched_param param = {};
+	if (sched_setscheduler(0, SCHED_IDLE, &param) != 0 && setpriority(PRIO_PROCESS, 0, 19) != 0)
+		PLOG(WARNING) << "Unable to lower the priority of the loudness analysis";
+}
+
+void Mp3PlayerService::StartWarmup()
+{
+	if (!libraryThread.Start())
+		LOG(ERROR) << "Unable to start the library thread, updating the library inline";
+	if (!prerollThread.Start())
+		LOG(ERROR) << "Unable to start the preroll thread, pre-rolling inline";
+	/* changes made during the scan are refreshed after it */
+	watcher.reset(new LibraryWatcher(
+		::base::Bind(&Mp3PlayerService::OnLibraryFilesChanged, weak_ptr_factory_.GetWeakPtr())));
+	/* the subdirectories are watched once the scan found them */
+	WatchDirectories(libraryRoots);
+	if (analysisThread.Start())
+		analysisThread.task_runner()->PostTask(FROM_HERE, ::base::Bind(&LowerThreadPriority));
+	else
+		LOG(ERROR) << "Unable to start the loudness analysis thread, tracks play unnormalized";
+
+	/* the reply owns the result */
+	WarmupResult* result = new WarmupResult;
+	result->startUs = metrics::NowUs();
+	PostLibraryTask(
+		::base::Bind(&Mp3PlayerService::Warmup, ::base::Unretained(this),
+		             ::base::Unretained(result)),
+		::base::Bind(&Mp3PlayerService::OnWarmupDone, weak_ptr_factory_.GetWeakPtr(),
+		             ::base::Owned(result)));
+}
+
+/* runs the task on the library thread and the reply on the message loop */
+void Mp3PlayerService::PostLibraryTask(const ::base::Closure& task, const ::base::Closure& reply)
+{
+	PostThreadTask(&libraryThread, task, reply);
+}
+
+/* runs the task on the thread, inline if it did not start, and the reply
+   on the message loop */
+void Mp3PlayerService::PostThreadTask(::base::Thread* thread, const ::base::Closure& task,
+                                      const ::base::Closure& reply)
 {
-	playList.clear();
-	DIR *dp;
-	if ((dp = opendir(SOUNDTRACKS_FORDER.c_str())) == NULL) {
-		LOG(ERROR) << "Unable to open directory '" << SOUNDTRACKS_FORDER
-		           << "' (errno=" << errno << ")";
+	if (!thread->IsRunning()) {
+		task.Run();
+		reply.Run();
 		return;
 	}
-	struct dirent *dirp;
-	while ((dirp = readdir(dp)) != NULL) {
-		std::string filename(dirp->d_name);
-		if (filename.find(".mp3") != std::string::npos)
-			playList.push_back(filename);
+	thread->task_runner()->PostTaskAndReply(FROM_HERE, task, reply);
+}
+
+/* the roots from the property, each ending with '/' */
+std::vector<std::string> Mp3PlayerService::LibraryRoots() const
+{
+	char value[PROPERTY_VALUE_MAX];
+	property_get(LIBRARY_ROOTS_PROPERTY.c_str(), value, DEFAULT_LIBRARY_ROOTS.c_str());
+	std::vector<std::string> roots = ::base::SplitString(value, ":",
+		::base::TRIM_WHITESPACE, ::base::SPLIT_WANT_NONEMPTY);
+	if (roots.empty())
+		roots.push_back(DEFAULT_LIBRARY_ROOTS);
+	for (auto& root : roots) {
+		if (root.back() != '/')
+			root += '/';
 	}
-	closedir(dp);
-	playIndex = 0;
+	return roots;
+}
 
-	LOG(INFO) << "Found " << playList.size() << " MP3 files";
-	for (size_t i = 0; i < playList.size(); i++)
-		LOG(INFO) << "\t" << i << ": " << playList[i];
+void Mp3PlayerService::WatchDirectories(const std::vector<std::string>& directories)
+{
+	for (const auto& directory : directories)
+		watcher->AddDirectory(directory);
+}
+
+/* runs on the library thread, touches nothing the loop thread uses */
+void Mp3PlayerService::Warmup(WarmupResult* result)
+{
+	result->status = client.connect();
+	if (result->status != OK)
+		return;
+	for (const auto& info : library.Update(&result->directories, nullptr)) {
+		bool added;
+		TrackTable::TrackId id = result->tracks.Put(info, &added);
+		if (added)
+			result->added.push_back(id);
+	}
+	result->tracks.ShrinkToFit();
+	/* a large library takes seconds to index on the device, not to be
+	   spent on the loop */
+	int64_t searchStartUs = metrics::NowUs();
+	result->search.Rebuild();
+	result->search.ShrinkToFit();
+	METRICS_RECORD("library.searchBuild", metrics::NowUs() - searchStartUs);
+}
+
+void Mp3PlayerService::OnWarmupDone(WarmupResult* result)
+{
+	METRICS_RECORD("startup.warmup", metrics::NowUs() - result->startUs);
+	if (result->status != OK)
+		LOG(ERROR) << "Unable to connect to the OMX codecs (status=" << result->status << ")";
+	/* nothing changes the tracks before the warmup is done */
+	tracks.Swap(&result->tracks);
+	search.Swap(&result->search);
+	for (TrackTable::TrackId id : result->added)
+		queue.OnAdded(id);
+	if (!tracks.empty()) {
+		queue.SetCurrent(tracks.At(0));
+		size_t bytes = tracks.MemoryBytes() + queue.MemoryBytes();
+		METRICS_RECORD("library.bytesPerTrack", bytes / tracks.size());
+		METRICS_RECORD("library.searchBytesPerTrack", search.MemoryBytes() / tracks.size());
+		LOG(INFO) << tracks.size() << " tracks in " << bytes << " bytes of playlist and "
+		          << search.MemoryBytes() << " bytes of search index";
+	}
+	WatchDirectories(result->directories);
+	SetState(Idle);
+	startup::Milestone("warmup.done");
+
+	std::vector<::base::Closure> requests;
+	requests.swap(deferredRequests);
+	LOG(INFO) << "Warmed up, running " << requests.size() << " deferred requests";
+	for (auto& request : requests)
+		request.Run();
+}
+
+void Mp3PlayerService::ScheduleAnalysis()
+{
+	if (analysisRunning || analysis_task != brillo::MessageLoop::kTaskIdNull)
+		return;
+	analysis_task = brillo::MessageLoop::current()->PostDelayedTask(
+		::base::Bind(&Mp3PlayerService::StartAnalysis, weak_ptr_factory_.GetWeakPtr()),
+		::base::TimeDelta::FromMilliseconds(LOUDNESS_PAUSE_MS));
+}
+
+/* analyzes the first track without a gain, the results are saved in the
+   index in batches, so a restart resumes close to the next track */
+void Mp3PlayerService::StartAnalysis()
+{
+	analysis_task = brillo::MessageLoop::kTaskIdNull;
+	if (state == Warming || state == Playing || !analysisThread.IsRunning())
+		return;
+	TrackTable::TrackId id = tracks.NextUnanalyzed(&analysisPosition);
+	if (id == TrackTable::kNoTrack) {
+		/* the end of the analysis, the last batch is saved now */
+		if (index_save_task != brillo::MessageLoop::kTaskIdNull) {
+			brillo::MessageLoop::current()->CancelTask(index_save_task);
+			SaveLibraryIndex();
+		}
+		return;
+	}
+	analysisCancel = false;
+	analysisRunning = true;
+	LoudnessResult* result = new LoudnessResult;
+	result->id = id;
+	result->path = tracks.Path(id);
+	result->stamp = tracks.Stamp(id);
+	analysisThread.task_runner()->PostTaskAndReply(FROM_HERE,
+		::base::Bind(&Mp3PlayerService::AnalyzeTrack, ::base::Unretained(this),
+		             ::base::Unretained(result)),
+		::base::Bind(&Mp3PlayerService::OnTrackAnalyzed, weak_ptr_factory_.GetWeakPtr(),
+		             ::base::Owned(result)));
+}
+
+/* runs on the analysis thread */
+void Mp3PlayerService::AnalyzeTrack(LoudnessResult* result)
+{
+	result->ok = AnalyzeLoudness(result->path, analysisCancel, &result->gainMb);
+}
+
+void Mp3PlayerService::OnTrackAnalyzed(LoudnessResult* result)
+{
+	analysisRunning = false;
+	/* the playback took over, the track is analyzed again later */
+	if (analysisCancel)
+		return;
+	/* an undecodable track keeps its level rather than being retried forever */
+	int32_t gainMb = result->ok ? result->gainMb : 0;
+	METRICS_COUNT("loudness.analyzed");
+	/* the id may have gone to another track meanwhile */
+	if (tracks.Contains(result->id) && tracks.Stamp(result->id) == result->stamp &&
+	    tracks.Path(result->id) == result->path)
+		tracks.SetGain(result->id, gainMb);
+	PostLibraryTask(
+		::base::Bind(&LibraryIndex::SetGain, ::base::Unretained(&library), result->path,
+		             result->stamp, gainMb),
+		::base::Bind(&::base::DoNothing));
+	if (index_save_task == brillo::MessageLoop::kTaskIdNull) {
+		index_save_task = brillo::MessageLoop::current()->PostDelayedTask(
+			::base::Bind(&Mp3PlayerService::SaveLibraryIndex, weak_ptr_factory_.GetWeakPtr()),
+			::base::TimeDelta::FromMilliseconds(INDEX_SAVE_MS));
+	}
+	ScheduleAnalysis();
+}
+
+/* the results of a batch not yet full, e.g. when the playback paused the
+   analysis */
+void Mp3PlayerService::SaveLibraryIndex()
+{
+	index_save_task = brillo::MessageLoop::kTaskIdNull;
+	PostLibraryTask(::base::Bind(&LibraryIndex::Flush, ::base::Unretained(&library)),
+	                ::base::Bind(&::base::DoNothing));
+}
+
+void Mp3PlayerService::OnLibraryFilesChanged(const std::set<std::string>& names, bool overflow)
+{
+	LibraryChanges* changes = new LibraryChanges;
+	changes->names = names;
+	changes->full = overflow;
+	PostLibraryTask(
+		::base::Bind(&Mp3PlayerService::RefreshLibrary, ::base::Unretained(this),
+		             ::base::Unretained(changes)),
+		::base::Bind(&Mp3PlayerService::OnLibraryChanged, weak_ptr_factory_.GetWeakPtr(),
+		             ::base::Owned(changes)));
+}
+
+/* runs on the library thread */
+void Mp3PlayerService::RefreshLibrary(LibraryChanges* changes)
+{
+	if (changes->full) {
+		LOG(WARNING) << "Missed library changes, rescanning";
+		changes->tracks = library.Update(&changes->directories, &changes->removed);
+	} else {
+		library.Refresh(changes->names, &changes->tracks, &changes->removed,
+		                &changes->directories);
+	}
+}
+
+/* applies the changes while the current track and its position stay put */
+void Mp3PlayerService::OnLibraryChanged(LibraryChanges* changes)
+{
+	WatchDirectories(changes->directories);
+	if (!changes->full && changes->tracks.empty() && changes->removed.empty())
+		return;
+	METRICS_SCOPED_TIMER("library.apply");
+	bool active = state == Playing || state == Paused;
+	for (const auto& path : changes->removed) {
+		TrackTable::TrackId id = tracks.Find(path);
+		if (id == TrackTable::kNoTrack)
+			continue;
+		if (active && id == queue.current()) {
+			currentRemoved = true;
+			continue;
+		}
+		RemoveTrack(id);
+	}
+	/* a full scan puts every track, most of them unchanged */
+	for (const auto& info : changes->tracks) {
+		/* the tags of a track only change along with its file */
+		TrackTable::TrackId id = tracks.Find(info.path);
+		bool retagged = id != TrackTable::kNoTrack && tracks.Stamp(id) != info.Stamp();
+		if (retagged)
+			search.Remove(id);
+		bool added;
+		id = tracks.Put(info, &added);
+		if (added)
+			queue.OnAdded(id);
+		else if (id == queue.current())
+			currentRemoved = false;
+		if (added || retagged)
+			search.Add(id);
+	}
+	if (queue.current() == TrackTable::kNoTrack && !tracks.empty())
+		queue.SetCurrent(tracks.At(0));
+
+	RequeuePreroll();
+	/* the title of the current track may have changed */
+	nameId = TrackTable::kNoTrack;
+	NotifyStateChanged();
+	ScheduleAnalysis();
+}
+
+/* the queue and the search let go of the track before the table does */
+void Mp3PlayerService::RemoveTrack(TrackTable::TrackId id)
+{
+	queue.OnRemoved(id);
+	search.Remove(id);
+	tracks.Remove(id);
+}
+
+/* drops the track that left the library while it was playing */
+bool Mp3PlayerService::DropRemovedCurrent()
+{
+	if (!currentRemoved)
+		return false;
+	currentRemoved = false;
+	/* the queue goes on to the next track */
+	RemoveTrack(queue.current());
+	return true;
+}
+
+bool Mp3PlayerService::DeferWhileWarming(const ::base::Closure& request)
+{
+	if (state != Warming)
+		return false;
+	deferredRequests.push_back(request);
+	return true;
 }
 
 status_t Mp3PlayerService::PlayStagefrightMp3(std::string filename)
+{
+	int64_t startUs = metrics::NowUs();
+	sp<MediaSource> decoded_source = OpenTrack(filename, traceId);
+	if (decoded_source == nullptr)
+		return UNKNOWN_ERROR;
+
+	int64_t durationUs = (int64_t)tracks.DurationMs(queue.current()) * 1000;
+	if (parked) {
+		if (release_task != brillo::MessageLoop::kTaskIdNull) {
+			brillo::MessageLoop::current()->CancelTask(release_task);
+			release_task = brillo::MessageLoop::kTaskIdNull;
+		}
+		/* the seek flushes the sink of what was left of the last track */
+		if (sequencer->Replace(decoded_source, durationUs, tracks.Gain(queue.current())) &&
+		    player->seekTo(0) == OK) {
+			parked = false;
+			decodeAhead->MarkStart(startUs);
+			player->resume();
+			trackUnderrunsPending = true;
+			METRICS_RECORD("playback.start_warm", metrics::NowUs() - startUs);
+			SchedulePreroll();
+			return OK;
+		}
+		/* another format needs another sink */
+		ReleasePlayback();
+	}
+
+	// Play audio.
+	sequencer = new TrackSequencer(decoded_source, durationUs, tracks.Gain(queue.current()),
+		::base::Bind(&Mp3PlayerService::OnTrackAdvanced, weak_ptr_factory_.GetWeakPtr()));
+	sequencer->SetCrossfade((int64_t)crossfadeMs * 1000);
+	player = new AudioPlayer(nullptr);  // Initialize without source.
+	decodeAhead = new DecodeAheadSource(sequencer, DECODE_AHEAD_MS, &gain);
+	decodeAhead->MarkStart(startUs);
+	player->setSource(decodeAhead);
+	status_t status = player->start();
+	if (status != OK) {
+		LOG(ERROR) << "Could not start playing audio.";
+		delete player;
+		player = nullptr;
+		sequencer = nullptr;
+		decodeAhead = nullptr;
+		return status;
+	}
+	trackUnderrunsPending = true;
+	METRICS_RECORD("playback.start_cold", metrics::NowUs() - startUs);
+	SchedulePreroll();
+	return status;
+}
+
+/* a decoder for the file, not started yet */
+sp<MediaSource> Mp3PlayerService::OpenTrack(const std::string& filename, int32_t correlationId)
 {
 	/* ${BDK_PATH}/device/generic/brillo/pts/audio/brillo-audio-test/stagefright_playback.cpp */
-	FileSource* file_source = new FileSource(filename.c_str());
+	sp<DataSource> file_source = MmapSource::Open(filename);
 	status_t status = file_source->initCheck();
 	if (status != OK) {
 		LOG(ERROR) << "Could not open the mp3 file source.";
-		return status;
+		return nullptr;
 	}
 
 	// Register default sniffers so MediaExtractor knows what kind of sniffer to
@@ -131,84 +805,586 @@ status_t Mp3PlayerService::PlayStagefrightMp3(std::string filename)
 	// Extract media.
 	sp<MediaExtractor> media_extractor =
 		reinterpret_cast<android::MediaExtractor*>(MediaExtractor::Create(file_source, NULL).get());
+	if (media_extractor == nullptr) {
+		LOG(ERROR) << "Could not extract " << filename;
+		return nullptr;
+	}
 	LOG(INFO) << "Num tracks: " << media_extractor->countTracks();
 	sp<MediaSource> media_source =
 		reinterpret_cast<android::MediaSource*>(media_extractor->getTrack(0).get());
+	/* frames read through the frame index seek without decoding up to the position */
+	const char* mime;
+	if (media_source->getFormat()->findCString(kKeyMIMEType, &mime) &&
+	    !strcasecmp(mime, MEDIA_MIMETYPE_AUDIO_MPEG)) {
+		sp<MediaSource> frames = Mp3FrameSource::Create(file_source, media_source->getFormat());
+		if (frames != nullptr)
+			media_source = frames;
+	}
 
 	// Decode audio.
-	sp<MediaSource> decoded_source = SimpleDecodingSource::Create(media_source);
+	trace::Mark("decoder.start", correlationId);
+	sp<MediaSource> decoded_source = decoders->Open(media_source);
+	if (decoded_source == nullptr)
+		return nullptr;
+	return new InstrumentedSource(decoded_source, correlationId);
+}
 
-	// Play audio.
-	player = new AudioPlayer(nullptr);  // Initialize without source.
-	player->setSource(decoded_source);
-	status = player->start();
+/* stops the playback, the queue stays on the current track; a warm
+   pipeline is parked rather than torn down */
+void Mp3PlayerService::StopPlayback()
+{
+	RecordTrackUnderruns();
+	prerollId = TrackTable::kNoTrack;
+	if (preroll_task != brillo::MessageLoop::kTaskIdNull) {
+		brillo::MessageLoop::current()->CancelTask(preroll_task);
+		preroll_task = brillo::MessageLoop::kTaskIdNull;
+	}
+	if (!warmPipeline || player == nullptr) {
+		ReleasePlayback();
+		return;
+	}
+	player->pause();
+	/* the decoders go back to the pool */
+	sequencer->Clear();
+	parked = true;
+	release_task = brillo::MessageLoop::current()->PostDelayedTask(
+		::base::Bind(&Mp3PlayerService::ReleasePlayback, weak_ptr_factory_.GetWeakPtr()),
+		::base::TimeDelta::FromMilliseconds(WARM_PIPELINE_MS));
+}
+
+/* tears the pipeline down, the sink and the idle decoders with it */
+void Mp3PlayerService::ReleasePlayback()
+{
+	if (release_task != brillo::MessageLoop::kTaskIdNull) {
+		brillo::MessageLoop::current()->CancelTask(release_task);
+		release_task = brillo::MessageLoop::kTaskIdNull;
+	}
+	delete player;
+	player = nullptr;
+	sequencer = nullptr;
+	decodeAhead = nullptr;
+	parked = false;
+	decoders->Trim();
+}
+
+/* one value per track played, in playback.track_underruns */
+void Mp3PlayerService::RecordTrackUnderruns()
+{
+	if (!trackUnderrunsPending || decodeAhead == nullptr)
+		return;
+	trackUnderrunsPending = false;
+	METRICS_RECORD_ROLLING("playback.track_underruns", decodeAhead->TakeUnderruns());
+}
+
+/* after the queue moved: playback starts over with the new current track,
+   or stops on it */
+void Mp3PlayerService::ChangeTrack(bool start)
+{
+	if (state == Playing || state == Paused)
+		StopPlayback();
+	if (start && queue.current() != TrackTable::kNoTrack &&
+	    PlayStagefrightMp3(tracks.Path(queue.current())) == OK) {
+		if (state == Playing)
+			NotifyStateChanged();
+		else
+			SetState(Playing);
+		return;
+	}
+	if (state == Idle)
+		NotifyStateChanged();
+	else
+		SetState(Idle);
+}
+
+/* pre-rolls on the message loop, after the reply to the current request */
+void Mp3PlayerService::SchedulePreroll()
+{
+	if (preroll_task != brillo::MessageLoop::kTaskIdNull)
+		return;
+	preroll_task = brillo::MessageLoop::current()->PostTask(
+		::base::Bind(&Mp3PlayerService::Preroll, weak_ptr_factory_.GetWeakPtr()));
+}
+
+/* the queued track may no longer be the one the queue goes to next */
+void Mp3PlayerService::RequeuePreroll()
+{
+	if (sequencer == nullptr || parked || !sequencer->HasNext() || queue.Peek() == prerollId)
+		return;
+	sequencer->ClearNext();
+	prerollId = TrackTable::kNoTrack;
+	SchedulePreroll();
+}
+
+/* opens the next track of the queue and decodes its first buffer on the
+   preroll thread, so the sequencer can switch to it without a gap */
+void Mp3PlayerService::Preroll()
+{
+	preroll_task = brillo::MessageLoop::kTaskIdNull;
+	/* a preroll still running is checked against the queue once it is done */
+	if (sequencer == nullptr || parked || sequencer->HasNext() || prerollRunning)
+		return;
+	TrackTable::TrackId nextId = queue.Peek();
+	if (nextId == TrackTable::kNoTrack)
+		return;
+	prerollRunning = true;
+	/* the reply owns the result */
+	PrerollResult* result = new PrerollResult;
+	result->id = nextId;
+	result->path = tracks.Path(nextId);
+	result->traceId = traceId;
+	PostThreadTask(&prerollThread,
+		::base::Bind(&Mp3PlayerService::OpenPreroll, ::base::Unretained(this),
+		             ::base::Unretained(result)),
+		::base::Bind(&Mp3PlayerService::OnPrerollDone, weak_ptr_factory_.GetWeakPtr(),
+		             ::base::Owned(result)));
+}
+
+/* runs on the preroll thread */
+void Mp3PlayerService::OpenPreroll(PrerollResult* result)
+{
+	METRICS_SCOPED_TIMER("playback.preroll");
+	sp<MediaSource> next = OpenTrack(result->path, result->traceId);
+	if (next == nullptr)
+		return;
+	if (next->start() != OK) {
+		LOG(ERROR) << "Could not start the decoder of " << result->path;
+		return;
+	}
+	/* the decoder may report its output format before the first buffer */
+	status_t status;
+	while ((status = next->read(&result->firstBuffer)) == INFO_FORMAT_CHANGED) {
+	}
 	if (status != OK) {
-		LOG(ERROR) << "Could not start playing audio.";
-		return status;
+		LOG(ERROR) << "Could not decode " << result->path;
+		result->firstBuffer = nullptr;
+		next->stop();
+		return;
 	}
-	return status;
+	result->source = next;
+}
+
+void Mp3PlayerService::OnPrerollDone(PrerollResult* result)
+{
+	prerollRunning = false;
+	if (result->source == nullptr)
+		return;
+	/* the playback stopped, or the queue moved on, while the track opened */
+	if (sequencer == nullptr || parked || sequencer->HasNext() || queue.Peek() != result->id ||
+	    !tracks.Contains(result->id)) {
+		METRICS_COUNT("playback.prerollDiscarded");
+		SchedulePreroll();
+		return;
+	}
+	TrackTable::TrackId nextId = result->id;
+	MediaBuffer* first_buffer = result->firstBuffer;
+	result->firstBuffer = nullptr;
+	sp<MediaSource> next = result->source;
+	result->source = nullptr;
+	if (sequencer->SetNext(next, (int64_t)tracks.DurationMs(nextId) * 1000,
+	                       tracks.Gain(nextId), first_buffer))
+		prerollId = nextId;
+}
+
+void Mp3PlayerService::OnTrackAdvanced()
+{
+	/* a sequencer stopped since has nothing to advance */
+	if (sequencer == nullptr || prerollId == TrackTable::kNoTrack)
+		return;
+	METRICS_COUNT("playback.gapless");
+	/* the ring holds the end of the last track still, which is close enough */
+	RecordTrackUnderruns();
+	trackUnderrunsPending = true;
+	DropRemovedCurrent();
+	if (tracks.Contains(prerollId) && queue.current() != prerollId) {
+		if (queue.Peek() == prerollId)
+			queue.Next();
+		else
+			queue.SetCurrent(prerollId);
+	}
+	prerollId = TrackTable::kNoTrack;
+	LOG(INFO) << "Continued gaplessly with " << tracks.Path(queue.current());
+	NotifyStateChanged();
+	SchedulePreroll();
 }
 
 android::binder::Status Mp3PlayerService::play()
 {
+	METRICS_SCOPED_TIMER("binder.play");
+	if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::play),
+	                                   ::base::Unretained(this))))
+		return android::binder::Status::ok();
 	switch (state) {
 	case Idle:
-		if (playIndex < playList.size() &&
-		    PlayStagefrightMp3(SOUNDTRACKS_FORDER + playList[playIndex]) == OK)
-			state = Playing;
+		if (queue.current() != TrackTable::kNoTrack &&
+		    PlayStagefrightMp3(tracks.Path(queue.current())) == OK)
+			SetState(Playing);
 	case Playing:
 		break;
 	case Paused:
+		decodeAhead->MarkStart(metrics::NowUs());
 		player->resume();
-		state = Playing;
+		SetState(Playing);
 	}
 	return android::binder::Status::ok();
 }
 
 android::binder::Status Mp3PlayerService::pause()
 {
+	METRICS_SCOPED_TIMER("binder.pause");
+	if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::pause),
+	                                   ::base::Unretained(this))))
+		return android::binder::Status::ok();
 	if (state == Playing) {
 		player->pause();
-		state = Paused;
+		SetState(Paused);
 	}
 	return android::binder::Status::ok();
 }
 
 android::binder::Status Mp3PlayerService::stop()
 {
+	METRICS_SCOPED_TIMER("binder.stop");
+	if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::stop),
+	                                   ::base::Unretained(this))))
+		return android::binder::Status::ok();
 	if (state == Playing || state == Paused) {
-		delete player;
-		player = nullptr;
-		state  = Idle;
-		if (++playIndex >= playList.size())
-			playIndex = 0;
+		StopPlayback();
+		/* the next track takes the place of a removed one */
+		if (!DropRemovedCurrent())
+			queue.Next();
+		SetState(Idle);
 	}
 	return android::binder::Status::ok();
 }
 
+android::binder::Status Mp3PlayerService::next()
+{
+	METRICS_SCOPED_TIMER("binder.next");
+	if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::next),
+	                                   ::base::Unretained(this))))
+		return android::binder::Status::ok();
+	if (!DropRemovedCurrent())
+		queue.Next();
+	/* a paused player stops on the new track */
+	ChangeTrack(state == Playing);
+	return android::binder::Status::ok();
+}
+
+android::binder::Status Mp3PlayerService::previous()
+{
+	METRICS_SCOPED_TIMER("binder.previous");
+	if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::previous),
+	                                   ::base::Unretained(this))))
+		return android::binder::Status::ok();
+	TrackTable::TrackId current = queue.current();
+	queue.Previous();
+	/* a track that left the library is not gone back to */
+	if (currentRemoved) {
+		currentRemoved = false;
+		RemoveTrack(current);
+	}
+	ChangeTrack(state == Playing);
+	return android::binder::Status::ok();
+}
+
+android::binder::Status Mp3PlayerService::setShuffle(bool enabled)
+{
+	METRICS_SCOPED_TIMER("binder.setShuffle");
+	if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::setShuffle),
+	                                   ::base::Unretained(this), enabled)))
+		return android::binder::Status::ok();
+	queue.SetShuffle(enabled);
+	RequeuePreroll();
+	NotifyStateChanged();
+	return android::binder::Status::ok();
+}
+
+android::binder::Status Mp3PlayerService::playByName(const String16& query)
+{
+	METRICS_SCOPED_TIMER("binder.playByName");
+	if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::playByName),
+	                                   ::base::Unretained(this), query)))
+		return android::binder::Status::ok();
+	std::string name = String8(query).string();
+	int64_t startUs = metrics::NowUs();
+	TrackTable::TrackId id = search.Find(name);
+	METRICS_RECORD("library.search", metrics::NowUs() - startUs);
+	if (id == TrackTable::kNoTrack || (currentRemoved && id == queue.current()))
+		return android::binder::Status::fromServiceSpecificError(
+			NAME_NOT_FOUND, String8("no track matches"));
+	TrackTable::TrackId current = queue.current();
+	queue.SetCurrent(id);
+	if (currentRemoved && current != id) {
+		currentRemoved = false;
+		RemoveTrack(current);
+	}
+	LOG(INFO) << "Playing " << tracks.Path(id) << " for \"" << name << "\"";
+	ChangeTrack(true);
+	return android::binder::Status::ok();
+}
+
 android::binder::Status Mp3PlayerService::reachedEOS(bool* pEOS)
 {
+	METRICS_SCOPED_TIMER("binder.reachedEOS");
 	status_t s;
 	*pEOS = (state == Playing && player->reachedEOS(&s));
 	return android::binder::Status::ok();
 }
 
 android::binder::Status Mp3PlayerService::status(String16* pInfo)
+{
+	METRICS_SCOPED_TIMER("binder.status");
+	pInfo->setTo(StatusString());
+	return android::binder::Status::ok();
+}
+
+const String16& Mp3PlayerService::CurrentName() const
+{
+	if (nameId != queue.current()) {
+		nameId = queue.current();
+		currentName.setTo(String16(tracks.DisplayName(nameId).c_str()));
+	}
+	return currentName;
+}
+
+String16 Mp3PlayerService::StatusString() const
+{
+	switch (state) {
+	case Playing:
+		return CurrentName();
+	case Paused:
+		return String16("paused");
+	case Warming:
+		return String16("warming");
+	case Idle:
+	default:
+		return String16("idle");
+	}
+}
+
+void Mp3PlayerService::SetState(PlayerState new_state)
+{
+	if (state == new_state)
+		return;
+	state = new_state;
+	if (state == Playing) {
+		/* the analysis never competes with the playback */
+		analysisCancel = true;
+		StartEOSWatch();
+	} else {
+		ScheduleAnalysis();
+		if (eos_watch_task != brillo::MessageLoop::kTaskIdNull) {
+			brillo::MessageLoop::current()->CancelTask(eos_watch_task);
+			eos_watch_task = brillo::MessageLoop::kTaskIdNull;
+		}
+	}
+	NotifyStateChanged();
+}
+
+/* ramped in by the audio thread */
+void Mp3PlayerService::UpdateGain()
+{
+	gain.SetGain(muted ? 0.0f : std::min(std::max(volume, 0.0f), 1.0f));
+}
+
+void Mp3PlayerService::NotifyStateChanged()
+{
+	if (listeners.empty())
+		return;
+	PlayerSnapshot snapshot;
+	FillSnapshot(&snapshot);
+	for (auto& listener : listeners)
+		listener->onStateChanged(snapshot);
+}
+
+void Mp3PlayerService::FillSnapshot(PlayerSnapshot* pSnapshot) const
 {
 	switch (state) {
+	case Warming:
+		pSnapshot->state = PlayerSnapshot::WARMING;
+		break;
 	case Idle:
-		pInfo->setTo(String16("idle"));
+		pSnapshot->state = PlayerSnapshot::IDLE;
 		break;
 	case Playing:
-		pInfo->setTo(String16(playList[playIndex].c_str()));
+		pSnapshot->state = PlayerSnapshot::PLAYING;
 		break;
 	case Paused:
-		pInfo->setTo(String16("paused"));
+		pSnapshot->state = PlayerSnapshot::PAUSED;
 		break;
 	}
+	if (state == Playing || state == Paused) {
+		pSnapshot->trackId = queue.current();
+		pSnapshot->trackName.setTo(CurrentName());
+		pSnapshot->positionMs = player->getMediaTimeUs() / 1000;
+		pSnapshot->durationMs = tracks.DurationMs(queue.current());
+	}
+	pSnapshot->crossfadeMs = crossfadeMs;
+	pSnapshot->shuffle = queue.shuffle();
+	pSnapshot->volume = volume;
+	pSnapshot->muted = muted;
+}
+
+android::binder::Status Mp3PlayerService::getSnapshot(PlayerSnapshot* pSnapshot)
+{
+	METRICS_SCOPED_TIMER("binder.getSnapshot");
+	FillSnapshot(pSnapshot);
 	return android::binder::Status::ok();
 }
 
+android::binder::Status Mp3PlayerService::getPosition(int32_t* pPositionMs)
+{
+	METRICS_SCOPED_TIMER("binder.getPosition");
+	*pPositionMs = (state == Playing || state == Paused) ? player->getMediaTimeUs() / 1000 : 0;
+	return android::binder::Status::ok();
+}
+
+android::binder::Status Mp3PlayerService::getDuration(int32_t* pDurationMs)
+{
+	METRICS_SCOPED_TIMER("binder.getDuration");
+	*pDurationMs = (state == Playing || state == Paused) ? tracks.DurationMs(queue.current()) : 0;
+	return android::binder::Status::ok();
+}
+
+android::binder::Status Mp3PlayerService::seek(int32_t positionMs)
+{
+	METRICS_SCOPED_TIMER("binder.seek");
+	if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::seek),
+	                                   ::base::Unretained(this), positionMs)))
+		return android::binder::Status::ok();
+	if (state != Playing && state != Paused)
+		return android::binder::Status::fromServiceSpecificError(
+			INVALID_OPERATION, String8("nothing is playing"));
+	int64_t durationMs = tracks.DurationMs(queue.current());
+	if (positionMs < 0 || (durationMs > 0 && positionMs > durationMs))
+		return android::binder::Status::fromExceptionCode(
+			android::binder::Status::EX_ILLEGAL_ARGUMENT, String8("position out of the track"));
+	/* the sources down to the frame index see the seek with the next read */
+	trace::Mark("mp3.seek", traceId);
+	if (player->seekTo((int64_t)positionMs * 1000) != OK)
+		return android::binder::Status::fromServiceSpecificError(
+			UNKNOWN_ERROR, String8("seek failed"));
+	NotifyStateChanged();
+	return android::binder::Status::ok();
+}
+
+android::binder::Status Mp3PlayerService::setCrossfade(int32_t durationMs)
+{
+	METRICS_SCOPED_TIMER("binder.setCrossfade");
+	if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::setCrossfade),
+	                                   ::base::Unretained(this), durationMs)))
+		return android::binder::Status::ok();
+	if (durationMs < 0 || durationMs > MAX_CROSSFADE_MS)
+		return android::binder::Status::fromExceptionCode(
+			android::binder::Status::EX_ILLEGAL_ARGUMENT, String8("crossfade out of range"));
+	crossfadeMs = durationMs;
+	/* a fade already under way keeps its length */
+	if (sequencer != nullptr)
+		sequencer->SetCrossfade((int64_t)crossfadeMs * 1000);
+	NotifyStateChanged();
+	return android::binder::Status::ok();
+}
+
+android::binder::Status Mp3PlayerService::applyVolume(float vol, bool state)
+{
+	METRICS_SCOPED_TIMER("binder.applyVolume");
+	if (DeferWhileWarming(::base::Bind(::base::IgnoreResult(&Mp3PlayerService::applyVolume),
+	                                   ::base::Unretained(this), vol, state)))
+		return android::binder::Status::ok();
+	muted = state;
+	if (!state)
+		volume = vol;
+	UpdateGain();
+	NotifyStateChanged();
+	return android::binder::Status::ok();
+}
+
+void Mp3PlayerService::StartEOSWatch()
+{
+	if (eos_watch_task != brillo::MessageLoop::kTaskIdNull)
+		return;
+	eos_watch_task = brillo::MessageLoop::current()->PostDelayedTask(
+		::base::Bind(&Mp3PlayerService::WatchEOS, weak_ptr_factory_.GetWeakPtr()),
+		::base::TimeDelta::FromMilliseconds(EOS_WATCH_INTERVAL_MS));
+}
+
+void Mp3PlayerService::WatchEOS()
+{
+	eos_watch_task = brillo::MessageLoop::kTaskIdNull;
+	if (state != Playing)
+		return;
+	status_t s;
+	if (!player->reachedEOS(&s)) {
+		StartEOSWatch();
+		return;
+	}
+	/* the watch is re-armed by the next transition to Playing */
+	RecordTrackUnderruns();
+	LOG(INFO) << "Reached end of stream: " << tracks.Path(queue.current());
+	for (auto& listener : listeners)
+		listener->onEndOfStream();
+}
+
+android::binder::Status Mp3PlayerService::registerListener(const sp<IMp3PlayerListener>& listener)
+{
+	METRICS_SCOPED_TIMER("binder.registerListener");
+	sp<IBinder> binder = IInterface::asBinder(listener);
+	for (auto& l : listeners) {
+		if (IInterface::asBinder(l) == binder)
+			return android::binder::Status::ok();
+	}
+	android::BinderWrapper::Get()->RegisterForDeathNotifications(binder,
+		::base::Bind(&Mp3PlayerService::OnListenerDied, weak_ptr_factory_.GetWeakPtr(), binder));
+	listeners.push_back(listener);
+	return android::binder::Status::ok();
+}
+
+android::binder::Status Mp3PlayerService::unregisterListener(const sp<IMp3PlayerListener>& listener)
+{
+	METRICS_SCOPED_TIMER("binder.unregisterListener");
+	sp<IBinder> binder = IInterface::asBinder(listener);
+	for (auto it = listeners.begin(); it != listeners.end(); ++it) {
+		if (IInterface::asBinder(*it) == binder) {
+			android::BinderWrapper::Get()->UnregisterForDeathNotifications(binder);
+			listeners.erase(it);
+			break;
+		}
+	}
+	return android::binder::Status::ok();
+}
+
+void Mp3PlayerService::OnListenerDied(sp<IBinder> binder)
+{
+	LOG(INFO) << "Mp3PlayerService::OnListenerDied";
+	for (auto it = listeners.begin(); it != listeners.end(); ++it) {
+		if (IInterface::asBinder(*it) == binder) {
+			listeners.erase(it);
+			break;
+		}
+	}
+}
+
+void Mp3PlayerService::BeginRequest(int32_t requestId)
+{
+	trace::Mark("mp3.receive", requestId);
+	traceId = requestId;
+}
+
+void Mp3PlayerService::ReportCompletion(int32_t requestId, const sp<IMp3PlayerListener>& listener,
+                                        const android::binder::Status& result)
+{
+	trace::Mark("mp3.complete", requestId);
+	traceId = 0;
+	if (!listener.get())
+		return;
+	int32_t error = 0;
+	if (!result.isOk()) {
+		error = result.exceptionCode() == android::binder::Status::EX_SERVICE_SPECIFIC ?
+			result.serviceSpecificErrorCode() : result.exceptionCode();
+	}
+	listener->onRequestCompleted(requestId, error, String16(result.exceptionMessage()));
+}
+
 class MyDaemon final : public brillo::Daemon {
 public:
 	MyDaemon() = default;
@@ -226,6 +1402,7 @@ private:
 
 int MyDaemon::OnInit()
 {
+	startup::Milestone("oninit.begin");
 	int rc;
 	if ((rc = brillo::Daemon::OnInit()) != EX_OK)
 		return rc;
@@ -235,9 +1412,13 @@ int MyDaemon::OnInit()
 	if (!binder_watcher_.Init())
 		return EX_OSERR;
 
+	/* register first, the clients see the warming state until the library is scanned */
 	mp3_player_service_ = new Mp3PlayerService();
 	android::BinderWrapper::Get()->RegisterService(mp3_player_service::kBinderServiceName,
 	                                               mp3_player_service_);
+	startup::Milestone("binder.registered");
+	mp3_player_service_->StartWarmup();
+	startup::Milestone("oninit.end");
 	return EX_OK;
 }
 
@@ -245,6 +1426,7 @@ int main(int argc, char* argv[])
 {
 	::base::CommandLine::Init(argc, argv);
 	brillo::InitLog(brillo::kLogToSyslog | brillo::kLogHeader);
+	startup::Init("mp3-player-service");
 	MyDaemon daemon;
 	return daemon.Run();
 }
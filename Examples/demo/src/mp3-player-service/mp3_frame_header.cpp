@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mp3_frame_header.h"
+
+#include <string.h>
+
+namespace {
+
+/* kbps by bitrate index, for MPEG-1 layers I, II, III and MPEG-2/2.5
+   layer I and layers II/III */
+const uint16_t kBitrates[5][16] = {
+	{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+	{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+	{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },
+	{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+	{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+};
+
+/* by sample rate index, for MPEG-1, the frequency is halved for MPEG-2
+   and quartered for MPEG-2.5 */
+const int kSampleRates[3] = { 44100, 48000, 32000 };
+
+uint32_t ReadBE32(const uint8_t* p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+uint16_t ReadBE16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+bool ParseXing(const uint8_t* frame, size_t size, const Mp3FrameHeader& header,
+               uint64_t frameOffset, Mp3VbrInfo* info)
+{
+	/* the tag follows the side information */
+	bool mpeg1 = header.samplesPerFrame == 1152 && header.sampleRate >= 32000;
+	size_t offset = 4 + (mpeg1 ? (header.channels == 1 ? 17 : 32) :
+	                             (header.channels == 1 ? 9 : 17));
+	if (offset + 8 > size ||
+	    (memcmp(frame + offset, "Xing", 4) != 0 && memcmp(frame + offset, "Info", 4) != 0))
+		return false;
+	uint32_t flags = ReadBE32(frame + offset + 4);
+	offset += 8;
+	if (flags & 1) {
+		if (offset + 4 > size)
+			return false;
+		info->frames = ReadBE32(frame + offset);
+		offset += 4;
+	}
+	if (flags & 2) {
+		if (offset + 4 > size)
+			return false;
+		info->bytes = ReadBE32(frame + offset);
+		offset += 4;
+	}
+	info->seekPointCount = 0;
+	if ((flags & 4) && offset + 100 <= size && info->frames > 0 && info->bytes > 0) {
+		/* the byte position of each percent of the duration, in 1/256 */
+		for (int i = 0; i < 100; i++) {
+			Mp3SeekPoint& point = info->seekPoints[info->seekPointCount++];
+			point.frame = (uint64_t)info->frames * i / 100;
+			point.offset = frameOffset + info->bytes * frame[offset + i] / 256;
+		}
+	}
+	return true;
+}
+
+bool ParseVbri(const uint8_t* frame, size_t size, uint64_t frameOffset, Mp3VbrInfo* info)
+{
+	const size_t offset = 4 + 32;
+	if (offset + 26 > size || memcmp(frame + offset, "VBRI", 4) != 0)
+		return false;
+	info->bytes = ReadBE32(frame + offset + 10);
+	info->frames = ReadBE32(frame + offset + 14);
+	int entries = ReadBE16(frame + offset + 18);
+	int scale = ReadBE16(frame + offset + 20);
+	int entryBytes = ReadBE16(frame + offset + 22);
+	int framesPerEntry = ReadBE16(frame + offset + 24);
+	info->seekPointCount = 0;
+	if (entryBytes < 1 || entryBytes > 4 || offset + 26 + (size_t)entries * entryBytes > size)
+		return true;
+
+	/* every stride-th entry fits the seek points */
+	int stride = entries / Mp3VbrInfo::kMaxSeekPoints + 1;
+	const uint8_t* p = frame + offset + 26;
+	uint64_t position = frameOffset;
+	uint32_t frameNumber = 0;
+	for (int i = 0; i < entries; i++) {
+		if (i % stride == 0) {
+			Mp3SeekPoint& point = info->seekPoints[info->seekPointCount++];
+			point.frame = frameNumber;
+			point.offset = position;
+		}
+		uint32_t entry = 0;
+		for (int b = 0; b < entryBytes; b++)
+			entry = entry << 8 | *p++;
+		position += (uint64_t)entry * scale;
+		frameNumber += framesPerEntry;
+	}
+	return true;
+}
+
+}  // namespace
+
+bool ParseMp3FrameHeader(const uint8_t* bytes, Mp3FrameHeader* header)
+{
+	if (bytes[0] != 0xff || (bytes[1] & 0xe0) != 0xe0)
+		return false;
+	/* 0: MPEG-2.5, 2: MPEG-2, 3: MPEG-1 */
+	int version = (bytes[1] >> 3) & 3;
+	/* 1: layer III, 2: layer II, 3: layer I */
+	int layer = (bytes[1] >> 1) & 3;
+	int bitrateIndex = bytes[2] >> 4;
+	int sampleRateIndex = (bytes[2] >> 2) & 3;
+	if (version == 1 || layer == 0 || bitrateIndex == 0 || bitrateIndex == 15 ||
+	    sampleRateIndex == 3)
+		return false;
+	bool mpeg1 = version == 3;
+	int padding = (bytes[2] >> 1) & 1;
+
+	int table = mpeg1 ? 3 - layer : (layer == 3 ? 3 : 4);
+	header->bitrate = kBitrates[table][bitrateIndex] * 1000;
+	header->sampleRate = kSampleRates[sampleRateIndex] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+	header->channels = (bytes[3] >> 6) == 3 ? 1 : 2;
+	if (layer == 3) {
+		header->samplesPerFrame = 384;
+		header->frameBytes = (12 * header->bitrate / header->sampleRate + padding) * 4;
+	} else {
+		header->samplesPerFrame = (layer == 1 && !mpeg1) ? 576 : 1152;
+		header->frameBytes =
+			header->samplesPerFrame / 8 * header->bitrate / header->sampleRate + padding;
+	}
+	return true;
+}
+
+size_t Id3v2TagBytes(const uint8_t* bytes, size_t size)
+{
+	if (size < 10 || memcmp(bytes, "ID3", 3) != 0)
+		return 0;
+	/* syncsafe: 7 bits per byte */
+	for (int i = 6; i < 10; i++) {
+		if (bytes[i] & 0x80)
+			return 0;
+	}
+	size_t length = (size_t)bytes[6] << 21 | bytes[7] << 14 | bytes[8] << 7 | bytes[9];
+	/* the footer flag */
+	bool footer = bytes[5] & 0x10;
+	return 10 + length + (footer ? 10 : 0);
+}
+
+bool ParseMp3VbrHeader(const uint8_t* frame, size_t size, const Mp3FrameHeader& header,
+                       uint64_t frameOffset, Mp3VbrInfo* info)
+{
+	return ParseXing(frame, size, header, frameOffset, info) ||
+	       ParseVbri(frame, size, frameOffset, info);
+}
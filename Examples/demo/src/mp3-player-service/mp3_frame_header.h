@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_MP3_FRAME_HEADER_H_
+#define MP3_PLAYER_MP3_FRAME_HEADER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Parsing of the MPEG audio frame headers and of the headers found around
+ * them: the ID3v2 tag in front of the stream and the Xing, Info or VBRI
+ * header in its first frame. Nothing here allocates. */
+
+struct Mp3FrameHeader {
+	int sampleRate;
+	int channels;
+	/* bits per second */
+	int bitrate;
+	int samplesPerFrame;
+	size_t frameBytes;
+};
+
+/* the 4 bytes of a frame header, false if they are not a valid one;
+   free format frames are not supported */
+bool ParseMp3FrameHeader(const uint8_t* bytes, Mp3FrameHeader* header);
+
+/* the length of the ID3v2 tag the bytes start with, 0 if there is none;
+   needs 10 bytes */
+size_t Id3v2TagBytes(const uint8_t* bytes, size_t size);
+
+/* a frame of the stream and its offset in the file */
+struct Mp3SeekPoint {
+	uint32_t frame;
+	uint64_t offset;
+};
+
+/* the VBR header of the first frame */
+struct Mp3VbrInfo {
+	static const int kMaxSeekPoints = 128;
+
+	/* 0 if unknown */
+	uint32_t frames = 0;
+	uint64_t bytes = 0;
+	/* from the table of contents, ordered by frame */
+	Mp3SeekPoint seekPoints[kMaxSeekPoints];
+	int seekPointCount = 0;
+};
+
+/* looks for a Xing, Info or VBRI header in the first frame, which starts
+   at frameOffset in the file and is given whole */
+bool ParseMp3VbrHeader(const uint8_t* frame, size_t size, const Mp3FrameHeader& header,
+                       uint64_t frameOffset, Mp3VbrInfo* info);
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mp3_frame_source.h"
+
+#include <algorithm>
+
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaData.h>
+
+#include "metrics.h"
+
+using android::MediaBuffer;
+using android::MetaData;
+using android::sp;
+using android::status_t;
+
+sp<Mp3FrameSource> Mp3FrameSource::Create(const sp<android::DataSource>& source,
+                                          const sp<MetaData>& format)
+{
+	sp<Mp3FrameSource> frames = new Mp3FrameSource(source, format);
+	if (!frames->Init())
+		return nullptr;
+	return frames;
+}
+
+Mp3FrameSource::Mp3FrameSource(const sp<android::DataSource>& source, const sp<MetaData>& format)
+	: source_(source), format_(format), scratch_(kResyncBytes)
+{
+}
+
+bool Mp3FrameSource::Init()
+{
+	uint8_t tag[10];
+	off64_t offset = 0;
+	if (source_->readAt(0, tag, sizeof(tag)) == sizeof(tag))
+		offset = Id3v2TagBytes(tag, sizeof(tag));
+	Mp3FrameHeader header;
+	if (!NextFrame(&offset, &header))
+		return false;
+	sample_rate_ = header.sampleRate;
+	samples_per_frame_ = header.samplesPerFrame;
+
+	/* the Xing or VBRI frame carries no audio */
+	ssize_t n = source_->readAt(offset, scratch_.data(), header.frameBytes);
+	if (n == (ssize_t)header.frameBytes &&
+	    ParseMp3VbrHeader(scratch_.data(), n, header, offset, &vbr_))
+		offset += header.frameBytes;
+	first_frame_ = index_end_ = next_offset_ = offset;
+
+	if (vbr_.frames > 0) {
+		offsets_.reserve(vbr_.frames);
+	} else {
+		off64_t size;
+		if (source_->getSize(&size) == android::OK && size > offset)
+			offsets_.reserve((size - offset) / header.frameBytes + 1);
+	}
+	return true;
+}
+
+status_t Mp3FrameSource::start(MetaData* params)
+{
+	if (started_)
+		return android::OK;
+	group_.add_buffer(new MediaBuffer(kMaxFrameBytes));
+	started_ = true;
+	return android::OK;
+}
+
+status_t Mp3FrameSource::stop()
+{
+	/* the buffers go with the group */
+	started_ = false;
+	return android::OK;
+}
+
+sp<MetaData> Mp3FrameSource::getFormat()
+{
+	return format_;
+}
+
+status_t Mp3FrameSource::read(MediaBuffer** buffer, const ReadOptions* options)
+{
+	*buffer = nullptr;
+	int64_t seekTimeUs;
+	ReadOptions::SeekMode seekMode;
+	if (options && options->getSeekTo(&seekTimeUs, &seekMode))
+		SeekTo(seekTimeUs);
+
+	Mp3FrameHeader header;
+	if (!NextFrame(&next_offset_, &header) || header.frameBytes > kMaxFrameBytes)
+		return android::ERROR_END_OF_STREAM;
+	MediaBuffer* frame;
+	status_t status = group_.acquire_buffer(&frame);
+	if (status != android::OK)
+		return status;
+	if (source_->readAt(next_offset_, frame->data(), header.frameBytes) !=
+	    (ssize_t)header.frameBytes) {
+		frame->release();
+		return android::ERROR_END_OF_STREAM;
+	}
+	frame->set_range(0, header.frameBytes);
+	frame->meta_data()->clear();
+	frame->meta_data()->setInt64(android::kKeyTime, FrameTimeUs(next_frame_));
+	frame->meta_data()->setInt32(android::kKeyIsSyncFrame, 1);
+
+	if (indexed_ && next_frame_ == offsets_.size()) {
+		offsets_.push_back(next_offset_ - first_frame_);
+		index_end_ = next_offset_ + header.frameBytes;
+	}
+	next_offset_ += header.frameBytes;
+	next_frame_++;
+	*buffer = frame;
+	return android::OK;
+}
+
+bool Mp3FrameSource::NextFrame(off64_t* offset, Mp3FrameHeader* header)
+{
+	if (ReadHeader(*offset, header))
+		return true;
+	off64_t found = Resync(*offset);
+	if (found < 0 || !ReadHeader(found, header))
+		return false;
+	*offset = found;
+	return true;
+}
+
+/* a header counts once the one following it is found where it points to */
+off64_t Mp3FrameSource::Resync(off64_t offset)
+{
+	ssize_t n = source_->readAt(offset, scratch_.data(), scratch_.size());
+	Mp3FrameHeader header, next;
+	for (ssize_t i = 0; i + 4 <= n; i++) {
+		if (!ParseMp3FrameHeader(&scratch_[i], &header) ||
+		    (sample_rate_ != 0 && header.sampleRate != sample_rate_))
+			continue;
+		if (ReadHeader(offset + i + header.frameBytes, &next) &&
+		    next.sampleRate == header.sampleRate)
+			return offset + i;
+	}
+	return -1;
+}
+
+bool Mp3FrameSource::ReadHeader(off64_t offset, Mp3FrameHeader* header)
+{
+	uint8_t bytes[4];
+	return source_->readAt(offset, bytes, sizeof(bytes)) == sizeof(bytes) &&
+	       ParseMp3FrameHeader(bytes, header) &&
+	       (sample_rate_ == 0 || header->sampleRate == sample_rate_);
+}
+
+void Mp3FrameSource::SeekTo(int64_t timeUs)
+{
+	METRICS_SCOPED_TIMER("mp3.seek");
+	uint32_t frame = timeUs <= 0 ? 0 :
+		timeUs * sample_rate_ / ((int64_t)samples_per_frame_ * 1000000);
+	if (frame < offsets_.size()) {
+		next_frame_ = frame;
+		next_offset_ = first_frame_ + offsets_[frame];
+		indexed_ = true;
+		return;
+	}
+
+	if (vbr_.seekPointCount > 0) {
+		/* the last point at or before the frame */
+		const Mp3SeekPoint* begin = vbr_.seekPoints;
+		const Mp3SeekPoint* end = begin + vbr_.seekPointCount;
+		const Mp3SeekPoint* point = std::upper_bound(begin, end, frame,
+			[](uint32_t f, const Mp3SeekPoint& p) { return f < p.frame; }) - 1;
+		if (point->frame > offsets_.size()) {
+			next_frame_ = point->frame;
+			next_offset_ = std::max<off64_t>(point->offset, first_frame_);
+			indexed_ = false;
+			/* at most the frames between two points */
+			Mp3FrameHeader header;
+			while (next_frame_ < frame && NextFrame(&next_offset_, &header)) {
+				next_offset_ += header.frameBytes;
+				next_frame_++;
+			}
+			return;
+		}
+	}
+
+	ExtendIndex(frame);
+	indexed_ = true;
+	if (frame < offsets_.size()) {
+		next_frame_ = frame;
+		next_offset_ = first_frame_ + offsets_[frame];
+	} else {
+		/* past the end, the next read reports it */
+		next_frame_ = offsets_.size();
+		next_offset_ = index_end_;
+	}
+}
+
+void Mp3FrameSource::ExtendIndex(uint32_t frame)
+{
+	Mp3FrameHeader header;
+	while (offsets_.size() <= frame) {
+		off64_t offset = index_end_;
+		if (!NextFrame(&offset, &header))
+			break;
+		offsets_.push_back(offset - first_frame_);
+		index_end_ = offset + header.frameBytes;
+	}
+}
+
+int64_t Mp3FrameSource::FrameTimeUs(uint32_t frame) const
+{
+	return (int64_t)frame * samples_per_frame_ * 1000000 / sample_rate_;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_MP3_FRAME_SOURCE_H_
+#define MP3_PLAYER_MP3_FRAME_SOURCE_H_
+
+#include <vector>
+
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaBufferGroup.h>
+#include <media/stagefright/MediaSource.h>
+
+#include "mp3_frame_header.h"
+
+/* Reads the frames of an MPEG audio stream, one per buffer, for the decoder.
+ *
+ * The offset of every frame read is kept in a table, so seeking to any
+ * position already played is a lookup. A seek past the table jumps through
+ * the Xing or VBRI table of contents when the stream has one; otherwise the
+ * table is extended by a scan that reads the 4 header bytes of each frame
+ * and decodes nothing. Seek times go to mp3.seek. */
+class Mp3FrameSource : public android::MediaSource {
+public:
+	/* nullptr if no MPEG audio stream is found; the format is the one of
+	   the extractor's track */
+	static android::sp<Mp3FrameSource> Create(const android::sp<android::DataSource>& source,
+	                                          const android::sp<android::MetaData>& format);
+
+	android::status_t start(android::MetaData* params) override;
+	android::status_t stop() override;
+	android::sp<android::MetaData> getFormat() override;
+	android::status_t read(android::MediaBuffer** buffer,
+	                       const ReadOptions* options) override;
+
+private:
+	/* large enough for an MPEG-2.5 layer II frame at 160 kbps */
+	static const size_t kMaxFrameBytes = 4096;
+	/* how far to look for the next frame after junk or a jump */
+	static const size_t kResyncBytes = 8192;
+
+	Mp3FrameSource(const android::sp<android::DataSource>& source,
+	               const android::sp<android::MetaData>& format);
+	bool Init();
+	/* the frame at the offset, or the first one found after it */
+	bool NextFrame(off64_t* offset, Mp3FrameHeader* header);
+	off64_t Resync(off64_t offset);
+	bool ReadHeader(off64_t offset, Mp3FrameHeader* header);
+	void SeekTo(int64_t timeUs);
+	/* scans the headers until the table holds the frame or the stream ends */
+	void ExtendIndex(uint32_t frame);
+	int64_t FrameTimeUs(uint32_t frame) const;
+
+	const android::sp<android::DataSource> source_;
+	const android::sp<android::MetaData> format_;
+	android::MediaBufferGroup group_;
+	bool started_ = false;
+	int sample_rate_ = 0;
+	int samples_per_frame_ = 0;
+	off64_t first_frame_ = 0;
+	Mp3VbrInfo vbr_;
+	std::vector<uint8_t> scratch_;
+
+	/* the offset of each frame from the first on, by frame number */
+	std::vector<uint32_t> offsets_;
+	/* the offset following the last frame of the table */
+	off64_t index_end_ = 0;
+	/* the frame read next */
+	uint32_t next_frame_ = 0;
+	off64_t next_offset_ = 0;
+	/* false after a jump through the table of contents, the frames read
+	   are then not contiguous with the table */
+	bool indexed_ = true;
+};
+
+#endif
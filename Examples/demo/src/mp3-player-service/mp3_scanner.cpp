@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mp3_scanner.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace {
+
+/* how far past the tags the first frame is looked for */
+const uint64_t kMaxJunkBytes = 64 * 1024;
+/* the frames averaged for a stream without a VBR header */
+const int kSampleFrames = 32;
+const size_t kId3v1Bytes = 128;
+
+uint32_t ReadBE32(const uint8_t* p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+uint32_t ReadSyncsafe(const uint8_t* p)
+{
+	return (uint32_t)(p[0] & 0x7f) << 21 | (p[1] & 0x7f) << 14 | (p[2] & 0x7f) << 7 |
+	       (p[3] & 0x7f);
+}
+
+/* a NUL terminated UTF-8 string in a fixed buffer, truncated at a
+   character boundary */
+class TextWriter {
+public:
+	TextWriter(char* out, size_t size) : out_(out), size_(size) { out_[0] = '\0'; }
+	bool Append(uint32_t c) {
+		char bytes[4];
+		size_t n;
+		if (c < 0x80) {
+			bytes[0] = c;
+			n = 1;
+		} else if (c < 0x800) {
+			bytes[0] = 0xc0 | c >> 6;
+			bytes[1] = 0x80 | (c & 0x3f);
+			n = 2;
+		} else if (c < 0x10000) {
+			bytes[0] = 0xe0 | c >> 12;
+			bytes[1] = 0x80 | (c >> 6 & 0x3f);
+			bytes[2] = 0x80 | (c & 0x3f);
+			n = 3;
+		} else {
+			bytes[0] = 0xf0 | c >> 18;
+			bytes[1] = 0x80 | (c >> 12 & 0x3f);
+			bytes[2] = 0x80 | (c >> 6 & 0x3f);
+			bytes[3] = 0x80 | (c & 0x3f);
+			n = 4;
+		}
+		if (length_ + n >= size_)
+			return false;
+		memcpy(out_ + length_, bytes, n);
+		length_ += n;
+		out_[length_] = '\0';
+		return true;
+	}
+	/* ID3v1 pads with spaces */
+	void TrimTrailingSpaces() {
+		while (length_ > 0 && out_[length_ - 1] == ' ')
+			out_[--length_] = '\0';
+	}
+private:
+	char* const out_;
+	const size_t size_;
+	size_t length_ = 0;
+};
+
+void DecodeLatin1(const uint8_t* p, size_t n, TextWriter* out)
+{
+	for (size_t i = 0; i < n && p[i] != 0 && out->Append(p[i]); i++)
+		;
+}
+
+void DecodeUtf8(const uint8_t* p, size_t n, TextWriter* out)
+{
+	size_t i = 0;
+	while (i < n && p[i] != 0) {
+		/* the length of the sequence, a stray byte is taken as Latin-1 */
+		size_t length = p[i] < 0x80 ? 1 : (p[i] & 0xe0) == 0xc0 ? 2 :
+		                (p[i] & 0xf0) == 0xe0 ? 3 : (p[i] & 0xf8) == 0xf0 ? 4 : 0;
+		uint32_t c = length == 1 ? p[i] : p[i] & (0x7f >> length);
+		for (size_t k = 1; k < length; k++) {
+			if (i + k >= n || (p[i + k] & 0xc0) != 0x80) {
+				length = 0;
+				break;
+			}
+			c = c << 6 | (p[i + k] & 0x3f);
+		}
+		if (length == 0) {
+			c = p[i];
+			length = 1;
+		}
+		if (!out->Append(c))
+			return;
+		i += length;
+	}
+}
+
+void DecodeUtf16(const uint8_t* p, size_t n, bool bigEndian, TextWriter* out)
+{
+	for (size_t i = 0; i + 1 < n; i += 2) {
+		uint32_t c = bigEndian ? (p[i] << 8 | p[i + 1]) : (p[i + 1] << 8 | p[i]);
+		if (c == 0)
+			return;
+		if (c >= 0xd800 && c < 0xdc00 && i + 3 < n) {
+			uint32_t low = bigEndian ? (p[i + 2] << 8 | p[i + 3]) : (p[i + 3] << 8 | p[i + 2]);
+			if (low >= 0xdc00 && low < 0xe000) {
+				c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+				i += 2;
+			}
+		}
+		if (!out->Append(c))
+			return;
+	}
+}
+
+/* the contents of an ID3v2 text frame: the encoding byte and the text */
+void DecodeId3Text(const uint8_t* p, size_t n, char* out, size_t size)
+{
+	TextWriter writer(out, size);
+	if (n < 1)
+		return;
+	uint8_t encoding = p[0];
+	p++;
+	n--;
+	switch (encoding) {
+	case 0:
+		DecodeLatin1(p, n, &writer);
+		break;
+	case 1:
+		/* UTF-16 with a byte order mark */
+		if (n >= 2 && (p[0] == 0xfe || p[0] == 0xff))
+			DecodeUtf16(p + 2, n - 2, p[0] == 0xfe, &writer);
+		break;
+	case 2:
+		DecodeUtf16(p, n, true, &writer);
+		break;
+	case 3:
+		DecodeUtf8(p, n, &writer);
+		break;
+	}
+}
+
+}  // namespace
+
+bool Mp3Scanner::Scan(const char* path, Mp3ScanResult* result)
+{
+	int fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC));
+	if (fd < 0)
+		return false;
+	bool ok = Scan(fd, result);
+	close(fd);
+	return ok;
+}
+
+bool Mp3Scanner::Scan(int fd, Mp3ScanResult* result)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		return false;
+	fd_ = fd;
+	file_size_ = st.st_size;
+	window_offset_ = 0;
+	window_size_ = 0;
+	/* only the head and the tail are read, read-ahead would be wasted */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+	result->durationMs = 0;
+	result->bitrate = 0;
+	result->sampleRate = 0;
+	result->channels = 0;
+	result->title[0] = '\0';
+	result->artist[0] = '\0';
+
+	uint64_t offset = ReadId3v2(0, result);
+	Mp3FrameHeader header;
+	if (!FindFirstFrame(&offset, &header))
+		return false;
+	result->sampleRate = header.sampleRate;
+	result->channels = header.channels;
+
+	/* before the window moves to the tail */
+	const uint8_t* frame;
+	vbr_.frames = 0;
+	vbr_.bytes = 0;
+	bool hasVbrHeader = Read(offset, header.frameBytes, &frame) == header.frameBytes &&
+	                    ParseMp3VbrHeader(frame, header.frameBytes, header, offset, &vbr_) &&
+	                    vbr_.frames > 0;
+	if (hasVbrHeader) {
+		int64_t durationUs =
+			(int64_t)vbr_.frames * header.samplesPerFrame * 1000000 / header.sampleRate;
+		/* the header counts the audio, some encoders leave the size out */
+		uint64_t bytes = vbr_.bytes > 0 ? vbr_.bytes : file_size_ - offset;
+		result->durationMs = durationUs / 1000;
+		if (durationUs > 0)
+			result->bitrate = bytes * 8 * 1000000 / durationUs;
+	} else {
+		result->bitrate = SampleBitrate(offset, header.sampleRate);
+	}
+
+	/* the tail last, the window is at the head until here */
+	bool hasId3v1 = ReadId3v1(result);
+	if (!hasVbrHeader && result->bitrate > 0) {
+		uint64_t end = file_size_ - (hasId3v1 ? kId3v1Bytes : 0);
+		if (end > offset)
+			result->durationMs = (end - offset) * 8000 / result->bitrate;
+	}
+	return true;
+}
+
+size_t Mp3Scanner::Read(uint64_t offset, size_t size, const uint8_t** data)
+{
+	if (offset < window_offset_ || offset + size > window_offset_ + window_size_) {
+		if (offset >= file_size_)
+			return 0;
+		ssize_t n = TEMP_FAILURE_RETRY(pread64(fd_, window_, kWindowBytes, offset));
+		window_offset_ = offset;
+		window_size_ = n > 0 ? n : 0;
+	}
+	*data = window_ + (offset - window_offset_);
+	return std::min<uint64_t>(size, window_offset_ + window_size_ - offset);
+}
+
+uint64_t Mp3Scanner::ReadId3v2(uint64_t offset, Mp3ScanResult* result)
+{
+	const uint8_t* p;
+	/* some files carry more than one tag */
+	while (Read(offset, 10, &p) == 10) {
+		size_t tagBytes = Id3v2TagBytes(p, 10);
+		if (tagBytes == 0)
+			break;
+		int version = p[3];
+		uint8_t flags = p[5];
+		uint64_t frame = offset + 10;
+		uint64_t end = offset + tagBytes - (flags & 0x10 ? 10 : 0);
+		offset += tagBytes;
+		/* an unsynchronised tag before 2.4 would need undoing as a whole,
+		   those are rare enough to go without the title */
+		if (version < 2 || version > 4 || (version < 4 && (flags & 0x80)))
+			continue;
+		if ((flags & 0x40) && version >= 3) {
+			/* the extended header, its size includes itself only in 2.4 */
+			if (Read(frame, 4, &p) != 4)
+				continue;
+			frame += version == 3 ? 4 + ReadBE32(p) : ReadSyncsafe(p);
+		}
+
+		const size_t headerBytes = version == 2 ? 6 : 10;
+		while (frame + headerBytes <= end && (!result->title[0] || !result->artist[0]) &&
+		       Read(frame, headerBytes, &p) == headerBytes && p[0] != 0) {
+			uint32_t size;
+			char* text = nullptr;
+			/* compressed or encrypted frames are left alone */
+			bool plain;
+			if (version == 2) {
+				size = p[3] << 16 | p[4] << 8 | p[5];
+				if (memcmp(p, "TT2", 3) == 0)
+					text = result->title;
+				else if (memcmp(p, "TP1", 3) == 0)
+					text = result->artist;
+				plain = true;
+			} else {
+				size = version == 3 ? ReadBE32(p + 4) : ReadSyncsafe(p + 4);
+				if (memcmp(p, "TIT2", 4) == 0)
+					text = result->title;
+				else if (memcmp(p, "TPE1", 4) == 0)
+					text = result->artist;
+				plain = version == 3 ? !(p[9] & 0xc0) : !(p[9] & 0x0f);
+			}
+			if (text != nullptr && text[0] == '\0' && plain) {
+				/* two bytes per character at most, and the encoding */
+				size_t n = Read(frame + headerBytes,
+				                std::min<size_t>(size, 2 * Mp3ScanResult::kMaxTextBytes + 1), &p);
+				DecodeId3Text(p, n, text, Mp3ScanResult::kMaxTextBytes);
+			}
+			frame += headerBytes + size;
+		}
+	}
+	return offset;
+}
+
+bool Mp3Scanner::ReadId3v1(Mp3ScanResult* result)
+{
+	const uint8_t* tag;
+	if (file_size_ < kId3v1Bytes ||
+	    Read(file_size_ - kId3v1Bytes, kId3v1Bytes, &tag) != kId3v1Bytes ||
+	    memcmp(tag, "TAG", 3) != 0)
+		return false;
+	/* 30 bytes each of Latin-1, padded with NULs or spaces */
+	if (!result->title[0]) {
+		TextWriter writer(result->title, Mp3ScanResult::kMaxTextBytes);
+		DecodeLatin1(tag + 3, 30, &writer);
+		writer.TrimTrailingSpaces();
+	}
+	if (!result->artist[0]) {
+		TextWriter writer(result->artist, Mp3ScanResult::kMaxTextBytes);
+		DecodeLatin1(tag + 33, 30, &writer);
+		writer.TrimTrailingSpaces();
+	}
+	return true;
+}
+
+bool Mp3Scanner::FindFirstFrame(uint64_t* offset, Mp3FrameHeader* header)
+{
+	const uint64_t limit = std::min(file_size_, *offset + kMaxJunkBytes);
+	uint64_t at = *offset;
+	while (at + 4 <= limit) {
+		const uint8_t* p;
+		size_t n = Read(at, kWindowBytes, &p);
+		if (n < 4)
+			return false;
+		for (size_t i = 0; i + 4 <= n; i++) {
+			const uint8_t* sync = static_cast<const uint8_t*>(memchr(p + i, 0xff, n - 3 - i));
+			if (sync == nullptr)
+				break;
+			i = sync - p;
+			if (!ParseMp3FrameHeader(sync, header))
+				continue;
+			const uint8_t* q;
+			Mp3FrameHeader next;
+			uint64_t candidate = at + i;
+			if (Read(candidate + header->frameBytes, 4, &q) == 4 && ParseMp3FrameHeader(q, &next) &&
+			    next.sampleRate == header->sampleRate) {
+				*offset = candidate;
+				return true;
+			}
+			/* the confirmation may have moved the window */
+			n = Read(at, kWindowBytes, &p);
+		}
+		at += n - 3;
+	}
+	return false;
+}
+
+int32_t Mp3Scanner::SampleBitrate(uint64_t offset, int32_t sampleRate)
+{
+	Mp3FrameHeader first = {}, header;
+	uint64_t bytes = 0;
+	int frames = 0;
+	bool constant = true;
+	const uint8_t* p;
+	while (frames < kSampleFrames && Read(offset, 4, &p) == 4 &&
+	       ParseMp3FrameHeader(p, &header) && header.sampleRate == sampleRate) {
+		if (frames == 0)
+			first = header;
+		constant = constant && header.bitrate == first.bitrate;
+		bytes += header.frameBytes;
+		offset += header.frameBytes;
+		frames++;
+	}
+	if (frames == 0)
+		return 0;
+	if (constant)
+		return first.bitrate;
+	/* the byte rate of the frames seen, as good a guess as any without a
+	   VBR header */
+	return bytes * 8 * first.sampleRate / ((uint64_t)frames * first.samplesPerFrame);
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_MP3_SCANNER_H_
+#define MP3_PLAYER_MP3_SCANNER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <base/macros.h>
+
+#include "mp3_frame_header.h"
+
+/* What a scan finds out about an MP3 file */
+struct Mp3ScanResult {
+	static const size_t kMaxTextBytes = 256;
+
+	int32_t durationMs = 0;
+	/* bits per second, the average for VBR */
+	int32_t bitrate = 0;
+	int32_t sampleRate = 0;
+	int32_t channels = 0;
+	/* UTF-8 from the ID3v2 or ID3v1 tag, empty if untagged */
+	char title[kMaxTextBytes];
+	char artist[kMaxTextBytes];
+};
+
+/* Finds the duration, bitrate and tags of MP3 files from their headers
+ * alone, without decoding or building a MediaExtractor.
+ *
+ * The ID3v2 tag is skipped frame header by frame header, picking up the
+ * title and artist on the way. The duration comes from the frame count
+ * of a Xing, Info or VBRI header, or else from the size of the stream and
+ * the bitrate of its first frames. A file costs a few reads of a fixed
+ * window and nothing is allocated, so one scanner is meant to be reused
+ * across a whole library. Not thread safe. */
+class Mp3Scanner final {
+public:
+	Mp3Scanner() = default;
+
+	/* false if no MPEG audio stream was found */
+	bool Scan(const char* path, Mp3ScanResult* result);
+	bool Scan(int fd, Mp3ScanResult* result);
+
+private:
+	static const size_t kWindowBytes = 16 * 1024;
+
+	/* the bytes at offset, read through the window; returns how many of
+	   them are available, at most kWindowBytes */
+	size_t Read(uint64_t offset, size_t size, const uint8_t** data);
+	/* the end of the ID3v2 tags at the start of the file */
+	uint64_t ReadId3v2(uint64_t offset, Mp3ScanResult* result);
+	/* takes what the ID3v2 tag left out from an ID3v1 tag, returns
+	   whether the file ends with one */
+	bool ReadId3v1(Mp3ScanResult* result);
+	/* the first frame header at or after offset that is followed by
+	   another one where it points to */
+	bool FindFirstFrame(uint64_t* offset, Mp3FrameHeader* header);
+	/* the average bitrate of the frames from offset on */
+	int32_t SampleBitrate(uint64_t offset, int32_t sampleRate);
+
+	int fd_ = -1;
+	uint64_t file_size_ = 0;
+	uint8_t window_[kWindowBytes];
+	uint64_t window_offset_ = 0;
+	size_t window_size_ = 0;
+	Mp3VbrInfo vbr_;
+
+	DISALLOW_COPY_AND_ASSIGN(Mp3Scanner);
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_PCM_RING_BUFFER_H_
+#define MP3_PLAYER_PCM_RING_BUFFER_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include <base/macros.h>
+
+/* Lock free byte ring for one producer thread and one consumer thread.
+ *
+ * The positions count the bytes ever written and read, so they never wrap
+ * in practice and full and empty are told apart without a spare slot. The
+ * producer publishes its data with a release store of the write position,
+ * the consumer frees space with a release store of the read position. */
+class PcmRingBuffer final {
+public:
+	explicit PcmRingBuffer(size_t capacity)
+		: data_(new uint8_t[capacity]), capacity_(capacity) {}
+
+	size_t capacity() const { return capacity_; }
+
+	/* consumer side */
+	size_t readable() const {
+		return write_.load(std::memory_order_acquire) - read_.load(std::memory_order_relaxed);
+	}
+	uint64_t read_position() const { return read_.load(std::memory_order_relaxed); }
+	size_t Read(uint8_t* data, size_t size) {
+		uint64_t read = read_.load(std::memory_order_relaxed);
+		size = std::min(size, readable());
+		Copy(data, read, size);
+		read_.store(read + size, std::memory_order_release);
+		return size;
+	}
+
+	/* producer side */
+	size_t writable() const {
+		return capacity_ - (write_.load(std::memory_order_relaxed) -
+		                    read_.load(std::memory_order_acquire));
+	}
+	uint64_t write_position() const { return write_.load(std::memory_order_relaxed); }
+	size_t Write(const uint8_t* data, size_t size) {
+		uint64_t write = write_.load(std::memory_order_relaxed);
+		size = std::min(size, writable());
+		size_t offset = write % capacity_;
+		size_t first = std::min(size, capacity_ - offset);
+		memcpy(data_.get() + offset, data, first);
+		memcpy(data_.get(), data + first, size - first);
+		write_.store(write + size, std::memory_order_release);
+		return size;
+	}
+
+	/* empties the ring, only while neither side is using it */
+	void Reset() {
+		read_.store(0, std::memory_order_relaxed);
+		write_.store(0, std::memory_order_release);
+	}
+
+private:
+	void Copy(uint8_t* data, uint64_t position, size_t size) const {
+		size_t offset = position % capacity_;
+		size_t first = std::min(size, capacity_ - offset);
+		memcpy(data, data_.get() + offset, first);
+		memcpy(data + first, data_.get(), size - first);
+	}
+
+	const std::unique_ptr<uint8_t[]> data_;
+	const size_t capacity_;
+	std::atomic<uint64_t> write_{0};
+	std::atomic<uint64_t> read_{0};
+
+	DISALLOW_COPY_AND_ASSIGN(PcmRingBuffer);
+};
+
+/* Lock free queue of up to kSize values for one producer thread and one
+ * consumer thread. */
+template <typename T, size_t kSize>
+class SpscQueue final {
+	/* the positions wrap around at 2^32 */
+	static_assert((kSize & (kSize - 1)) == 0, "kSize must be a power of two");
+public:
+	SpscQueue() = default;
+
+	/* producer side, false if the queue is full */
+	bool Push(const T& value) {
+		uint32_t tail = tail_.load(std::memory_order_relaxed);
+		if (tail - head_.load(std::memory_order_acquire) == kSize)
+			return false;
+		values_[tail % kSize] = value;
+		tail_.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* consumer side, the oldest value without removing it */
+	bool Peek(T* value) const {
+		uint32_t head = head_.load(std::memory_order_relaxed);
+		if (head == tail_.load(std::memory_order_acquire))
+			return false;
+		*value = values_[head % kSize];
+		return true;
+	}
+	void Pop() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+	/* empties the queue, only while neither side is using it */
+	void Reset() {
+		head_.store(0, std::memory_order_relaxed);
+		tail_.store(0, std::memory_order_release);
+	}
+
+private:
+	T values_[kSize];
+	std::atomic<uint32_t> tail_{0};
+	std::atomic<uint32_t> head_{0};
+
+	DISALLOW_COPY_AND_ASSIGN(SpscQueue);
+};
+
+#endif
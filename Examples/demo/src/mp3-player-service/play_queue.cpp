@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "play_queue.h"
+
+#include <algorithm>
+
+const size_t PlayQueue::kMaxHistory;
+const uint32_t PlayQueue::kNotInDeck;
+
+PlayQueue::PlayQueue(const TrackTable* tracks)
+	: tracks_(tracks), random_(std::random_device()())
+{
+}
+
+void PlayQueue::SetCurrent(TrackId id)
+{
+	if (id == current_)
+		return;
+	PushHistory(current_);
+	forward_.clear();
+	upcoming_ = TrackTable::kNoTrack;
+	current_ = id;
+	MarkDrawn(id);
+}
+
+void PlayQueue::SetShuffle(bool shuffle)
+{
+	shuffle_ = shuffle;
+	upcoming_ = TrackTable::kNoTrack;
+	forward_.clear();
+	drawn_ = 0;
+	MarkDrawn(current_);
+}
+
+PlayQueue::TrackId PlayQueue::Peek()
+{
+	if (!forward_.empty())
+		return forward_.back();
+	if (upcoming_ == TrackTable::kNoTrack)
+		upcoming_ = shuffle_ ? Draw() : Following();
+	return upcoming_;
+}
+
+PlayQueue::TrackId PlayQueue::Next()
+{
+	TrackId id = Peek();
+	if (!forward_.empty())
+		forward_.pop_back();
+	upcoming_ = TrackTable::kNoTrack;
+	if (id == TrackTable::kNoTrack)
+		return current_;
+	PushHistory(current_);
+	current_ = id;
+	MarkDrawn(id);
+	return id;
+}
+
+PlayQueue::TrackId PlayQueue::Previous()
+{
+	TrackId id;
+	if (!history_.empty()) {
+		id = history_.back();
+		history_.pop_back();
+	} else if (!shuffle_) {
+		id = Preceding();
+	} else {
+		/* a shuffle has nothing before its first track */
+		return current_;
+	}
+	if (id == TrackTable::kNoTrack)
+		return current_;
+	if (current_ != TrackTable::kNoTrack)
+		forward_.push_back(current_);
+	upcoming_ = TrackTable::kNoTrack;
+	current_ = id;
+	return id;
+}
+
+void PlayQueue::OnAdded(TrackId id)
+{
+	if (id >= deck_positions_.size())
+		deck_positions_.resize(id + 1, kNotInDeck);
+	deck_positions_[id] = deck_.size();
+	deck_.push_back(id);
+	/* it may come right after the current track */
+	if (!shuffle_)
+		upcoming_ = TrackTable::kNoTrack;
+}
+
+void PlayQueue::OnRemoved(TrackId id)
+{
+	if (id == current_) {
+		/* the only track has nothing to go on to */
+		if (Next() == id)
+			current_ = TrackTable::kNoTrack;
+	}
+	if (upcoming_ == id || !shuffle_)
+		upcoming_ = TrackTable::kNoTrack;
+	/* the id may be reused for another track */
+	history_.erase(std::remove(history_.begin(), history_.end(), id), history_.end());
+	forward_.erase(std::remove(forward_.begin(), forward_.end(), id), forward_.end());
+
+	if (id >= deck_positions_.size() || deck_positions_[id] == kNotInDeck)
+		return;
+	size_t position = deck_positions_[id];
+	/* out of the drawn part first, then out of the deck */
+	if (position < drawn_) {
+		SwapInDeck(position, drawn_ - 1);
+		position = --drawn_;
+	}
+	SwapInDeck(position, deck_.size() - 1);
+	deck_.pop_back();
+	deck_positions_[id] = kNotInDeck;
+}
+
+size_t PlayQueue::MemoryBytes() const
+{
+	return (deck_.capacity() + deck_positions_.capacity() + history_.size() +
+	        forward_.capacity()) * sizeof(TrackId);
+}
+
+PlayQueue::TrackId PlayQueue::Following() const
+{
+	if (tracks_->empty())
+		return TrackTable::kNoTrack;
+	if (!tracks_->Contains(current_))
+		return tracks_->At(0);
+	return tracks_->At((tracks_->PositionOf(current_) + 1) % tracks_->size());
+}
+
+PlayQueue::TrackId PlayQueue::Preceding() const
+{
+	if (tracks_->empty())
+		return TrackTable::kNoTrack;
+	if (!tracks_->Contains(current_))
+		return tracks_->At(0);
+	size_t size = tracks_->size();
+	return tracks_->At((tracks_->PositionOf(current_) + size - 1) % size);
+}
+
+/* picks one of the tracks not played in this round, it counts as played
+   once Next() goes to it */
+PlayQueue::TrackId PlayQueue::Draw()
+{
+	size_t size = deck_.size();
+	if (size == 0)
+		return TrackTable::kNoTrack;
+	if (size == 1)
+		return deck_[0];
+	if (drawn_ >= size) {
+		/* a new round, without the current track at its start */
+		drawn_ = 0;
+		MarkDrawn(current_);
+	}
+	std::uniform_int_distribution<size_t> pick(drawn_, size - 1);
+	SwapInDeck(drawn_, pick(random_));
+	return deck_[drawn_];
+}
+
+void PlayQueue::MarkDrawn(TrackId id)
+{
+	if (id >= deck_positions_.size() || deck_positions_[id] == kNotInDeck ||
+	    deck_positions_[id] < drawn_)
+		return;
+	SwapInDeck(deck_positions_[id], drawn_);
+	drawn_++;
+}
+
+void PlayQueue::SwapInDeck(size_t a, size_t b)
+{
+	std::swap(deck_[a], deck_[b]);
+	deck_positions_[deck_[a]] = a;
+	deck_positions_[deck_[b]] = b;
+}
+
+void PlayQueue::PushHistory(TrackId id)
+{
+	if (id == TrackTable::kNoTrack)
+		return;
+	history_.push_back(id);
+	if (history_.size() > kMaxHistory)
+		history_.pop_front();
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_PLAY_QUEUE_H_
+#define MP3_PLAYER_PLAY_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <random>
+#include <vector>
+
+#include <base/macros.h>
+
+#include "track_table.h"
+
+/* The order the tracks of a TrackTable play in.
+ *
+ * In order, the track after the current one is the next in the table.
+ * Shuffled, it is drawn from the tracks not played yet in this round with
+ * one step of a Fisher-Yates shuffle, so every track plays once per round
+ * and no step, toggling the shuffle included, costs more than O(1) at any
+ * library size. The deck of the shuffle holds all the ids and is kept up
+ * to date as the table changes.
+ *
+ * The tracks played are kept in a history: Previous() goes back through
+ * it, and Next() then goes forward again the same way. */
+class PlayQueue final {
+public:
+	using TrackId = TrackTable::TrackId;
+
+	explicit PlayQueue(const TrackTable* tracks);
+
+	/* kNoTrack while the table is empty */
+	TrackId current() const { return current_; }
+	/* goes to the track, the current one goes to the history */
+	void SetCurrent(TrackId id);
+	bool shuffle() const { return shuffle_; }
+	/* starts a new round of the shuffle */
+	void SetShuffle(bool shuffle);
+
+	/* the track Next() goes to; decided at the first call, so that it can
+	   be prepared ahead */
+	TrackId Peek();
+	TrackId Next();
+	TrackId Previous();
+
+	/* to be called after a track is added to the table */
+	void OnAdded(TrackId id);
+	/* to be called before a track is removed from the table; when it is
+	   the current one, the queue goes on to the next */
+	void OnRemoved(TrackId id);
+
+	/* the heap memory of the queue */
+	size_t MemoryBytes() const;
+
+private:
+	static const size_t kMaxHistory = 1000;
+	static const uint32_t kNotInDeck = UINT32_MAX;
+
+	/* the track after the current one in the table */
+	TrackId Following() const;
+	/* the track before the current one in the table */
+	TrackId Preceding() const;
+	TrackId Draw();
+	/* takes the track out of the tracks to be drawn in this round */
+	void MarkDrawn(TrackId id);
+	void SwapInDeck(size_t a, size_t b);
+	void PushHistory(TrackId id);
+
+	const TrackTable* const tracks_;
+	TrackId current_ = TrackTable::kNoTrack;
+	/* what Peek() decided */
+	TrackId upcoming_ = TrackTable::kNoTrack;
+	bool shuffle_ = false;
+	/* every track of the table, those before drawn_ were played this round */
+	std::vector<TrackId> deck_;
+	/* the position of each id in the deck */
+	std::vector<uint32_t> deck_positions_;
+	size_t drawn_ = 0;
+	/* the tracks played before the current one, the latest at the back */
+	std::deque<TrackId> history_;
+	/* the tracks Previous() went back over, the nearest at the back */
+	std::vector<TrackId> forward_;
+	std::minstd_rand random_;
+
+	DISALLOW_COPY_AND_ASSIGN(PlayQueue);
+};
+
+#endif
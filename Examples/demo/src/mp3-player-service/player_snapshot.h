@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_SERVICE_PLAYER_SNAPSHOT_H_
+#define MP3_PLAYER_SERVICE_PLAYER_SNAPSHOT_H_
+
+#include <binder/Parcel.h>
+#include <binder/Parcelable.h>
+#include <utils/String16.h>
+
+namespace brillo {
+namespace demo {
+
+/* Everything a client needs to render the player, fetched in one transaction */
+class PlayerSnapshot : public ::android::Parcelable {
+public:
+	enum State {
+		WARMING,
+		IDLE,
+		PLAYING,
+		PAUSED,
+	};
+
+	PlayerSnapshot() = default;
+
+	::android::status_t writeToParcel(::android::Parcel* parcel) const override;
+	::android::status_t readFromParcel(const ::android::Parcel* parcel) override;
+
+	/* the state name used by the _mediaplayer trait */
+	const char* StateName() const;
+
+	int32_t state = IDLE;
+	int32_t trackId = -1;
+	::android::String16 trackName;
+	float volume = 0.0f;
+	bool muted = false;
+	int32_t positionMs = 0;
+	int32_t durationMs = 0;
+	int32_t crossfadeMs = 0;
+	bool shuffle = false;
+};
+
+}  // namespace demo
+}  // namespace brillo
+
+#endif
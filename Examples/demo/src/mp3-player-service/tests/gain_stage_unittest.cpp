@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "gain_stage.h"
+
+namespace {
+
+/* the per sample arithmetic of the kernels, which the SSE2 paths must
+   match: the gain of frame i is gain + i * step, rounded to the nearest
+   and saturated to 16 bits */
+int16_t Scaled(float sample, float gain)
+{
+	long v = lrintf(sample * gain);
+	return std::min<long>(std::max<long>(v, INT16_MIN), INT16_MAX);
+}
+
+std::vector<int16_t> Noise(size_t count, uint32_t seed)
+{
+	std::vector<int16_t> samples(count);
+	for (auto& sample : samples) {
+		seed = seed * 1103515245 + 12345;
+		sample = seed >> 16;
+	}
+	/* the extremes, where the saturation shows */
+	if (count >= 4) {
+		samples[0] = INT16_MAX;
+		samples[1] = INT16_MIN;
+		samples[count - 2] = INT16_MIN;
+		samples[count - 1] = INT16_MAX;
+	}
+	return samples;
+}
+
+/* the vector paths add up the gain as they go, and may differ from the
+   product by a rounding step */
+void ExpectNear(const std::vector<int16_t>& expected, const std::vector<int16_t>& actual)
+{
+	ASSERT_EQ(expected.size(), actual.size());
+	for (size_t i = 0; i < expected.size(); i++)
+		ASSERT_LE(abs(expected[i] - actual[i]), 1) << "sample " << i;
+}
+
+}  // namespace
+
+TEST(GainStageTest, ApplyGainSaturates)
+{
+	std::vector<int16_t> samples = {INT16_MAX, INT16_MIN, 20000, -20000,
+	                                16384, -16384, 1, -1, 0, 100};
+	ApplyGain(samples.data(), samples.size() / 2, 2, 2.0f, 0.0f);
+	std::vector<int16_t> expected = {INT16_MAX, INT16_MIN, INT16_MAX, INT16_MIN,
+	                                 INT16_MAX, -32768, 2, -2, 0, 200};
+	EXPECT_EQ(expected, samples);
+}
+
+TEST(GainStageTest, ApplyGainMatchesScalar)
+{
+	/* frame counts around the 8 samples of a vector step, and a channel
+	   count the vector paths leave to the scalar loop */
+	for (int channels = 1; channels <= 3; channels++) {
+		for (size_t frames : {1, 3, 4, 7, 8, 9, 255, 960}) {
+			for (float gain : {0.0f, 0.25f, 1.0f, 3.5f}) {
+				for (float step : {0.0f, 1.0f / 960, -1.0f / 960, 0.01f}) {
+					std::vector<int16_t> samples = Noise(frames * channels, frames + channels);
+					std::vector<int16_t> expected(samples);
+					for (size_t i = 0; i < expected.size(); i++)
+						expected[i] = Scaled(expected[i], gain + (i / channels) * step);
+					ApplyGain(samples.data(), frames, channels, gain, step);
+					SCOPED_TRACE(testing::Message() << channels << " channels, " << frames <<
+					             " frames, gain " << gain << ", step " << step);
+					ExpectNear(expected, samples);
+				}
+			}
+		}
+	}
+}
+
+TEST(GainStageTest, ApplyGainFloatMatchesScalar)
+{
+	for (int channels = 1; channels <= 3; channels++) {
+		for (size_t frames : {1, 5, 8, 961}) {
+			std::vector<int16_t> noise = Noise(frames * channels, 7);
+			std::vector<float> samples(noise.begin(), noise.end());
+			std::vector<float> expected(samples);
+			float step = -1.0f / 960;
+			for (size_t i = 0; i < expected.size(); i++)
+				expected[i] *= 1.0f + (i / channels) * step;
+			ApplyGain(samples.data(), frames, channels, 1.0f, step);
+			/* within half a 16 bit step */
+			for (size_t i = 0; i < expected.size(); i++)
+				ASSERT_NEAR(expected[i], samples[i], 0.5f) << "sample " << i;
+		}
+	}
+}
+
+TEST(GainStageTest, MixWithGainMatchesScalar)
+{
+	for (int channels = 1; channels <= 3; channels++) {
+		for (size_t frames : {1, 7, 8, 9, 960}) {
+			/* a linear crossfade and a sum that overflows */
+			for (float srcGain : {0.0f, 1.0f}) {
+				std::vector<int16_t> dst = Noise(frames * channels, 3);
+				std::vector<int16_t> src = Noise(frames * channels, 4);
+				float step = 1.0f / frames;
+				float dstGain = 1.0f, dstStep = srcGain == 0.0f ? -step : 0.0f;
+				float srcStep = srcGain == 0.0f ? step : 0.0f;
+				std::vector<int16_t> expected(dst);
+				for (size_t i = 0; i < expected.size(); i++) {
+					size_t frame = i / channels;
+					expected[i] = Scaled(1.0f, dst[i] * (dstGain + frame * dstStep) +
+					                     src[i] * (srcGain + frame * srcStep));
+				}
+				MixWithGain(dst.data(), src.data(), frames, channels,
+				            dstGain, dstStep, srcGain, srcStep);
+				SCOPED_TRACE(testing::Message() << channels << " channels, " << frames <<
+				             " frames, source gain " << srcGain);
+				ExpectNear(expected, dst);
+			}
+		}
+	}
+}
+
+TEST(GainStageTest, UnityGainLeavesSamples)
+{
+	GainStage stage;
+	std::vector<int16_t> samples = Noise(960, 1);
+	std::vector<int16_t> expected(samples);
+	stage.Process(samples.data(), 480, 2, 48000);
+	EXPECT_EQ(expected, samples);
+}
+
+TEST(GainStageTest, RampsToTheNewGain)
+{
+	/* 20 ms at 48 kHz */
+	const size_t kRampFrames = 960;
+	GainStage stage;
+	stage.SetGain(0.0f);
+	std::vector<int16_t> samples(2 * (kRampFrames + 100), 10000);
+	stage.Process(samples.data(), kRampFrames + 100, 2, 48000);
+
+	/* down from the first frame, both channels alike, without a jump */
+	EXPECT_LT(samples[0], 10000);
+	EXPECT_GT(samples[0], 9980);
+	for (size_t frame = 1; frame < kRampFrames; frame++) {
+		ASSERT_EQ(samples[2 * frame], samples[2 * frame + 1]);
+		ASSERT_LE(samples[2 * frame], samples[2 * frame - 2]);
+		ASSERT_GE(samples[2 * frame], samples[2 * frame - 2] - 12);
+	}
+	EXPECT_EQ(0, samples[2 * kRampFrames - 2]);
+	for (size_t i = 2 * kRampFrames; i < samples.size(); i++)
+		ASSERT_EQ(0, samples[i]);
+}
+
+TEST(GainStageTest, RampAcrossPeriodsMatchesOnePeriod)
+{
+	GainStage whole, split;
+	whole.SetGain(0.5f);
+	split.SetGain(0.5f);
+	std::vector<int16_t> expected = Noise(2 * 1200, 9);
+	std::vector<int16_t> samples(expected);
+	whole.Process(expected.data(), 1200, 2, 48000);
+	for (size_t frame = 0; frame < 1200; frame += 100)
+		split.Process(samples.data() + 2 * frame, 100, 2, 48000);
+	ExpectNear(expected, samples);
+}
+
+TEST(GainStageTest, NewTargetRampsFromTheCurrentGain)
+{
+	GainStage stage;
+	stage.SetGain(0.0f);
+	std::vector<int16_t> samples(2 * 480, 10000);
+	/* half way down */
+	stage.Process(samples.data(), 480, 2, 48000);
+	int16_t reached = samples.back();
+	EXPECT_NEAR(5000, reached, 20);
+
+	stage.SetGain(1.0f);
+	std::fill(samples.begin(), samples.end(), 10000);
+	stage.Process(samples.data(), 480, 2, 48000);
+	EXPECT_GE(samples[0], reached);
+	EXPECT_LE(samples[0], reached + 20);
+	EXPECT_GT(samples.back(), reached);
+}
+
+TEST(GainStageTest, ResetSkipsTheRamp)
+{
+	GainStage stage;
+	stage.SetGain(0.5f);
+	stage.Reset();
+	std::vector<int16_t> samples(2 * 16, 10000);
+	stage.Process(samples.data(), 16, 2, 48000);
+	for (int16_t sample : samples)
+		ASSERT_EQ(5000, sample);
+}
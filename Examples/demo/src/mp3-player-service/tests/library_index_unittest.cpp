@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "library_index.h"
+#include "metrics.h"
+
+namespace {
+
+const int kTracks = 40;
+/* LibraryIndex::kSaveBatch */
+const int kSaveBatch = 32;
+
+uint64_t IndexSaves()
+{
+	return metrics::Registry::Get()->GetCounter("library.indexSaves")->value();
+}
+
+/* A library of empty tracks in a directory of its own */
+class LibraryIndexTest : public testing::Test {
+protected:
+	void SetUp() override {
+		const char* tmp = getenv("TMPDIR");
+		root_ = std::string(tmp ? tmp : "/data/local/tmp") + "/library_index_test.XXXXXX";
+		ASSERT_NE(nullptr, mkdtemp(&root_[0]));
+		root_ += '/';
+		for (int i = 0; i < kTracks; i++) {
+			std::string path = root_ + "track" + std::to_string(100 + i) + ".mp3";
+			int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+			ASSERT_GE(fd, 0);
+			close(fd);
+		}
+		index_file_ = root_ + "index";
+		index_.reset(new LibraryIndex({ root_ }, index_file_, 1));
+		tracks_ = index_->Update(&directories_, nullptr);
+		ASSERT_EQ((size_t)kTracks, tracks_.size());
+	}
+	void TearDown() override {
+		index_.reset();
+		for (const auto& track : tracks_)
+			unlink(track.path.c_str());
+		unlink(index_file_.c_str());
+		rmdir(root_.c_str());
+	}
+
+	void Analyze(int first, int count) {
+		for (int i = first; i < first + count; i++)
+			index_->SetGain(tracks_[i].path, tracks_[i].Stamp(), -300);
+	}
+	/* the analyzed tracks in the index file, as after a restart */
+	int SavedAnalyzed() const {
+		LibraryIndex reloaded({ root_ }, index_file_, 1);
+		std::vector<std::string> directories;
+		int analyzed = 0;
+		for (const auto& track : reloaded.Update(&directories, nullptr))
+			analyzed += track.analyzed;
+		return analyzed;
+	}
+
+	std::string root_;
+	std::string index_file_;
+	std::unique_ptr<LibraryIndex> index_;
+	std::vector<std::string> directories_;
+	std::vector<TrackInfo> tracks_;
+};
+
+}  // namespace
+
+TEST_F(LibraryIndexTest, SavesAnalysisInBatches)
+{
+	uint64_t saves = IndexSaves();
+	Analyze(0, kSaveBatch - 1);
+	EXPECT_EQ(saves, IndexSaves());
+	EXPECT_EQ(0, SavedAnalyzed());
+
+	Analyze(kSaveBatch - 1, 1);
+	EXPECT_EQ(saves + 1, IndexSaves());
+	EXPECT_EQ(kSaveBatch, SavedAnalyzed());
+}
+
+TEST_F(LibraryIndexTest, FlushSavesPartialBatch)
+{
+	Analyze(0, 3);
+	index_->Flush();
+	EXPECT_EQ(3, SavedAnalyzed());
+
+	/* nothing new, no rewrite */
+	uint64_t saves = IndexSaves();
+	index_->Flush();
+	EXPECT_EQ(saves, IndexSaves());
+}
+
+TEST_F(LibraryIndexTest, SavesOnDestruction)
+{
+	Analyze(0, 5);
+	index_.reset();
+	EXPECT_EQ(5, SavedAnalyzed());
+}
+
+TEST_F(LibraryIndexTest, UpdateKeepsUnsavedAnalysis)
+{
+	Analyze(0, 5);
+	int analyzed = 0;
+	for (const auto& track : index_->Update(&directories_, nullptr))
+		analyzed += track.analyzed;
+	EXPECT_EQ(5, analyzed);
+	EXPECT_EQ(5, SavedAnalyzed());
+}
+
+TEST_F(LibraryIndexTest, IgnoresChangedTrack)
+{
+	index_->SetGain(tracks_[0].path, tracks_[0].Stamp() + 1, -300);
+	index_->Flush();
+	EXPECT_EQ(0, SavedAnalyzed());
+}
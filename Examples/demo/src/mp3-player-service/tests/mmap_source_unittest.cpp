@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "metrics.h"
+#include "mmap_source.h"
+
+using android::DataSource;
+using android::sp;
+
+namespace {
+
+const size_t kFileBytes = 1024 * 1024;
+
+uint64_t Faults()
+{
+	return metrics::Registry::Get()->GetCounter("mmap.sigbus")->value();
+}
+
+/* A file of kFileBytes, byte i holding i % 251 */
+class MmapSourceTest : public testing::Test {
+protected:
+	void SetUp() override {
+		const char* tmp = getenv("TMPDIR");
+		path_ = std::string(tmp ? tmp : "/data/local/tmp") + "/mmap_source_test.XXXXXX";
+		int fd = mkstemp(&path_[0]);
+		ASSERT_GE(fd, 0);
+		std::vector<uint8_t> data(kFileBytes);
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = i % 251;
+		ASSERT_EQ((ssize_t)data.size(), write(fd, data.data(), data.size()));
+		close(fd);
+	}
+	void TearDown() override { unlink(path_.c_str()); }
+
+	std::string path_;
+};
+
+}  // namespace
+
+TEST_F(MmapSourceTest, ReadsTheFile)
+{
+	sp<DataSource> source = MmapSource::Open(path_);
+	off64_t size;
+	ASSERT_EQ(android::OK, source->getSize(&size));
+	EXPECT_EQ((off64_t)kFileBytes, size);
+	EXPECT_EQ((uint32_t)DataSource::kIsLocalFileSource, source->flags());
+
+	uint8_t data[4096];
+	for (off64_t offset = 0; offset < (off64_t)kFileBytes; offset += 100000) {
+		ASSERT_EQ((ssize_t)sizeof(data), source->readAt(offset, data, sizeof(data)));
+		EXPECT_EQ(offset % 251, data[0]);
+	}
+	/* short at the end, nothing past it */
+	EXPECT_EQ(10, source->readAt(kFileBytes - 10, data, sizeof(data)));
+	EXPECT_EQ(0, source->readAt(kFileBytes, data, sizeof(data)));
+}
+
+TEST_F(MmapSourceTest, TruncatedWithinTheReadaheadWindow)
+{
+	sp<DataSource> source = MmapSource::Open(path_);
+	uint8_t data[4096];
+	ASSERT_EQ((ssize_t)sizeof(data), source->readAt(0, data, sizeof(data)));
+
+	/* rewritten shorter, the next read is within the window checked before */
+	ASSERT_EQ(0, truncate(path_.c_str(), 8192));
+	uint64_t faults = Faults();
+	EXPECT_EQ(0, source->readAt(16384, data, sizeof(data)));
+	EXPECT_EQ(faults + 1, Faults());
+	/* from then on through pread() */
+	ASSERT_EQ((ssize_t)sizeof(data), source->readAt(4096, data, sizeof(data)));
+	EXPECT_EQ(4096 % 251, data[0]);
+	EXPECT_EQ(0, source->readAt(kFileBytes / 2, data, sizeof(data)));
+	EXPECT_EQ(faults + 1, Faults());
+}
+
+TEST_F(MmapSourceTest, TruncatedBeforeTheNextWindow)
+{
+	sp<DataSource> source = MmapSource::Open(path_);
+	uint8_t data[4096];
+	ASSERT_EQ((ssize_t)sizeof(data), source->readAt(0, data, sizeof(data)));
+	ASSERT_EQ(0, truncate(path_.c_str(), 0));
+	uint64_t faults = Faults();
+	EXPECT_EQ(0, source->readAt(kFileBytes / 2, data, sizeof(data)));
+	/* found by the size check, without a fault */
+	EXPECT_EQ(faults, Faults());
+}
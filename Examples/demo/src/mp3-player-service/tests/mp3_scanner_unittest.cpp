@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "mp3_scanner.h"
+
+namespace {
+
+/* the files of tests/data, written by tools/make_mp3_corpus.py; installed
+   in data/ next to the test, or found in $MP3_PLAYER_TEST_DATA */
+std::string DataPath(const char* name)
+{
+	const char* dir = getenv("MP3_PLAYER_TEST_DATA");
+	if (dir != nullptr)
+		return std::string(dir) + '/' + name;
+	char exe[PATH_MAX];
+	ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	if (n <= 0)
+		return name;
+	std::string path(exe, n);
+	return path.substr(0, path.rfind('/') + 1) + "data/" + name;
+}
+
+bool Scan(const char* name, Mp3ScanResult* result)
+{
+	Mp3Scanner scanner;
+	return scanner.Scan(DataPath(name).c_str(), result);
+}
+
+}  // namespace
+
+TEST(Mp3ScannerTest, VbrXingHeader)
+{
+	Mp3ScanResult result;
+	ASSERT_TRUE(Scan("vbr_xing.mp3", &result));
+	/* 114 frames of 1152 samples */
+	EXPECT_EQ(2977, result.durationMs);
+	/* the 74512 bytes the header counts over that time */
+	EXPECT_EQ(200169, result.bitrate);
+	EXPECT_EQ(44100, result.sampleRate);
+	EXPECT_EQ(2, result.channels);
+	EXPECT_STREQ("Xing Title", result.title);
+	EXPECT_STREQ("VBR Artist", result.artist);
+}
+
+TEST(Mp3ScannerTest, Id3v2WithPadding)
+{
+	Mp3ScanResult result;
+	ASSERT_TRUE(Scan("id3v2_padding.mp3", &result));
+	EXPECT_STREQ("T\xc3\xadtulo", result.title);
+	EXPECT_STREQ("K\xc3\xbcnstler", result.artist);
+	/* the stream starts past the 20000 bytes of padding */
+	EXPECT_EQ(128000, result.bitrate);
+	EXPECT_EQ(1980, result.durationMs);
+	EXPECT_EQ(44100, result.sampleRate);
+}
+
+TEST(Mp3ScannerTest, TruncatedFrame)
+{
+	Mp3ScanResult result;
+	ASSERT_TRUE(Scan("truncated.mp3", &result));
+	EXPECT_EQ(128000, result.bitrate);
+	/* from the size of the file, the cut included */
+	EXPECT_EQ(1968, result.durationMs);
+	EXPECT_STREQ("", result.title);
+	EXPECT_STREQ("", result.artist);
+}
+
+TEST(Mp3ScannerTest, FreeFormatIsNotSupported)
+{
+	Mp3ScanResult result;
+	EXPECT_FALSE(Scan("free_format.mp3", &result));
+}
+
+TEST(Mp3ScannerTest, MissingFile)
+{
+	Mp3ScanResult result;
+	EXPECT_FALSE(Scan("missing.mp3", &result));
+}
+
+TEST(Mp3ScannerTest, ReusedAcrossFiles)
+{
+	/* nothing of a file carries over to the next through the window */
+	const char* kFiles[] = { "id3v2_padding.mp3", "free_format.mp3", "vbr_xing.mp3",
+	                         "truncated.mp3", "vbr_xing.mp3" };
+	Mp3Scanner scanner;
+	for (const char* name : kFiles) {
+		SCOPED_TRACE(name);
+		Mp3ScanResult reused, fresh;
+		bool ok = scanner.Scan(DataPath(name).c_str(), &reused);
+		ASSERT_EQ(Scan(name, &fresh), ok);
+		if (!ok)
+			continue;
+		EXPECT_EQ(fresh.durationMs, reused.durationMs);
+		EXPECT_EQ(fresh.bitrate, reused.bitrate);
+		EXPECT_STREQ(fresh.title, reused.title);
+		EXPECT_STREQ(fresh.artist, reused.artist);
+	}
+}
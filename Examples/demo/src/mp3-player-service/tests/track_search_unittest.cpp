@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "library_index.h"
+#include "track_search.h"
+#include "track_table.h"
+
+namespace {
+
+class TrackSearchTest : public testing::Test {
+protected:
+	using TrackId = TrackTable::TrackId;
+
+	void SetUp() override {
+		yesterday_ = Put("Yesterday", "The Beatles");
+		yesterday_once_more_ = Put("Yesterday Once More", "Carpenters");
+		let_it_be_ = Put("Let It Be", "The Beatles");
+		hey_jude_ = Put("Hey Jude", "The Beatles");
+		be_my_baby_ = Put("Be My Baby", "The Ronettes");
+		tommy_ = Put("Tommy", "The Who");
+		go_your_own_way_ = Put("Go Your Own Way", "Fleetwood Mac");
+		endless_love_ = Put("Endless Love", "Diana Ross");
+		glove_story_ = Put("Glove Story", "Ann");
+		ego_ = Put("Ego", "Abc");
+		/* untagged, found by its file name */
+		TrackInfo info;
+		info.path = "/music/Go West.mp3";
+		go_west_ = Put(info);
+		search_.Rebuild();
+	}
+
+	TrackId Put(const char* title, const char* artist) {
+		TrackInfo info;
+		info.path = "/music/track_" + std::to_string(count_) + ".mp3";
+		info.title = title;
+		info.artist = artist;
+		return Put(info);
+	}
+	TrackId Put(TrackInfo info) {
+		info.size = 1000 + count_++;
+		bool added;
+		return tracks_.Put(info, &added);
+	}
+
+	TrackTable tracks_;
+	TrackSearch search_{&tracks_};
+	int count_ = 0;
+	TrackId yesterday_, yesterday_once_more_, let_it_be_, hey_jude_, be_my_baby_, tommy_,
+		go_your_own_way_, endless_love_, glove_story_, ego_, go_west_;
+};
+
+}  // namespace
+
+TEST_F(TrackSearchTest, EqualTitleFirst)
+{
+	EXPECT_EQ(yesterday_, search_.Find("yesterday"));
+	EXPECT_EQ(yesterday_, search_.Find("  YESTERDAY! "));
+	EXPECT_EQ(let_it_be_, search_.Find("let it be"));
+}
+
+TEST_F(TrackSearchTest, TitlePrefixThenShortest)
+{
+	EXPECT_EQ(yesterday_once_more_, search_.Find("yesterday once"));
+	/* the file name stands in for the title, and is shorter */
+	EXPECT_EQ(go_west_, search_.Find("go"));
+	EXPECT_EQ(go_your_own_way_, search_.Find("go your"));
+}
+
+TEST_F(TrackSearchTest, WordStartBeforeSubstring)
+{
+	/* "glove story" has the shorter text, but not the word */
+	EXPECT_EQ(endless_love_, search_.Find("love"));
+	EXPECT_EQ(glove_story_, search_.Find("glov"));
+}
+
+TEST_F(TrackSearchTest, ArtistAndShorterText)
+{
+	EXPECT_EQ(endless_love_, search_.Find("diana ross"));
+	/* three tracks of the artist, the shortest text wins */
+	EXPECT_EQ(hey_jude_, search_.Find("beatles"));
+}
+
+TEST_F(TrackSearchTest, WordsApart)
+{
+	EXPECT_EQ(hey_jude_, search_.Find("jude beatles"));
+	EXPECT_EQ(yesterday_once_more_, search_.Find("carpenters more"));
+}
+
+TEST_F(TrackSearchTest, TwoLetterWordMustStartAWord)
+{
+	EXPECT_EQ(be_my_baby_, search_.Find("my"));
+	/* "tommy" has "my" inside a word only */
+	search_.Remove(be_my_baby_);
+	EXPECT_EQ(TrackTable::kNoTrack, search_.Find("my"));
+	/* "ego" ends with "go", the untagged "go west" starts with it */
+	EXPECT_EQ(go_west_, search_.Find("go west"));
+	search_.Remove(go_west_);
+	search_.Remove(go_your_own_way_);
+	EXPECT_EQ(TrackTable::kNoTrack, search_.Find("go"));
+}
+
+TEST_F(TrackSearchTest, FuzzyMatchOfATypo)
+{
+	/* shares yes, est, rda and day, half of the query's trigrams */
+	EXPECT_EQ(yesterday_, search_.Find("yesturday"));
+	EXPECT_EQ(hey_jude_, search_.Find("hey jude beatels"));
+	/* a single trigram in common is not enough */
+	EXPECT_EQ(TrackTable::kNoTrack, search_.Find("zzzday"));
+}
+
+TEST_F(TrackSearchTest, QueriesTooShortOrUnknown)
+{
+	EXPECT_EQ(TrackTable::kNoTrack, search_.Find(""));
+	EXPECT_EQ(TrackTable::kNoTrack, search_.Find("y"));
+	EXPECT_EQ(TrackTable::kNoTrack, search_.Find("!!"));
+	EXPECT_EQ(TrackTable::kNoTrack, search_.Find("qwertzuiop"));
+}
+
+TEST_F(TrackSearchTest, FollowsTheTable)
+{
+	TrackInfo info;
+	info.path = "/music/new.mp3";
+	info.title = "Yesterday";
+	info.artist = "Someone Else";
+	TrackId added = Put(info);
+	search_.Add(added);
+	/* two equal titles, the older id first */
+	EXPECT_EQ(yesterday_, search_.Find("yesterday"));
+	EXPECT_EQ(added, search_.Find("someone"));
+
+	search_.Remove(yesterday_);
+	EXPECT_EQ(added, search_.Find("yesterday"));
+	search_.Remove(added);
+	tracks_.Remove(added);
+	EXPECT_EQ(yesterday_once_more_, search_.Find("yesterday"));
+}
+
+TEST_F(TrackSearchTest, AddedOneByOneAsRebuilt)
+{
+	TrackSearch incremental(&tracks_);
+	for (size_t i = 0; i < tracks_.size(); i++)
+		incremental.Add(tracks_.At(i));
+	for (const char* query : { "yesterday", "go", "love", "beatles", "jude beatles", "my",
+	                           "yesturday", "ross" })
+		EXPECT_EQ(search_.Find(query), incremental.Find(query)) << query;
+}
+
+TEST_F(TrackSearchTest, BetterRankBeyondTheFirstCandidates)
+{
+	/* more tracks than are read for a query, all ranking below the last */
+	for (int i = 0; i < 100; i++) {
+		Put(("Glove " + std::to_string(i)).c_str(), "Knit");
+		Put(("Saturday " + std::to_string(i)).c_str(), "Weekend");
+	}
+	TrackId true_love = Put("True Love", "Someone");
+	TrackId yesturdey = Put("Yesturdey", "Misspelt");
+	search_.Rebuild();
+	search_.Remove(endless_love_);
+	search_.Remove(yesterday_);
+	search_.Remove(yesterday_once_more_);
+
+	/* a word starting with the query, after 100 substrings of "glove" */
+	EXPECT_EQ(true_love, search_.Find("love"));
+	/* every saturday shares 4 trigrams of the typo, the last track 5 */
+	EXPECT_EQ(yesturdey, search_.Find("yesturday"));
+}
+
+TEST_F(TrackSearchTest, SwapTakesOverAnIndexBuiltElsewhere)
+{
+	TrackTable tracks;
+	TrackSearch search(&tracks);
+	tracks.Swap(&tracks_);
+	search.Swap(&search_);
+	EXPECT_TRUE(tracks_.empty());
+	EXPECT_EQ(TrackTable::kNoTrack, search_.Find("yesterday"));
+	EXPECT_EQ(yesterday_, search.Find("yesterday"));
+	EXPECT_EQ(be_my_baby_, search.Find("my"));
+	EXPECT_EQ(yesterday_, search.Find("yesturday"));
+	/* and goes on following its new table */
+	TrackInfo info;
+	info.path = "/music/new.mp3";
+	info.title = "Brand New";
+	bool added;
+	TrackId id = tracks.Put(info, &added);
+	search.Add(id);
+	EXPECT_EQ(id, search.Find("brand new"));
+}
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <functional>
+
+#include <base/bind.h>
+#include <base/bind_helpers.h>
+#include <base/message_loop/message_loop.h>
+#include <base/run_loop.h>
+#include <gtest/gtest.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaData.h>
+
+#include "track_sequencer.h"
+
+using android::MediaBuffer;
+using android::MediaSource;
+using android::MetaData;
+using android::sp;
+using android::status_t;
+
+namespace {
+
+const int kSampleRate = 48000;
+const int kChannels = 2;
+/* 10 ms */
+const size_t kBufferFrames = 480;
+
+int64_t FramesToUs(size_t frames)
+{
+	return (int64_t)frames * 1000000 / kSampleRate;
+}
+
+/* A track of one sample value, in buffers of 10 ms */
+class ToneSource : public MediaSource {
+public:
+	ToneSource(int16_t value, int64_t durationUs)
+		: value_(value), frames_(durationUs * kSampleRate / 1000000) {}
+
+	status_t start(MetaData* params) override { return android::OK; }
+	status_t stop() override { return android::OK; }
+	sp<MetaData> getFormat() override {
+		sp<MetaData> format = new MetaData;
+		format->setInt32(android::kKeySampleRate, kSampleRate);
+		format->setInt32(android::kKeyChannelCount, kChannels);
+		return format;
+	}
+	status_t read(MediaBuffer** buffer, const ReadOptions* options) override {
+		int64_t seekTimeUs;
+		ReadOptions::SeekMode seekMode;
+		if (options != nullptr && options->getSeekTo(&seekTimeUs, &seekMode)) {
+			position_ = seekTimeUs * kSampleRate / 1000000;
+			seeks_++;
+		}
+		if (position_ >= frames_)
+			return android::ERROR_END_OF_STREAM;
+		if (on_read_) {
+			on_read_();
+			on_read_ = nullptr;
+		}
+		size_t frames = std::min(kBufferFrames, frames_ - position_);
+		*buffer = new MediaBuffer(frames * kChannels * sizeof(int16_t));
+		int16_t* samples = static_cast<int16_t*>((*buffer)->data());
+		std::fill(samples, samples + frames * kChannels, value_);
+		(*buffer)->meta_data()->setInt64(android::kKeyTime, FramesToUs(position_));
+		position_ += frames;
+		return android::OK;
+	}
+
+	size_t position() const { return position_; }
+	int seeks() const { return seeks_; }
+	/* runs once, at the next read */
+	void set_on_read(const std::function<void()>& on_read) { on_read_ = on_read; }
+
+private:
+	const int16_t value_;
+	const size_t frames_;
+	size_t position_ = 0;
+	int seeks_ = 0;
+	std::function<void()> on_read_;
+};
+
+class TrackSequencerTest : public testing::Test {
+protected:
+	static const int16_t kOutgoing = 8000;
+	static const int16_t kIncoming = 4000;
+
+	/* a crossfade of 200 ms from a track of 1 s, or of played, into the
+	   next track of 1 s */
+	void StartCrossfade(int64_t playedUs) {
+		outgoing_ = new ToneSource(kOutgoing, playedUs);
+		incoming_ = new ToneSource(kIncoming, 1000000);
+		sequencer_ = new TrackSequencer(outgoing_, 1000000, 1.0f, base::Bind(&base::DoNothing));
+		sequencer_->SetCrossfade(200000);
+		ASSERT_EQ(android::OK, sequencer_->start(nullptr));
+		MediaBuffer* first;
+		ASSERT_EQ(android::OK, incoming_->read(&first, nullptr));
+		ASSERT_TRUE(sequencer_->SetNext(incoming_, 1000000, 1.0f, first));
+	}
+	void TearDown() override {
+		if (sequencer_ != nullptr)
+			sequencer_->stop();
+		sequencer_ = nullptr;
+		base::RunLoop().RunUntilIdle();
+	}
+
+	void ReadBuffers(int count) {
+		MediaBuffer* buffer;
+		for (int i = 0; i < count; i++) {
+			ASSERT_EQ(android::OK, sequencer_->read(&buffer, nullptr));
+			buffer->release();
+		}
+	}
+	/* reads until the buffer time reaches timeUs, or the end; false at the end */
+	bool ReadTo(int64_t timeUs) {
+		MediaBuffer* buffer;
+		while (sequencer_->read(&buffer, nullptr) == android::OK) {
+			int64_t bufferUs = 0;
+			buffer->meta_data()->findInt64(android::kKeyTime, &bufferUs);
+			buffer->release();
+			if (bufferUs >= timeUs)
+				return true;
+		}
+		return false;
+	}
+	/* the frames read from here to the end */
+	size_t ReadToEnd() {
+		size_t frames = 0;
+		MediaBuffer* buffer;
+		while (sequencer_->read(&buffer, nullptr) == android::OK) {
+			frames += buffer->range_length() / (kChannels * sizeof(int16_t));
+			buffer->release();
+		}
+		return frames;
+	}
+	/* the buffer at the seek, released by the caller */
+	MediaBuffer* Seek(int64_t timeUs) {
+		MediaSource::ReadOptions options;
+		options.setSeekTo(timeUs);
+		MediaBuffer* buffer = nullptr;
+		EXPECT_EQ(android::OK, sequencer_->read(&buffer, &options));
+		return buffer;
+	}
+	static void ExpectAll(int16_t value, MediaBuffer* buffer) {
+		const int16_t* samples = reinterpret_cast<const int16_t*>(
+			static_cast<const uint8_t*>(buffer->data()) + buffer->range_offset());
+		for (size_t i = 0; i < buffer->range_length() / sizeof(int16_t); i++)
+			ASSERT_EQ(value, samples[i]) << "sample " << i;
+	}
+
+	base::MessageLoop message_loop_;
+	sp<ToneSource> outgoing_;
+	sp<ToneSource> incoming_;
+	sp<TrackSequencer> sequencer_;
+};
+
+const int16_t TrackSequencerTest::kOutgoing;
+const int16_t TrackSequencerTest::kIncoming;
+
+}  // namespace
+
+TEST_F(TrackSequencerTest, CrossfadeOverlapsTheTracks)
+{
+	StartCrossfade(1000000);
+	/* 800 ms of the first track, the 200 ms of the fade, 800 ms of the next */
+	EXPECT_EQ((size_t)1800 * kSampleRate / 1000, ReadToEnd());
+	EXPECT_EQ((size_t)kSampleRate, incoming_->position());
+}
+
+TEST_F(TrackSequencerTest, SeekDuringCrossfadeRestartsIt)
+{
+	StartCrossfade(1000000);
+	/* half way through the fade */
+	ASSERT_TRUE(ReadTo(900000));
+	ASSERT_GT(incoming_->position(), (size_t)kSampleRate / 10);
+
+	/* back before the fade: the first track alone, the next one rewound */
+	MediaBuffer* buffer = Seek(100000);
+	ASSERT_NE(nullptr, buffer);
+	ExpectAll(kOutgoing, buffer);
+	buffer->release();
+	EXPECT_EQ(1, incoming_->seeks());
+	EXPECT_EQ(kBufferFrames, incoming_->position());
+
+	/* and the whole fade once more, from 110 ms on */
+	EXPECT_EQ((size_t)1690 * kSampleRate / 1000, ReadToEnd());
+	EXPECT_EQ((size_t)kSampleRate, incoming_->position());
+}
+
+TEST_F(TrackSequencerTest, SeekWithinCrossfadeStartsItAnew)
+{
+	StartCrossfade(1000000);
+	ASSERT_TRUE(ReadTo(950000));
+	/* into the overlap again: mixed from the start of the next track */
+	MediaBuffer* buffer = Seek(850000);
+	ASSERT_NE(nullptr, buffer);
+	buffer->release();
+	/* the 150 ms left of the first track fade three quarters of the way,
+	   the next track fades in the rest alone and plays to its end */
+	EXPECT_EQ((size_t)990 * kSampleRate / 1000, ReadToEnd());
+	EXPECT_EQ((size_t)kSampleRate, incoming_->position());
+}
+
+TEST_F(TrackSequencerTest, SeekDuringFadeInPlaysAtFullLevel)
+{
+	/* the first track ends 100 ms into the fade, the next one fades in alone */
+	StartCrossfade(900000);
+	ReadBuffers(90);
+	/* 120 ms of the 200 ms fade in */
+	ReadBuffers(2);
+
+	MediaBuffer* buffer = Seek(500000);
+	ASSERT_NE(nullptr, buffer);
+	ExpectAll(kIncoming, buffer);
+	buffer->release();
+	buffer = Seek(0);
+	ASSERT_NE(nullptr, buffer);
+	ExpectAll(kIncoming, buffer);
+	buffer->release();
+}
+
+TEST_F(TrackSequencerTest, QueuesATrackDuringTheCrossfadeDecode)
+{
+	StartCrossfade(1000000);
+	ASSERT_TRUE(ReadTo(850000));
+	/* the message loop queues another track while the incoming one decodes */
+	sp<ToneSource> other = new ToneSource(kIncoming, 1000000);
+	bool queued = false;
+	incoming_->set_on_read([&]() {
+		MediaBuffer* first;
+		ASSERT_EQ(android::OK, other->read(&first, nullptr));
+		queued = sequencer_->SetNext(other, 0, 1.0f, first);
+	});
+	/* the first track plays out alone, then the other one without a fade */
+	size_t frames = ReadToEnd();
+	ASSERT_TRUE(queued);
+	EXPECT_EQ((size_t)1140 * kSampleRate / 1000, frames);
+	EXPECT_EQ((size_t)kSampleRate, other->position());
+}
@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "track_search.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+const char kTrackExtension[] = ".mp3";
+
+/* appends the string lowercased, each run of characters other than ASCII
+   letters and digits becoming a single space; the bytes of UTF-8 sequences
+   are kept as they are. out ends with a space already */
+void AppendNormalized(const char* s, size_t length, std::string* out)
+{
+	for (size_t i = 0; i < length; i++) {
+		unsigned char c = s[i];
+		if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80)
+			out->push_back(c);
+		else if (c >= 'A' && c <= 'Z')
+			out->push_back(c - 'A' + 'a');
+		else if (out->back() != ' ')
+			out->push_back(' ');
+	}
+	if (out->back() != ' ')
+		out->push_back(' ');
+}
+
+/* the file name without its extension */
+void AppendName(const char* name, std::string* out)
+{
+	size_t length = strlen(name);
+	size_t extension = sizeof(kTrackExtension) - 1;
+	if (length > extension && !strcasecmp(name + length - extension, kTrackExtension))
+		length -= extension;
+	AppendNormalized(name, length, out);
+}
+
+/* the words of a normalized text, without the spaces around them */
+std::string Trim(const std::string& text)
+{
+	return text.size() > 1 ? text.substr(1, text.size() - 2) : std::string();
+}
+
+uint32_t Trigram(const char* s)
+{
+	return (uint8_t)s[0] << 16 | (uint8_t)s[1] << 8 | (uint8_t)s[2];
+}
+
+/* the trigrams a query word needs: a short one has to start a word */
+void AddWordTrigrams(const std::string& word, std::vector<uint32_t>* trigrams)
+{
+	if (word.size() == 2) {
+		trigrams->push_back(Trigram((" " + word).c_str()));
+		return;
+	}
+	for (size_t i = 0; i + 3 <= word.size(); i++)
+		trigrams->push_back(Trigram(&word[i]));
+}
+
+/* how well the text of a track matches the query, lower is better, -1 when
+   it does not */
+int Rank(const std::string& text, const std::string& phrase, const std::vector<std::string>& words)
+{
+	if (text.find(" " + phrase) != std::string::npos)
+		return 0;
+	if (phrase.size() > 2 && text.find(phrase) != std::string::npos)
+		return 1;
+	for (const auto& word : words) {
+		if (text.find(word.size() > 2 ? word : " " + word) == std::string::npos)
+			return -1;
+	}
+	return 2;
+}
+
+}  // namespace
+
+const size_t TrackSearch::kMaxCandidates;
+
+TrackSearch::TrackSearch(const TrackTable* tracks)
+	: tracks_(tracks)
+{
+}
+
+void TrackSearch::Rebuild()
+{
+	titles_.clear();
+	postings_.clear();
+	id_limit_ = 0;
+	std::vector<std::pair<std::string, TrackId>> titles;
+	titles.reserve(tracks_->size());
+	for (size_t position = 0; position < tracks_->size(); position++) {
+		TrackId id = tracks_->At(position);
+		titles.emplace_back(Title(id), id);
+	}
+	std::sort(titles.begin(), titles.end());
+	/* in the order of the ids, the lists are only appended to */
+	std::vector<TrackId> ids;
+	ids.reserve(titles.size());
+	for (const auto& title : titles)
+		ids.push_back(title.second);
+	std::sort(ids.begin(), ids.end());
+	for (TrackId id : ids)
+		AddTrigrams(id);
+	titles_.reserve(titles.size());
+	for (const auto& title : titles)
+		titles_.push_back(title.second);
+}
+
+void TrackSearch::Add(TrackId id)
+{
+	titles_.insert(titles_.begin() + TitlePosition(id, Title(id)), id);
+	AddTrigrams(id);
+}
+
+void TrackSearch::AddTrigrams(TrackId id)
+{
+	id_limit_ = std::max(id_limit_, id + 1);
+	for (uint32_t trigram : Trigrams(Text(id))) {
+		std::vector<TrackId>& ids = postings_[trigram];
+		if (ids.empty() || ids.back() < id) {
+			ids.push_back(id);
+			continue;
+		}
+		auto it = std::lower_bound(ids.begin(), ids.end(), id);
+		if (*it != id)
+			ids.insert(it, id);
+	}
+}
+
+void TrackSearch::Remove(TrackId id)
+{
+	size_t position = TitlePosition(id, Title(id));
+	if (position < titles_.size() && titles_[position] == id)
+		titles_.erase(titles_.begin() + position);
+	for (uint32_t trigram : Trigrams(Text(id))) {
+		auto entry = postings_.find(trigram);
+		if (entry == postings_.end())
+			continue;
+		std::vector<TrackId>& ids = entry->second;
+		auto it = std::lower_bound(ids.begin(), ids.end(), id);
+		if (it != ids.end() && *it == id)
+			ids.erase(it);
+		if (ids.empty())
+			postings_.erase(entry);
+	}
+}
+
+TrackSearch::TrackId TrackSearch::Find(const std::string& query) const
+{
+	std::string normalized(1, ' ');
+	AppendNormalized(query.c_str(), query.size(), &normalized);
+	std::string phrase = Trim(normalized);
+	std::vector<std::string> words;
+	std::vector<uint32_t> trigrams;
+	for (size_t start = 1, end; start < normalized.size(); start = end + 1) {
+		end = normalized.find(' ', start);
+		words.push_back(normalized.substr(start, end - start));
+		AddWordTrigrams(words.back(), &trigrams);
+	}
+	/* a letter alone says too little */
+	if (trigrams.empty())
+		return TrackTable::kNoTrack;
+	std::sort(trigrams.begin(), trigrams.end());
+	trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+	TrackId id = FindTitle(phrase);
+	if (id == TrackTable::kNoTrack)
+		id = FindText(phrase, words, trigrams);
+	if (id == TrackTable::kNoTrack)
+		id = FindFuzzy(trigrams);
+	return id;
+}
+
+size_t TrackSearch::MemoryBytes() const
+{
+	/* the nodes of the map hold the key, the list and a link */
+	size_t bytes = titles_.capacity() * sizeof(TrackId) + postings_.bucket_count() * sizeof(void*);
+	for (const auto& entry : postings_)
+		bytes += sizeof(entry) + sizeof(void*) + entry.second.capacity() * sizeof(TrackId);
+	return bytes;
+}
+
+void TrackSearch::ShrinkToFit()
+{
+	titles_.shrink_to_fit();
+	for (auto& entry : postings_)
+		entry.second.shrink_to_fit();
+}
+
+void TrackSearch::Swap(TrackSearch* other)
+{
+	titles_.swap(other->titles_);
+	postings_.swap(other->postings_);
+	std::swap(id_limit_, other->id_limit_);
+}
+
+std::string TrackSearch::Title(TrackId id) const
+{
+	std::string title(1, ' ');
+	const char* s = tracks_->Title(id);
+	if (*s != '\0')
+		AppendNormalized(s, strlen(s), &title);
+	else
+		AppendName(tracks_->Name(id), &title);
+	return Trim(title);
+}
+
+std::string TrackSearch::Text(TrackId id) const
+{
+	std::string text(1, ' ');
+	const char* title = tracks_->Title(id);
+	AppendNormalized(title, strlen(title), &text);
+	const char* artist = tracks_->Artist(id);
+	AppendNormalized(artist, strlen(artist), &text);
+	AppendName(tracks_->Name(id), &text);
+	return text;
+}
+
+/* queries only look for trigrams within words, or starting one, so those
+   are the only ones kept */
+std::vector<uint32_t> TrackSearch::Trigrams(const std::string& text)
+{
+	std::vector<uint32_t> trigrams;
+	for (size_t i = 0; i + 3 <= text.size(); i++) {
+		if (text[i + 1] != ' ' && text[i + 2] != ' ')
+			trigrams.push_back(Trigram(&text[i]));
+	}
+	std::sort(trigrams.begin(), trigrams.end());
+	trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+	return trigrams;
+}
+
+const std::vector<TrackSearch::TrackId>* TrackSearch::Postings(uint32_t trigram) const
+{
+	auto entry = postings_.find(trigram);
+	return entry != postings_.end() ? &entry->second : nullptr;
+}
+
+size_t TrackSearch::TitlePosition(TrackId id, const std::string& title) const
+{
+	return std::lower_bound(titles_.begin(), titles_.end(), id,
+		[this, &title](TrackId other, TrackId id) {
+			int order = Title(other).compare(title);
+			return order < 0 || (order == 0 && other < id);
+		}) - titles_.begin();
+}
+
+/* a title equal to the phrase sorts first, then those going on with
+   another word: a space sorts before any letter */
+TrackSearch::TrackId TrackSearch::FindTitle(const std::string& phrase) const
+{
+	auto it = std::lower_bound(titles_.begin(), titles_.end(), phrase,
+		[this](TrackId id, const std::string& p) { return Title(id) < p; });
+	TrackId best = TrackTable::kNoTrack;
+	size_t bestLength = 0;
+	for (size_t n = 0; it != titles_.end() && n < kMaxCandidates; ++it, n++) {
+		std::string title = Title(*it);
+		if (title.compare(0, phrase.size(), phrase) != 0 ||
+		    (title.size() > phrase.size() && title[phrase.size()] != ' '))
+			break;
+		if (title.size() == phrase.size())
+			return *it;
+		if (best == TrackTable::kNoTrack || title.size() < bestLength) {
+			best = *it;
+			bestLength = title.size();
+		}
+	}
+	return best;
+}
+
+TrackSearch::TrackId TrackSearch::FindText(const std::string& phrase,
+                                           const std::vector<std::string>& words,
+                                           const std::vector<uint32_t>& trigrams) const
+{
+	std::vector<const std::vector<TrackId>*> lists;
+	for (uint32_t trigram : trigrams) {
+		const std::vector<TrackId>* ids = Postings(trigram);
+		if (ids == nullptr)
+			return TrackTable::kNoTrack;
+		lists.push_back(ids);
+	}
+	std::sort(lists.begin(), lists.end(),
+		[](const std::vector<TrackId>* a, const std::vector<TrackId>* b) {
+			return a->size() < b->size();
+		});
+
+	/* only a track with a word starting like the phrase, with the trigram
+	   of a space and its first two letters, can rank 0; a first word of one
+	   letter has no such trigram */
+	bool letter = phrase[1] == ' ';
+	const std::vector<TrackId>* starts = letter ? nullptr : Postings(Trigram((" " + phrase).c_str()));
+	auto startsWord = [letter, starts](TrackId id) {
+		return letter || (starts != nullptr && std::binary_search(starts->begin(), starts->end(), id));
+	};
+
+	TrackId best = TrackTable::kNoTrack;
+	int bestRank = 0;
+	size_t bestLength = 0;
+	/* reads the tracks with every trigram of the query; once kMaxCandidates
+	   of them matched after one with the best rank they can have, only a
+	   shorter text of that rank could follow */
+	auto read = [&](bool wordStarts, int bestPossible) {
+		size_t matches = 0;
+		for (TrackId id : *lists[0]) {
+			bool all = startsWord(id) == wordStarts;
+			for (size_t i = 1; i < lists.size() && all; i++)
+				all = std::binary_search(lists[i]->begin(), lists[i]->end(), id);
+			if (!all)
+				continue;
+			std::string text = Text(id);
+			int rank = Rank(text, phrase, words);
+			if (rank < 0)
+				continue;
+			if (best == TrackTable::kNoTrack || rank < bestRank ||
+			    (rank == bestRank && text.size() < bestLength)) {
+				best = id;
+				bestRank = rank;
+				bestLength = text.size();
+			}
+			if (bestRank <= bestPossible && ++matches == kMaxCandidates)
+				return;
+		}
+	};
+	if (letter || starts != nullptr)
+		read(true, 0);
+	if (best == TrackTable::kNoTrack || bestRank > 0)
+		read(false, phrase.size() > 2 ? 1 : 2);
+	return best;
+}
+
+/* the track sharing most trigrams with the query, at least half of them;
+   slower than an exact match, it counts through every list of the query */
+TrackSearch::TrackId TrackSearch::FindFuzzy(const std::vector<uint32_t>& trigrams) const
+{
+	uint16_t needed = (trigrams.size() + 1) / 2;
+	std::vector<uint16_t> shared(id_limit_);
+	std::vector<TrackId> qualified;
+	for (uint32_t trigram : trigrams) {
+		const std::vector<TrackId>* ids = Postings(trigram);
+		if (ids == nullptr)
+			continue;
+		for (TrackId id : *ids) {
+			if (++shared[id] == needed)
+				qualified.push_back(id);
+		}
+	}
+	uint16_t mostShared = 0;
+	for (TrackId id : qualified)
+		mostShared = std::max(mostShared, shared[id]);
+	/* the text is read for the tracks sharing the most only */
+	TrackId best = TrackTable::kNoTrack;
+	size_t bestLength = 0;
+	size_t candidates = 0;
+	for (TrackId id : qualified) {
+		if (shared[id] < mostShared)
+			continue;
+		size_t length = Text(id).size();
+		if (best == TrackTable::kNoTrack || length < bestLength) {
+			best = id;
+			bestLength = length;
+		}
+		if (++candidates == kMaxCandidates)
+			break;
+	}
+	return best;
+}
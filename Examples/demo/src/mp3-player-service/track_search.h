@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_TRACK_SEARCH_H_
+#define MP3_PLAYER_TRACK_SEARCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <base/macros.h>
+
+#include "track_table.h"
+
+/* Finds the track a spoken or typed name is meant for, among the tracks of
+ * a TrackTable.
+ *
+ * The tracks are kept in the order of their titles, the file name standing
+ * in for a missing one, so a title equal to the query or starting with it
+ * is found by a binary search. Otherwise the title, artist and file name of
+ * a track are lowercased into one text with single spaces around its words,
+ * and every three bytes of a word, or the first two with the space before
+ * them, are a trigram. Each trigram lists the ids of the tracks that have
+ * it, sorted, so a query intersects the lists of its own trigrams, starting
+ * with the shortest one, and only reads the text of the few tracks left.
+ *
+ * Matches rank: a title equal to the query, a title starting with it, a
+ * word starting with it, any other match of the whole query, and a match
+ * of all its words apart. Shorter texts win a tie. When nothing contains
+ * the query, as with a typo, the track sharing most of its trigrams is
+ * taken, provided it shares half of them.
+ *
+ * The index follows the table one track at a time: Add() after a track is
+ * put in the table, Remove() before its strings change or it leaves. */
+class TrackSearch final {
+public:
+	using TrackId = TrackTable::TrackId;
+
+	explicit TrackSearch(const TrackTable* tracks);
+
+	/* indexes every track of the table anew, faster than adding them one
+	   by one */
+	void Rebuild();
+	void Add(TrackId id);
+	void Remove(TrackId id);
+	/* the best match of the query, kNoTrack if there is none */
+	TrackId Find(const std::string& query) const;
+
+	/* the heap memory of the index */
+	size_t MemoryBytes() const;
+	/* gives back the memory reserved for growth, after a bulk load */
+	void ShrinkToFit();
+	/* exchanges the indexes of the two searches, once their tables were
+	   swapped, so that an index built on another thread is taken over */
+	void Swap(TrackSearch* other);
+
+private:
+	/* the tracks whose text is read at most, once the best rank is
+	   found, to pick the shortest; a query matching half the library
+	   still takes microseconds */
+	static const size_t kMaxCandidates = 64;
+
+	void AddTrigrams(TrackId id);
+	/* the title as it is searched */
+	std::string Title(TrackId id) const;
+	/* the title, artist and file name as they are searched */
+	std::string Text(TrackId id) const;
+	/* the trigrams of the text, each once, sorted */
+	static std::vector<uint32_t> Trigrams(const std::string& text);
+	/* the list of the trigram, null if no track has it */
+	const std::vector<TrackId>* Postings(uint32_t trigram) const;
+	/* the position of the track in titles_, or where it goes */
+	size_t TitlePosition(TrackId id, const std::string& title) const;
+	TrackId FindTitle(const std::string& phrase) const;
+	TrackId FindText(const std::string& phrase, const std::vector<std::string>& words,
+	                 const std::vector<uint32_t>& trigrams) const;
+	TrackId FindFuzzy(const std::vector<uint32_t>& trigrams) const;
+
+	const TrackTable* const tracks_;
+	/* the ids by title, then by id */
+	std::vector<TrackId> titles_;
+	std::unordered_map<uint32_t, std::vector<TrackId>> postings_;
+	/* above the largest id indexed */
+	TrackId id_limit_ = 0;
+
+	DISALLOW_COPY_AND_ASSIGN(TrackSearch);
+};
+
+#endif
@@ -0,0 +1,428 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "track_sequencer.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include <base/bind.h>
+#include <base/location.h>
+#include <base/logging.h>
+#include <base/thread_task_runner_handle.h>
+#include <media/stagefright/MediaBuffer.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaData.h>
+
+#include "gain_stage.h"
+#include "metrics.h"
+
+using android::MediaBuffer;
+using android::MediaSource;
+using android::MetaData;
+using android::sp;
+using android::status_t;
+
+namespace {
+
+/* the sink is set up from these, any difference needs a new one */
+bool SameSinkFormat(const sp<MetaData>& a, const sp<MetaData>& b)
+{
+	int32_t a_rate, a_channels, b_rate, b_channels;
+	return a != nullptr && b != nullptr &&
+	       a->findInt32(android::kKeySampleRate, &a_rate) &&
+	       a->findInt32(android::kKeyChannelCount, &a_channels) &&
+	       b->findInt32(android::kKeySampleRate, &b_rate) &&
+	       b->findInt32(android::kKeyChannelCount, &b_channels) &&
+	       a_rate == b_rate && a_channels == b_channels;
+}
+
+/* the equal-power gains at a point of the fade, 0 to 1 */
+float FadeOutGain(float progress)
+{
+	return cosf(progress * (float)M_PI_2);
+}
+
+float FadeInGain(float progress)
+{
+	return sinf(progress * (float)M_PI_2);
+}
+
+int16_t* Samples(MediaBuffer* buffer)
+{
+	return reinterpret_cast<int16_t*>(
+		static_cast<uint8_t*>(buffer->data()) + buffer->range_offset());
+}
+
+/* a finished track is stopped off the decoder thread */
+void StopSource(const sp<MediaSource>& source)
+{
+	source->stop();
+}
+
+}  // namespace
+
+TrackSequencer::TrackSequencer(const sp<MediaSource>& first, int64_t firstDurationUs,
+                               float firstGain, const base::Closure& on_advanced)
+	: task_runner_(base::ThreadTaskRunnerHandle::Get()),
+	  on_advanced_(on_advanced),
+	  format_(first->getFormat()),
+	  current_(first),
+	  current_duration_us_(firstDurationUs),
+	  current_gain_(firstGain)
+{
+	if (format_ != nullptr) {
+		format_->findInt32(android::kKeyChannelCount, &channels_);
+		format_->findInt32(android::kKeySampleRate, &sample_rate_);
+	}
+}
+
+TrackSequencer::~TrackSequencer()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	ClearNextLocked();
+	if (pending_) {
+		pending_->release();
+		pending_ = nullptr;
+	}
+}
+
+void TrackSequencer::Clear()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	ClearNextLocked();
+	ClearCurrentLocked();
+}
+
+bool TrackSequencer::Replace(const sp<MediaSource>& track, int64_t durationUs, float gain)
+{
+	if (!SameSinkFormat(format_, track->getFormat())) {
+		LOG(INFO) << "The track needs a different sink";
+		return false;
+	}
+	if (track->start() != android::OK)
+		return false;
+	std::lock_guard<std::mutex> guard(lock_);
+	ClearNextLocked();
+	ClearCurrentLocked();
+	current_ = track;
+	current_duration_us_ = durationUs;
+	current_gain_ = gain;
+	return true;
+}
+
+bool TrackSequencer::SetNext(const sp<MediaSource>& next, int64_t durationUs, float gain,
+                             MediaBuffer* first_buffer)
+{
+	if (!SameSinkFormat(format_, next->getFormat())) {
+		LOG(INFO) << "The next track needs a different sink, no gapless transition";
+		first_buffer->release();
+		next->stop();
+		return false;
+	}
+	std::lock_guard<std::mutex> guard(lock_);
+	ClearNextLocked();
+	next_ = next;
+	next_duration_us_ = durationUs;
+	next_gain_ = gain;
+	next_first_buffer_ = first_buffer;
+	return true;
+}
+
+bool TrackSequencer::HasNext()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return next_ != nullptr;
+}
+
+void TrackSequencer::ClearNext()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	if (fade_ != kMixing)
+		ClearNextLocked();
+}
+
+status_t TrackSequencer::start(MetaData* params)
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return current_ != nullptr ? current_->start(params) : android::OK;
+}
+
+status_t TrackSequencer::stop()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	ClearNextLocked();
+	if (pending_) {
+		pending_->release();
+		pending_ = nullptr;
+	}
+	return current_ != nullptr ? current_->stop() : android::OK;
+}
+
+sp<MetaData> TrackSequencer::getFormat()
+{
+	return format_;
+}
+
+status_t TrackSequencer::read(MediaBuffer** buffer, const ReadOptions* options)
+{
+	sp<MediaSource> current;
+	sp<MediaSource> rewind;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		int64_t seekTimeUs;
+		ReadOptions::SeekMode seekMode;
+		bool seeking = options != nullptr && options->getSeekTo(&seekTimeUs, &seekMode);
+		if (pending_ && !seeking) {
+			*buffer = pending_;
+			pending_ = nullptr;
+			ApplyTrackGainLocked(*buffer);
+			if (fade_ == kFadingIn)
+				FadeInLocked(*buffer);
+			return android::OK;
+		}
+		if (pending_) {
+			pending_->release();
+			pending_ = nullptr;
+		}
+		if (seeking && fade_ != kNoFade)
+			rewind = CancelFadeLocked();
+		current = current_;
+	}
+	if (rewind != nullptr)
+		RewindNext(rewind);
+	if (current == nullptr)
+		return android::ERROR_END_OF_STREAM;
+	status_t status = current->read(buffer, options);
+	if (status == android::OK) {
+		std::unique_lock<std::mutex> guard(lock_);
+		ApplyTrackGainLocked(*buffer);
+		if (fade_ == kNoFade)
+			MaybeStartFadeLocked(*buffer);
+		if (fade_ == kMixing && MixIncoming(*buffer, &guard))
+			AdvanceLocked();
+		else if (fade_ == kFadingIn)
+			FadeInLocked(*buffer);
+		return status;
+	}
+	if (status != android::ERROR_END_OF_STREAM)
+		return status;
+
+	int64_t switch_us = metrics::NowUs();
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		if (next_ == nullptr)
+			return status;
+		if (fade_ == kMixing)
+			fade_ = kFadingIn;
+		AdvanceLocked();
+	}
+	/* the queued track's buffer, or its next one */
+	status = read(buffer, nullptr);
+	/* from the end of one track to the first buffer of the next */
+	METRICS_RECORD("playback.transition", metrics::NowUs() - switch_us);
+	return status;
+}
+
+status_t TrackSequencer::pause()
+{
+	std::lock_guard<std::mutex> guard(lock_);
+	return current_ != nullptr ? current_->pause() : android::OK;
+}
+
+void TrackSequencer::AdvanceLocked()
+{
+	task_runner_->PostTask(FROM_HERE, base::Bind(&StopSource, current_));
+	task_runner_->PostTask(FROM_HERE, on_advanced_);
+	current_ = next_;
+	current_duration_us_ = next_duration_us_;
+	current_gain_ = next_gain_;
+	pending_ = next_first_buffer_;
+	next_ = nullptr;
+	next_first_buffer_ = nullptr;
+}
+
+sp<MediaSource> TrackSequencer::CancelFadeLocked()
+{
+	sp<MediaSource> rewind;
+	if (fade_ == kMixing) {
+		/* the queued track was partly played into the mix, it starts over
+		   should the seek lead to the crossfade again */
+		if (next_first_buffer_) {
+			next_first_buffer_->release();
+			next_first_buffer_ = nullptr;
+		}
+		rewind = next_;
+	}
+	/* a track fading in plays on at its full level */
+	fade_ = kNoFade;
+	faded_frames_ = 0;
+	return rewind;
+}
+
+void TrackSequencer::RewindNext(const sp<MediaSource>& next)
+{
+	ReadOptions options;
+	options.setSeekTo(0);
+	const ReadOptions* seek = &options;
+	MediaBuffer* first_buffer = nullptr;
+	status_t status;
+	while ((status = next->read(&first_buffer, seek)) == android::INFO_FORMAT_CHANGED)
+		seek = nullptr;
+	std::lock_guard<std::mutex> guard(lock_);
+	/* the message loop may have queued another track in the meantime */
+	if (next_ != next || next_first_buffer_ != nullptr) {
+		if (status == android::OK)
+			first_buffer->release();
+		return;
+	}
+	if (status != android::OK) {
+		LOG(WARNING) << "The queued track did not seek back to its start";
+		ClearNextLocked();
+		return;
+	}
+	next_first_buffer_ = first_buffer;
+}
+
+void TrackSequencer::MaybeStartFadeLocked(MediaBuffer* buffer)
+{
+	int64_t crossfade = crossfade_us_;
+	if (next_ == nullptr || crossfade <= 0 || current_duration_us_ <= 0 || next_duration_us_ <= 0)
+		return;
+	/* neither track is all fade */
+	crossfade = std::min({ crossfade, current_duration_us_ / 2, next_duration_us_ / 2 });
+	int64_t timeUs;
+	if (!buffer->meta_data()->findInt64(android::kKeyTime, &timeUs) ||
+	    timeUs < current_duration_us_ - crossfade)
+		return;
+	fade_ = kMixing;
+	fade_frames_ = std::max<int64_t>(crossfade * sample_rate_ / 1000000, 1);
+	faded_frames_ = 0;
+}
+
+bool TrackSequencer::MixIncoming(MediaBuffer* buffer, std::unique_lock<std::mutex>* guard)
+{
+	const size_t frame_bytes = channels_ * sizeof(int16_t);
+	int16_t* out = Samples(buffer);
+	size_t frames = buffer->range_length() / frame_bytes;
+	size_t mixed = 0;
+	while (mixed < frames && faded_frames_ < fade_frames_) {
+		MediaBuffer* in = next_first_buffer_;
+		if (in == nullptr || in->range_length() < frame_bytes) {
+			if (in)
+				in->release();
+			next_first_buffer_ = nullptr;
+			sp<MediaSource> next = next_;
+			in = nullptr;
+			guard->unlock();
+			status_t status;
+			while ((status = next->read(&in)) == android::INFO_FORMAT_CHANGED)
+				;
+			guard->lock();
+			/* the queued track was dropped or replaced during the decode, the
+			   outgoing track plays on without it */
+			if (next_ != next || next_first_buffer_ != nullptr || fade_ != kMixing) {
+				if (status == android::OK)
+					in->release();
+				return false;
+			}
+			if (status != android::OK) {
+				LOG(WARNING) << "The incoming track ended during the crossfade";
+				ClearNextLocked();
+				return false;
+			}
+			next_first_buffer_ = in;
+			continue;
+		}
+		size_t n = std::min({ frames - mixed, in->range_length() / frame_bytes,
+		                      fade_frames_ - faded_frames_ });
+		/* the curve is followed linearly within a decoder buffer; the
+		   outgoing buffer has its track gain already */
+		float from = (float)faded_frames_ / fade_frames_;
+		float to = (float)(faded_frames_ + n) / fade_frames_;
+		MixWithGain(out + mixed * channels_, Samples(in), n, channels_,
+		            FadeOutGain(from), (FadeOutGain(to) - FadeOutGain(from)) / n,
+		            next_gain_ * FadeInGain(from),
+		            next_gain_ * (FadeInGain(to) - FadeInGain(from)) / n);
+		in->set_range(in->range_offset() + n * frame_bytes, in->range_length() - n * frame_bytes);
+		int64_t timeUs;
+		if (in->meta_data()->findInt64(android::kKeyTime, &timeUs))
+			in->meta_data()->setInt64(android::kKeyTime,
+			                          timeUs + (int64_t)n * 1000000 / sample_rate_);
+		faded_frames_ += n;
+		mixed += n;
+	}
+	if (faded_frames_ < fade_frames_)
+		return false;
+	/* the outgoing track is silent from here on */
+	buffer->set_range(buffer->range_offset(), mixed * frame_bytes);
+	fade_ = kNoFade;
+	METRICS_COUNT("playback.crossfades");
+	return true;
+}
+
+void TrackSequencer::FadeInLocked(MediaBuffer* buffer)
+{
+	size_t frames = std::min(buffer->range_length() / (channels_ * sizeof(int16_t)),
+	                         fade_frames_ - faded_frames_);
+	float from = (float)faded_frames_ / fade_frames_;
+	float to = (float)(faded_frames_ + frames) / fade_frames_;
+	if (frames > 0)
+		ApplyGain(Samples(buffer), frames, channels_, FadeInGain(from),
+		          (FadeInGain(to) - FadeInGain(from)) / frames);
+	faded_frames_ += frames;
+	if (faded_frames_ >= fade_frames_)
+		fade_ = kNoFade;
+}
+
+void TrackSequencer::ApplyTrackGainLocked(MediaBuffer* buffer)
+{
+	if (current_gain_ == 1.0f)
+		return;
+	ApplyGain(Samples(buffer), buffer->range_length() / (channels_ * sizeof(int16_t)), channels_,
+	          current_gain_, 0.0f);
+}
+
+void TrackSequencer::ClearCurrentLocked()
+{
+	if (pending_) {
+		pending_->release();
+		pending_ = nullptr;
+	}
+	fade_ = kNoFade;
+	if (current_ != nullptr) {
+		/* a read of the decoder thread may still be under way */
+		task_runner_->PostTask(FROM_HERE, base::Bind(&StopSource, current_));
+		current_ = nullptr;
+	}
+}
+
+void TrackSequencer::ClearNextLocked()
+{
+	if (fade_ == kMixing)
+		fade_ = kNoFade;
+	if (next_first_buffer_) {
+		next_first_buffer_->release();
+		next_first_buffer_ = nullptr;
+	}
+	if (next_ != nullptr) {
+		/* it may be decoding on the decoder thread for a crossfade */
+		task_runner_->PostTask(FROM_HERE, base::Bind(&StopSource, next_));
+		next_ = nullptr;
+	}
+}
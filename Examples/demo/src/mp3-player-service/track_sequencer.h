@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_TRACK_SEQUENCER_H_
+#define MP3_PLAYER_TRACK_SEQUENCER_H_
+
+#include <atomic>
+#include <mutex>
+
+#include <base/callback.h>
+#include <base/memory/ref_counted.h>
+#include <base/single_thread_task_runner.h>
+#include <media/stagefright/MediaSource.h>
+
+/* Feeds the AudioPlayer one track after another without reopening the sink.
+ *
+ * The track queued with SetNext() is started and holds its first decoded
+ * buffer, so at the end of the current track read() returns that buffer
+ * right away and the audio continues without a gap. Without a queued track
+ * the end of stream is passed on to the AudioPlayer.
+ *
+ * With a crossfade set, the queued track starts that long before the end
+ * of the current one, as given by the track durations, and both decoders
+ * run during the overlap. The outgoing track fades out and the incoming
+ * one fades in along an equal-power curve, so the loudness stays even.
+ * The playback moves on to the queued track when the fade completes, or
+ * when the current track ends first, in which case the rest of the fade
+ * in is still applied. A seek ends the fade: the queued track goes back
+ * to its start, to be faded in again if the playback reaches the overlap.
+ *
+ * Each track plays at its own loudness normalization gain.
+ *
+ * The sequencer outlives its tracks when the sink is kept between plays:
+ * Clear() lets go of them, and Replace() puts a new track in their place,
+ * to be read after a seek to its start. */
+class TrackSequencer : public android::MediaSource {
+public:
+	/* on_advanced runs on the thread that created the sequencer whenever
+	   the playback moves on to the queued track */
+	TrackSequencer(const android::sp<android::MediaSource>& first, int64_t firstDurationUs,
+	               float firstGain, const base::Closure& on_advanced);
+
+	/* takes a started source and its first buffer; fails if the format
+	   differs from the playing one, which would need a new sink; a
+	   duration of 0 means unknown and rules out a crossfade */
+	bool SetNext(const android::sp<android::MediaSource>& next, int64_t durationUs, float gain,
+	             android::MediaBuffer* first_buffer);
+	bool HasNext();
+	/* drops the queued track, the playback then ends with the current one;
+	   a track already fading in stays */
+	void ClearNext();
+	/* drops every track, the sequencer then reads end of stream */
+	void Clear();
+	/* plays the source, not started yet, in place of the current track;
+	   fails like SetNext() when the format differs, or if the source does
+	   not start. The reader is to seek to 0 before reading on */
+	bool Replace(const android::sp<android::MediaSource>& track, int64_t durationUs,
+	             float gain);
+	/* 0 for gapless transitions */
+	void SetCrossfade(int64_t durationUs) { crossfade_us_ = durationUs; }
+
+	android::status_t start(android::MetaData* params) override;
+	android::status_t stop() override;
+	android::sp<android::MetaData> getFormat() override;
+	android::status_t read(android::MediaBuffer** buffer,
+	                       const ReadOptions* options) override;
+	android::status_t pause() override;
+
+private:
+	~TrackSequencer() override;
+	void ClearNextLocked();
+	/* lets go of the current track and what is left of it */
+	void ClearCurrentLocked();
+	/* ends the crossfade in progress on a seek, returns the queued track
+	   to be rewound to its start by RewindNext() */
+	android::sp<android::MediaSource> CancelFadeLocked();
+	/* seeks the queued track back to its start, without the lock */
+	void RewindNext(const android::sp<android::MediaSource>& next);
+	void MaybeStartFadeLocked(android::MediaBuffer* buffer);
+	/* mixes the queued track into the buffer, true once the fade is complete;
+	   the lock is let go of while the queued track decodes */
+	bool MixIncoming(android::MediaBuffer* buffer, std::unique_lock<std::mutex>* guard);
+	void FadeInLocked(android::MediaBuffer* buffer);
+	void ApplyTrackGainLocked(android::MediaBuffer* buffer);
+	/* makes the queued track the current one */
+	void AdvanceLocked();
+
+	const scoped_refptr<base::SingleThreadTaskRunner> task_runner_;
+	const base::Closure on_advanced_;
+	/* the format of the first track, set up in the sink */
+	const android::sp<android::MetaData> format_;
+	int32_t channels_ = 2;
+	int32_t sample_rate_ = 44100;
+	std::atomic<int64_t> crossfade_us_{0};
+
+	/* guards the tracks; read() runs on the DecodeAheadSource thread and
+	   decodes without it, so the message loop does not wait on a decode */
+	std::mutex lock_;
+	/* null after Clear() */
+	android::sp<android::MediaSource> current_;
+	int64_t current_duration_us_;
+	float current_gain_;
+	android::sp<android::MediaSource> next_;
+	int64_t next_duration_us_ = 0;
+	float next_gain_ = 1.0f;
+	/* decoded but not yet played PCM of the queued track */
+	android::MediaBuffer* next_first_buffer_ = nullptr;
+	/* the PCM of the current track left over from the crossfade */
+	android::MediaBuffer* pending_ = nullptr;
+	/* the crossfade in progress, in frames of the incoming track */
+	enum Fade {
+		kNoFade,
+		/* both tracks are playing */
+		kMixing,
+		/* the current track ended early, the queued one plays alone */
+		kFadingIn,
+	};
+	Fade fade_ = kNoFade;
+	size_t fade_frames_ = 0;
+	size_t faded_frames_ = 0;
+};
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "track_table.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+/* smaller arenas are not worth compacting */
+const size_t kMinCompactBytes = 64 * 1024;
+
+/* compares a1 a2 with b1 b2, each pair read as one string; a2 and b2 may
+   be null */
+int CompareJoined(const char* a1, const char* a2, const char* b1, const char* b2)
+{
+	for (;;) {
+		if (*a1 == '\0' && a2 != nullptr) {
+			a1 = a2;
+			a2 = nullptr;
+			continue;
+		}
+		if (*b1 == '\0' && b2 != nullptr) {
+			b1 = b2;
+			b2 = nullptr;
+			continue;
+		}
+		unsigned char a = *a1, b = *b1;
+		if (a != b || a == '\0')
+			return a - b;
+		a1++;
+		b1++;
+	}
+}
+
+}  // namespace
+
+const TrackTable::TrackId TrackTable::kNoTrack;
+
+TrackTable::TrackTable()
+	: arena_(1, '\0')
+{
+}
+
+size_t TrackTable::PositionOf(TrackId id) const
+{
+	return std::lower_bound(order_.begin(), order_.end(), id,
+		[this](TrackId a, TrackId b) { return Compare(a, b) < 0; }) - order_.begin();
+}
+
+TrackTable::TrackId TrackTable::Find(const std::string& path) const
+{
+	auto it = std::lower_bound(order_.begin(), order_.end(), path,
+		[this](TrackId id, const std::string& p) { return Compare(id, p) < 0; });
+	return it != order_.end() && Compare(*it, path) == 0 ? *it : kNoTrack;
+}
+
+bool TrackTable::Contains(TrackId id) const
+{
+	return id < records_.size() && (records_[id].flags & kLive);
+}
+
+TrackTable::TrackId TrackTable::Put(const TrackInfo& info, bool* added)
+{
+	TrackId id = Find(info.path);
+	*added = id == kNoTrack;
+	if (!*added) {
+		Record& record = records_[id];
+		/* the same file, and rescans mostly find those */
+		if (record.stamp == info.Stamp() && record.gainMb == info.gainMb &&
+		    ((record.flags & kAnalyzed) != 0) == info.analyzed)
+			return id;
+		DropStrings(record);
+		Fill(&record, info);
+		MaybeCompact();
+		return id;
+	}
+
+	if (!free_.empty()) {
+		id = free_.back();
+		free_.pop_back();
+	} else {
+		id = records_.size();
+		records_.emplace_back();
+	}
+	Fill(&records_[id], info);
+	/* appends when the tracks come in path order, as from the index */
+	auto it = order_.end();
+	if (!order_.empty() && Compare(order_.back(), id) > 0) {
+		it = std::lower_bound(order_.begin(), order_.end(), id,
+			[this](TrackId a, TrackId b) { return Compare(a, b) < 0; });
+	}
+	order_.insert(it, id);
+	return id;
+}
+
+void TrackTable::Remove(TrackId id)
+{
+	if (!Contains(id))
+		return;
+	order_.erase(order_.begin() + PositionOf(id));
+	DropStrings(records_[id]);
+	records_[id].flags = 0;
+	free_.push_back(id);
+	MaybeCompact();
+}
+
+void TrackTable::SetGain(TrackId id, int32_t gainMb)
+{
+	records_[id].gainMb = gainMb;
+	records_[id].flags |= kAnalyzed;
+}
+
+TrackTable::TrackId TrackTable::NextUnanalyzed(size_t* position) const
+{
+	for (size_t n = 0; n < order_.size(); n++) {
+		if (*position >= order_.size())
+			*position = 0;
+		TrackId id = order_[*position];
+		if (!(records_[id].flags & kAnalyzed))
+			return id;
+		(*position)++;
+	}
+	return kNoTrack;
+}
+
+std::string TrackTable::Path(TrackId id) const
+{
+	const Record& record = records_[id];
+	return std::string(String(directories_[record.directory])) + String(record.name);
+}
+
+std::string TrackTable::DisplayName(TrackId id) const
+{
+	const Record& record = records_[id];
+	if (record.title == 0)
+		return String(record.name);
+	if (record.artist == 0)
+		return String(record.title);
+	return std::string(String(record.artist)) + " - " + String(record.title);
+}
+
+float TrackTable::Gain(TrackId id) const
+{
+	const Record& record = records_[id];
+	return (record.flags & kAnalyzed) ? powf(10.0f, record.gainMb / 2000.0f) : 1.0f;
+}
+
+size_t TrackTable::MemoryBytes() const
+{
+	return records_.capacity() * sizeof(Record) + free_.capacity() * sizeof(TrackId) +
+	       order_.capacity() * sizeof(TrackId) + arena_.capacity() +
+	       (directories_.capacity() + directory_order_.capacity()) * sizeof(uint32_t);
+}
+
+void TrackTable::ShrinkToFit()
+{
+	records_.shrink_to_fit();
+	free_.shrink_to_fit();
+	order_.shrink_to_fit();
+	arena_.shrink_to_fit();
+	directories_.shrink_to_fit();
+	directory_order_.shrink_to_fit();
+}
+
+void TrackTable::Swap(TrackTable* other)
+{
+	records_.swap(other->records_);
+	free_.swap(other->free_);
+	order_.swap(other->order_);
+	arena_.swap(other->arena_);
+	std::swap(garbage_, other->garbage_);
+	directories_.swap(other->directories_);
+	directory_order_.swap(other->directory_order_);
+}
+
+uint32_t TrackTable::AddString(const std::string& value)
+{
+	if (value.empty())
+		return 0;
+	uint32_t offset = arena_.size();
+	arena_.insert(arena_.end(), value.c_str(), value.c_str() + value.size() + 1);
+	return offset;
+}
+
+void TrackTable::DropStrings(const Record& record)
+{
+	for (uint32_t offset : { record.name, record.title, record.artist }) {
+		if (offset != 0)
+			garbage_ += strlen(String(offset)) + 1;
+	}
+}
+
+uint32_t TrackTable::InternDirectory(const std::string& directory)
+{
+	auto it = std::lower_bound(directory_order_.begin(), directory_order_.end(), directory,
+		[this](uint32_t index, const std::string& d) {
+			return strcmp(String(directories_[index]), d.c_str()) < 0;
+		});
+	if (it != directory_order_.end() && directory == String(directories_[*it]))
+		return *it;
+	uint32_t index = directories_.size();
+	directories_.push_back(AddString(directory));
+	directory_order_.insert(it, index);
+	return index;
+}
+
+int TrackTable::Compare(TrackId a, TrackId b) const
+{
+	const Record& ra = records_[a];
+	const Record& rb = records_[b];
+	if (ra.directory == rb.directory)
+		return strcmp(String(ra.name), String(rb.name));
+	return CompareJoined(String(directories_[ra.directory]), String(ra.name),
+	                     String(directories_[rb.directory]), String(rb.name));
+}
+
+int TrackTable::Compare(TrackId id, const std::string& path) const
+{
+	const Record& record = records_[id];
+	return CompareJoined(String(directories_[record.directory]), String(record.name),
+	                     path.c_str(), nullptr);
+}
+
+void TrackTable::Fill(Record* record, const TrackInfo& info)
+{
+	size_t slash = info.path.rfind('/') + 1;
+	record->directory = InternDirectory(info.path.substr(0, slash));
+	record->name = AddString(info.path.substr(slash));
+	record->title = AddString(info.title);
+	record->artist = AddString(info.artist);
+	record->stamp = info.Stamp();
+	record->durationMs = info.durationMs;
+	record->gainMb = info.gainMb;
+	record->flags = kLive | (info.analyzed ? kAnalyzed : 0);
+}
+
+/* copies the strings still used into a new arena, the directories first
+   so that their indices stay */
+void TrackTable::MaybeCompact()
+{
+	if (arena_.size() < kMinCompactBytes || garbage_ < arena_.size() / 2)
+		return;
+	std::vector<char> old;
+	old.swap(arena_);
+	arena_.reserve(old.size() - garbage_);
+	arena_.push_back('\0');
+	for (auto& offset : directories_)
+		offset = AddString(&old[offset]);
+	for (auto& record : records_) {
+		if (!(record.flags & kLive))
+			continue;
+		record.name = AddString(&old[record.name]);
+		record.title = record.title ? AddString(&old[record.title]) : 0;
+		record.artist = record.artist ? AddString(&old[record.artist]) : 0;
+	}
+	garbage_ = 0;
+}
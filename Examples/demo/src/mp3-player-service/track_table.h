@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MP3_PLAYER_TRACK_TABLE_H_
+#define MP3_PLAYER_TRACK_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+
+#include "library_index.h"
+
+/* The tracks of the library as the player keeps them, compactly enough for
+ * libraries of 100k tracks.
+ *
+ * A track is a fixed record addressed by a 32-bit id that stays the same
+ * while the track is in the table. Its strings live in one arena: the
+ * directories are interned, so a track holds the offsets of its file name,
+ * title and artist and the index of its directory. The ids are also kept
+ * in path order, which is the order of the playlist.
+ *
+ * Updating a track leaves its old strings behind in the arena; it is
+ * compacted once those make up half of it. */
+class TrackTable final {
+public:
+	using TrackId = uint32_t;
+	static const TrackId kNoTrack = UINT32_MAX;
+
+	TrackTable();
+
+	size_t size() const { return order_.size(); }
+	bool empty() const { return order_.empty(); }
+	/* the track at a position of the path order */
+	TrackId At(size_t position) const { return order_[position]; }
+	/* the position of a track of the table in the path order */
+	size_t PositionOf(TrackId id) const;
+	/* kNoTrack if the path is not in the table */
+	TrackId Find(const std::string& path) const;
+	bool Contains(TrackId id) const;
+
+	/* adds the track or updates the one with its path, which keeps its id;
+	   added tells which of the two it was */
+	TrackId Put(const TrackInfo& info, bool* added);
+	void Remove(TrackId id);
+	void SetGain(TrackId id, int32_t gainMb);
+	/* the first track from the position on, wrapping around, that has not
+	   been analyzed, kNoTrack if there is none; the position is left there
+	   so that the next search starts from it */
+	TrackId NextUnanalyzed(size_t* position) const;
+
+	std::string Path(TrackId id) const;
+	/* as TrackInfo::DisplayName() */
+	std::string DisplayName(TrackId id) const;
+	int32_t DurationMs(TrackId id) const { return records_[id].durationMs; }
+	/* as TrackInfo::Gain() */
+	float Gain(TrackId id) const;
+	/* as TrackInfo::Stamp() */
+	uint32_t Stamp(TrackId id) const { return records_[id].stamp; }
+	/* the strings of a track, empty when it has none; valid until the table
+	   changes */
+	const char* Name(TrackId id) const { return String(records_[id].name); }
+	const char* Title(TrackId id) const { return String(records_[id].title); }
+	const char* Artist(TrackId id) const { return String(records_[id].artist); }
+
+	/* the heap memory of the table */
+	size_t MemoryBytes() const;
+	/* gives back the memory reserved for growth, after a bulk load */
+	void ShrinkToFit();
+	/* exchanges the tracks of the two tables, ids included, so that a
+	   table filled on another thread is taken over */
+	void Swap(TrackTable* other);
+
+private:
+	enum Flags : uint8_t {
+		kLive = 1,
+		kAnalyzed = 2,
+	};
+	/* 28 bytes */
+	struct Record {
+		uint32_t directory;
+		/* offsets into the arena, 0 for an empty string */
+		uint32_t name;
+		uint32_t title;
+		uint32_t artist;
+		uint32_t stamp;
+		int32_t durationMs;
+		/* millibels, the analysis keeps them within -24..+12 dB */
+		int16_t gainMb;
+		uint8_t flags;
+	};
+
+	const char* String(uint32_t offset) const { return &arena_[offset]; }
+	uint32_t AddString(const std::string& value);
+	void DropStrings(const Record& record);
+	uint32_t InternDirectory(const std::string& directory);
+	/* as strcmp() of the paths */
+	int Compare(TrackId a, TrackId b) const;
+	int Compare(TrackId id, const std::string& path) const;
+	void Fill(Record* record, const TrackInfo& info);
+	void MaybeCompact();
+
+	std::vector<Record> records_;
+	/* the ids of removed tracks, reused first */
+	std::vector<TrackId> free_;
+	/* the live ids by path */
+	std::vector<TrackId> order_;
+	/* NUL terminated strings, starting with an empty one */
+	std::vector<char> arena_;
+	/* the bytes of strings no longer used */
+	size_t garbage_ = 0;
+	/* arena offsets of the directories, and their indices by path */
+	std::vector<uint32_t> directories_;
+	std::vector<uint32_t> directory_order_;
+
+	DISALLOW_COPY_AND_ASSIGN(TrackTable);
+};
+
+#endif
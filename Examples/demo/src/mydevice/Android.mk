@@ -21,7 +21,9 @@ LOCAL_INIT_RC := mydevice.rc
 LOCAL_CFLAGS := -Wall -Werror -Wno-unused-parameter
 
 LOCAL_SRC_FILES :=	\
+	command_queue.cpp	\
 	mydevice.cpp	\
+	state_publisher.cpp	\
 
 LOCAL_SHARED_LIBRARIES := \
 	libbinder \
@@ -30,12 +32,36 @@ LOCAL_SHARED_LIBRARIES := \
 	libbrillo-binder \
 	libbrillo-stream \
 	libchrome \
+	libcutils \
 	libhardware \
 	libutils \
 	libweaved \
 
 LOCAL_STATIC_LIBRARIES := \
+	libdemo-metrics \
 	libon-off-service \
 	libmp3-player-service \
 
 include $(BUILD_EXECUTABLE)
+
+# Unit tests, run on the device with
+#   adb shell /data/nativetest/mydevice_unittests/mydevice_unittests
+include $(CLEAR_VARS)
+LOCAL_MODULE := mydevice_unittests
+LOCAL_CFLAGS := -Wall -Werror -Wno-unused-parameter
+# the commands of libweaved are only created by the weaved device
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/tests/fake
+LOCAL_SRC_FILES := \
+	command_queue.cpp \
+	tests/command_queue_unittest.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libbinder \
+	libchrome \
+	libcutils \
+	libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+	libdemo-metrics \
+
+include $(BUILD_NATIVE_TEST)
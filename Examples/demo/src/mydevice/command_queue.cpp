@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "command_queue.h"
+
+#include <base/logging.h>
+
+#include "metrics.h"
+#include "trace.h"
+
+void CommandQueue::Push(const std::string& kind, std::unique_ptr<weaved::Command> command,
+                        const Executor& executor, Coalesce coalesce)
+{
+	std::unique_ptr<Entry> entry(new Entry);
+	entry->kind = kind;
+	entry->coalesce = coalesce;
+	entry->id = trace::NewId();
+	entry->trace_name = "command." + trait_ + "." + kind;
+	entry->command = std::move(command);
+	entry->executor = executor;
+	entry->received_us = metrics::NowUs();
+	trace::Mark("command.received", entry->id);
+	trace::AsyncBegin(entry->trace_name.c_str(), entry->id);
+
+	/* the newest command goes last, so the order across kinds is kept */
+	for (auto it = waiting_.begin(); it != waiting_.end(); ++it) {
+		if ((*it)->kind != kind || coalesce == Coalesce::kEach ||
+		    (*it)->coalesce == Coalesce::kEach)
+			continue;
+		LOG(INFO) << "Superseding the pending '" << kind << "' command";
+		metrics::Registry::Get()->GetCounter(
+			"command." + trait_ + "." + kind + ".superseded")->Increment();
+		entry->superseded = std::move((*it)->superseded);
+		if ((*it)->command)
+			entry->superseded.push_back(std::move((*it)->command));
+		EndTrace(**it);
+		waiting_.erase(it);
+		break;
+	}
+	waiting_.push_back(std::move(entry));
+	RunNext();
+}
+
+void CommandQueue::Complete()
+{
+	std::unique_ptr<Entry> entry = TakeCurrent();
+	if (!entry)
+		return;
+	ReportOutcome(entry.get(), [](weaved::Command* command) {
+		command->Complete({}, nullptr);
+	});
+	RunNext();
+}
+
+void CommandQueue::Abort(const std::string& code, const std::string& message)
+{
+	std::unique_ptr<Entry> entry = TakeCurrent();
+	if (!entry)
+		return;
+	ReportOutcome(entry.get(), [&code, &message](weaved::Command* command) {
+		command->Abort(code, message, nullptr);
+	});
+	RunNext();
+}
+
+void CommandQueue::AbortWithCustomError(const android::binder::Status& status)
+{
+	std::unique_ptr<Entry> entry = TakeCurrent();
+	if (!entry)
+		return;
+	ReportOutcome(entry.get(), [&status](weaved::Command* command) {
+		command->AbortWithCustomError(status, nullptr);
+	});
+	RunNext();
+}
+
+void CommandQueue::AbortAll(const std::string& code, const std::string& message)
+{
+	std::deque<std::unique_ptr<Entry>> waiting;
+	waiting.swap(waiting_);
+	Abort(code, message);
+	for (auto& entry : waiting) {
+		EndTrace(*entry);
+		ReportOutcome(entry.get(), [&code, &message](weaved::Command* command) {
+			command->Abort(code, message, nullptr);
+		});
+	}
+}
+
+bool CommandQueue::Pending(const std::string& kind) const
+{
+	if (current_ && current_->kind == kind)
+		return true;
+	for (const auto& entry : waiting_) {
+		if (entry->kind == kind)
+			return true;
+	}
+	return false;
+}
+
+template <typename Report>
+void CommandQueue::ReportOutcome(Entry* entry, Report report)
+{
+	for (auto& command : entry->superseded)
+		report(command.get());
+	if (entry->command)
+		report(entry->command.get());
+}
+
+void CommandQueue::RunNext()
+{
+	if (current_ || waiting_.empty())
+		return;
+	current_ = std::move(waiting_.front());
+	waiting_.pop_front();
+	/* the executor may report the outcome right away */
+	current_->executor.Run(current_->command.get(), current_->id);
+}
+
+std::unique_ptr<CommandQueue::Entry> CommandQueue::TakeCurrent()
+{
+	if (current_) {
+		/* from the arrival of the command to its outcome */
+		metrics::Registry::Get()->GetHistogram("command." + trait_ + "." + current_->kind)
+			->Record(metrics::NowUs() - current_->received_us);
+		EndTrace(*current_);
+	}
+	return std::move(current_);
+}
+
+void CommandQueue::EndTrace(const Entry& entry)
+{
+	trace::AsyncEnd(entry.trace_name.c_str(), entry.id);
+}
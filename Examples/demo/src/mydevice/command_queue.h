@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MYDEVICE_COMMAND_QUEUE_H_
+#define MYDEVICE_COMMAND_QUEUE_H_
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <binder/Status.h>
+#include <libweaved/command.h>
+
+/* Runs the Weave commands of one trait one at a time.
+ *
+ * While a command is executing, newly arrived commands wait. A waiting
+ * command is superseded by a newer one of the same kind, so a burst of
+ * volume changes applies only the last value. The superseded commands get
+ * the outcome of the command that replaced them. Commands that are not
+ * idempotent, such as a skip to the next track, are pushed with kEach:
+ * they all run, in their order of arrival. */
+class CommandQueue final {
+public:
+	/* starts executing a command, the outcome is reported to the queue
+	   with Complete() or Abort*(); the id given on arrival tags the trace
+	   points of the command across the processes */
+	using Executor = base::Callback<void(weaved::Command*, int32_t id)>;
+
+	/* whether a newer command of the same kind replaces a waiting one */
+	enum class Coalesce { kLatestWins, kEach };
+
+	/* the trait name prefixes the latency metrics of its commands */
+	explicit CommandQueue(const std::string& trait) : trait_(trait) {}
+
+	/* the command is null for a request of the daemon itself, which is
+	   queued with the commands but has no outcome to report */
+	void Push(const std::string& kind, std::unique_ptr<weaved::Command> command,
+	          const Executor& executor, Coalesce coalesce = Coalesce::kLatestWins);
+
+	/* outcome of the executing command */
+	void Complete();
+	void Abort(const std::string& code, const std::string& message);
+	void AbortWithCustomError(const android::binder::Status& status);
+
+	/* aborts the executing and all the waiting commands */
+	void AbortAll(const std::string& code, const std::string& message);
+
+	bool busy() const { return current_.get() != nullptr; }
+	/* whether a command of the kind is executing or waiting */
+	bool Pending(const std::string& kind) const;
+
+private:
+	struct Entry {
+		std::string kind;
+		Coalesce coalesce;
+		int32_t id;
+		std::string trace_name;
+		std::unique_ptr<weaved::Command> command;
+		std::vector<std::unique_ptr<weaved::Command>> superseded;
+		Executor executor;
+		int64_t received_us;
+	};
+	void RunNext();
+	/* reports the outcome to the command and those it superseded */
+	template <typename Report>
+	static void ReportOutcome(Entry* entry, Report report);
+	std::unique_ptr<Entry> TakeCurrent();
+	static void EndTrace(const Entry& entry);
+
+	const std::string trait_;
+	std::unique_ptr<Entry> current_;
+	std::deque<std::unique_ptr<Entry>> waiting_;
+
+	DISALLOW_COPY_AND_ASSIGN(CommandQueue);
+};
+
+#endif
@@ -14,8 +14,9 @@
  * limitations under the License.
  */
 #include <unistd.h>
-#include <codecvt>
+#include <signal.h>
 #include <sysexits.h>
+#include <map>
 
 #include <base/logging.h>
 #include <base/command_line.h>
@@ -24,6 +25,7 @@
 #include <binderwrapper/binder_wrapper.h>
 #include <brillo/binder_watcher.h>
 #include <brillo/daemons/daemon.h>
+#include <brillo/message_loops/message_loop.h>
 #include <brillo/syslog_logging.h>
 #include <libweaved/service.h>
 
@@ -31,15 +33,60 @@
 #include "on-off-service.h"
 using brillo::demo::IOnOffService;
 
+#include "brillo/demo/BnMp3PlayerListener.h"
 #include "brillo/demo/BnMp3PlayerService.h"
 #include "mp3-player-service.h"
+#include "player_snapshot.h"
 using brillo::demo::IMp3PlayerService;
+using brillo::demo::PlayerSnapshot;
+
+#include "command_queue.h"
+#include "metrics.h"
+#include "service_client.h"
+#include "startup_profile.h"
+#include "state_publisher.h"
+#include "trace.h"
 
 namespace {
 	const char Welcome[] = "     Brillo Jukebox demo running on Minnowboard";
+	const char Loading[] = "     Loading the music library...";
 	const char kWeaveComponent[] = "mydevice";
+	/* the position moves on its own while playing, it is published at
+	   this pace so that progress does not flood weaved */
+	const int kPositionPublishIntervalSec = 10;
 }
 
+/* Receives the events pushed by the MP3 player service. The callbacks are
+   dispatched on the message loop by the binder watcher. */
+class Mp3PlayerListener : public brillo::demo::BnMp3PlayerListener {
+public:
+	using StateChangedCallback = base::Callback<void(const PlayerSnapshot&)>;
+	using RequestCompletedCallback =
+		base::Callback<void(int32_t, int32_t, const std::string&)>;
+	Mp3PlayerListener(const StateChangedCallback& on_state_changed,
+	                  const base::Closure& on_end_of_stream,
+	                  const RequestCompletedCallback& on_request_completed)
+		: on_state_changed_(on_state_changed), on_end_of_stream_(on_end_of_stream),
+		  on_request_completed_(on_request_completed) {}
+	android::binder::Status onStateChanged(const PlayerSnapshot& snapshot) {
+		on_state_changed_.Run(snapshot);
+		return android::binder::Status::ok();
+	}
+	android::binder::Status onEndOfStream() {
+		on_end_of_stream_.Run();
+		return android::binder::Status::ok();
+	}
+	android::binder::Status onRequestCompleted(int32_t request_id, int32_t error,
+	                                           const ::android::String16& message) {
+		on_request_completed_.Run(request_id, error, ::android::String8(message).string());
+		return android::binder::Status::ok();
+	}
+private:
+	StateChangedCallback on_state_changed_;
+	base::Closure on_end_of_stream_;
+	RequestCompletedCallback on_request_completed_;
+};
+
 class DeviceDaemon final : public brillo::Daemon {
 public:
 	DeviceDaemon() = default;
@@ -47,24 +94,50 @@ protected:
 	int OnInit() override;
 	void OnWeaveServiceConnected(const std::weak_ptr<weaved::Service>& service);
 	void OnPairingInfoChanged(const weaved::Service::PairingInfo* pairing_info);
+	void OnOnOffServiceConnected();
 	void OnOnOffServiceDisconnected();
+	void OnMp3PlayerServiceConnected();
 	void OnMp3PlayerServiceDisconnected();
 
 	void UpdateDeviceState();
 	void UpdateOnOffTraitState();
 	void UpdateMediaPlayerTraitState();
+	void PublishMediaPlayerTraitState(const PlayerSnapshot& snapshot);
+	void SchedulePositionUpdate(bool playing);
 
-	void ConnectToOnOffService();
-	void ConnectToMp3PlayerService();
-	void TrackMp3PlayerReachedEOS();
+	void OnMp3PlayerEndOfStream();
 	// Command handlers
 	void OnSetConfig(std::unique_ptr<weaved::Command> command);
 	void OnMp3Play(std::unique_ptr<weaved::Command> command);
 	void OnMp3Pause(std::unique_ptr<weaved::Command> command);
 	void OnMp3Stop(std::unique_ptr<weaved::Command> command);
+	void OnMp3Seek(std::unique_ptr<weaved::Command> command);
+	void OnMp3SetCrossfade(std::unique_ptr<weaved::Command> command);
+	void OnMp3Next(std::unique_ptr<weaved::Command> command);
+	void OnMp3Previous(std::unique_ptr<weaved::Command> command);
+	void OnMp3SetShuffle(std::unique_ptr<weaved::Command> command);
+	void OnMp3PlayByName(std::unique_ptr<weaved::Command> command);
 	void OnMp3SetVolume(std::unique_ptr<weaved::Command> command);
 
+	// Asynchronous MP3 player requests, one at a time per trait
+	void ExecuteMp3Play(weaved::Command* command, int32_t id);
+	void ExecuteMp3Advance(weaved::Command* command, int32_t id);
+	void ExecuteMp3Pause(weaved::Command* command, int32_t id);
+	void ExecuteMp3Stop(weaved::Command* command, int32_t id);
+	void ExecuteMp3Seek(weaved::Command* command, int32_t id);
+	void ExecuteMp3SetCrossfade(weaved::Command* command, int32_t id);
+	void ExecuteMp3Next(weaved::Command* command, int32_t id);
+	void ExecuteMp3Previous(weaved::Command* command, int32_t id);
+	void ExecuteMp3SetShuffle(weaved::Command* command, int32_t id);
+	void ExecuteMp3PlayByName(weaved::Command* command, int32_t id);
+	void ExecuteMp3SetVolume(weaved::Command* command, int32_t id);
+	bool StartMp3Request(CommandQueue* queue, int32_t request_id);
+	void OnMp3RequestSent(int32_t request_id, const android::binder::Status& status);
+	void OnMp3RequestCompleted(int32_t request_id, int32_t error, const std::string& message);
+	void AbortPendingMp3Commands();
+
 	void SetDisplay(std::string msg);
+	bool OnDumpMetrics(const struct signalfd_siginfo& info);
 private:
 	/* the bridge between libbinder and brillo::MessageLoop */
 	brillo::BinderWatcher binder_watcher_;
@@ -72,12 +145,23 @@ private:
 	std::unique_ptr<weaved::Service::Subscription> weave_service_subscription_;
 	/* the service instance */
 	std::weak_ptr<weaved::Service> weave_service_;
+	/* publishes the changed trait state properties */
+	StatePublisher state_publisher_{::kWeaveComponent};
 
 	/* the On/Off service interface */
-	android::sp<IOnOffService> on_off_service_;
+	ServiceClient<IOnOffService> on_off_service_{on_off_service::kBinderServiceName};
 	/* the MP3 player service interface */
-	android::sp<IMp3PlayerService> mp3_player_service_;
+	ServiceClient<IMp3PlayerService> mp3_player_service_{mp3_player_service::kBinderServiceName};
+	/* the listener registered to the MP3 player service */
+	android::sp<Mp3PlayerListener> mp3_player_listener_;
 	std::string mp3_current_playing;
+	/* refreshes the published position while playing */
+	brillo::MessageLoop::TaskId mp3_position_task_ = brillo::MessageLoop::kTaskIdNull;
+	/* the _mediaplayer and volume trait commands */
+	CommandQueue mp3_player_queue_{mp3_player_service::kWeaveTrait};
+	CommandQueue mp3_volume_queue_{mp3_player_service::kVolumeTrait};
+	/* the queue waiting for the outcome of each asynchronous request */
+	std::map<int32_t, CommandQueue*> mp3_requests_;
 
 	base::WeakPtrFactory<DeviceDaemon> weak_ptr_factory_{this};
 	DISALLOW_COPY_AND_ASSIGN(DeviceDaemon);
@@ -85,10 +169,15 @@ private:
 
 int DeviceDaemon::OnInit()
 {
+	startup::Milestone("oninit.begin");
 	int rc;
 	if ((rc = brillo::Daemon::OnInit()) != EX_OK)
 		return rc;
 
+	/* kill -USR1 writes the metrics to the log */
+	RegisterHandler(SIGUSR1,
+		base::Bind(&DeviceDaemon::OnDumpMetrics, base::Unretained(this)));
+
 	/* Create and initialize the singleton for communicating with the real binder system */
 	android::BinderWrapper::Create();
 	if (!binder_watcher_.Init())
@@ -99,17 +188,29 @@ int DeviceDaemon::OnInit()
 		brillo::MessageLoop::current(),
 		base::Bind(&DeviceDaemon::OnWeaveServiceConnected, weak_ptr_factory_.GetWeakPtr()));
 
-	ConnectToOnOffService();
-	ConnectToMp3PlayerService();
+	mp3_player_listener_ = new Mp3PlayerListener(
+		base::Bind(&DeviceDaemon::PublishMediaPlayerTraitState, weak_ptr_factory_.GetWeakPtr()),
+		base::Bind(&DeviceDaemon::OnMp3PlayerEndOfStream, weak_ptr_factory_.GetWeakPtr()),
+		base::Bind(&DeviceDaemon::OnMp3RequestCompleted, weak_ptr_factory_.GetWeakPtr()));
 
+	on_off_service_.Connect(
+		base::Bind(&DeviceDaemon::OnOnOffServiceConnected, weak_ptr_factory_.GetWeakPtr()),
+		base::Bind(&DeviceDaemon::OnOnOffServiceDisconnected, weak_ptr_factory_.GetWeakPtr()));
+	mp3_player_service_.Connect(
+		base::Bind(&DeviceDaemon::OnMp3PlayerServiceConnected, weak_ptr_factory_.GetWeakPtr()),
+		base::Bind(&DeviceDaemon::OnMp3PlayerServiceDisconnected, weak_ptr_factory_.GetWeakPtr()));
+
+	startup::Milestone("oninit.end");
 	return EX_OK;
 }
 
 void DeviceDaemon::OnWeaveServiceConnected(const std::weak_ptr<weaved::Service>& service)
 {
 	LOG(INFO) << "DeviceDaemon::OnWeaveServiceConnected";
+	startup::Milestone("weave.connected");
 	/* upon connection the service instance is passed to the callback */
 	weave_service_ = service;
+	state_publisher_.SetService(service);
 	auto weave_service = weave_service_.lock();
 	if (!weave_service)
 		return;
@@ -129,6 +230,24 @@ void DeviceDaemon::OnWeaveServiceConnected(const std::weak_ptr<weaved::Service>&
 	weave_service->AddCommandHandler(
 		::kWeaveComponent, mp3_player_service::kWeaveTrait, "stop",
 		base::Bind(&DeviceDaemon::OnMp3Stop, weak_ptr_factory_.GetWeakPtr()));
+	weave_service->AddCommandHandler(
+		::kWeaveComponent, mp3_player_service::kWeaveTrait, "seek",
+		base::Bind(&DeviceDaemon::OnMp3Seek, weak_ptr_factory_.GetWeakPtr()));
+	weave_service->AddCommandHandler(
+		::kWeaveComponent, mp3_player_service::kWeaveTrait, "setCrossfade",
+		base::Bind(&DeviceDaemon::OnMp3SetCrossfade, weak_ptr_factory_.GetWeakPtr()));
+	weave_service->AddCommandHandler(
+		::kWeaveComponent, mp3_player_service::kWeaveTrait, "next",
+		base::Bind(&DeviceDaemon::OnMp3Next, weak_ptr_factory_.GetWeakPtr()));
+	weave_service->AddCommandHandler(
+		::kWeaveComponent, mp3_player_service::kWeaveTrait, "previous",
+		base::Bind(&DeviceDaemon::OnMp3Previous, weak_ptr_factory_.GetWeakPtr()));
+	weave_service->AddCommandHandler(
+		::kWeaveComponent, mp3_player_service::kWeaveTrait, "setShuffle",
+		base::Bind(&DeviceDaemon::OnMp3SetShuffle, weak_ptr_factory_.GetWeakPtr()));
+	weave_service->AddCommandHandler(
+		::kWeaveComponent, mp3_player_service::kWeaveTrait, "playByName",
+		base::Bind(&DeviceDaemon::OnMp3PlayByName, weak_ptr_factory_.GetWeakPtr()));
 	weave_service->AddCommandHandler(
 		::kWeaveComponent, mp3_player_service::kVolumeTrait, "setConfig",
 		base::Bind(&DeviceDaemon::OnMp3SetVolume, weak_ptr_factory_.GetWeakPtr()));
@@ -153,20 +272,10 @@ void DeviceDaemon::UpdateDeviceState()
 	UpdateMediaPlayerTraitState();
 }
 
-void DeviceDaemon::ConnectToOnOffService()
+void DeviceDaemon::OnOnOffServiceConnected()
 {
-	android::BinderWrapper* binder_wrapper = android::BinderWrapper::Get();
-	auto binder = binder_wrapper->GetService(on_off_service::kBinderServiceName);
-	if (!binder.get()) {
-		brillo::MessageLoop::current()->PostDelayedTask(
-			base::Bind(&DeviceDaemon::ConnectToOnOffService, weak_ptr_factory_.GetWeakPtr()),
-			base::TimeDelta::FromMilliseconds(500));
-		return;
-	}
 	LOG(INFO) << "DeviceDaemon::OnOffServiceConnected";
-	binder_wrapper->RegisterForDeathNotifications(binder,
-		base::Bind(&DeviceDaemon::OnOnOffServiceDisconnected, weak_ptr_factory_.GetWeakPtr()));
-	on_off_service_ = android::interface_cast<IOnOffService>(binder);
+	startup::Milestone("peer.onOff.connected");
 	SetDisplay(::Welcome);
 	UpdateOnOffTraitState();
 }
@@ -174,8 +283,6 @@ void DeviceDaemon::ConnectToOnOffService()
 void DeviceDaemon::OnOnOffServiceDisconnected()
 {
 	LOG(INFO) << "DeviceDaemon::OnOnOffServiceDisconnected";
-	on_off_service_ = nullptr;
-	ConnectToOnOffService();
 }
 
 void DeviceDaemon::UpdateOnOffTraitState()
@@ -183,23 +290,23 @@ void DeviceDaemon::UpdateOnOffTraitState()
 	LOG(INFO) << "DeviceDaemon::UpdateOnOffTraitState";
 	if (on_off_service_.get()) {
 		bool flag = false;
-		android::binder::Status status = on_off_service_->getState(&flag);
+		android::binder::Status status;
+		{
+			METRICS_SCOPED_TIMER("binder.onOff.getState");
+			status = on_off_service_->getState(&flag);
+		}
 		std::string output_string = "off";
 		if (status.isOk() && flag)
 			output_string = "on";
-
-		auto weave_service = weave_service_.lock();
-		if (!weave_service)
-			return;
-
-		base::DictionaryValue state_change;
-		state_change.SetString("onOff.state", output_string);
-		weave_service->SetStateProperties(::kWeaveComponent, state_change, nullptr);
+		state_publisher_.SetString("onOff.state", output_string);
 	}
 }
 
 void DeviceDaemon::OnSetConfig(std::unique_ptr<weaved::Command> command)
 {
+	METRICS_SCOPED_TIMER("command.onOff.setConfig");
+	int32_t id = trace::NewId();
+	trace::Mark("command.received", id);
 	std::string state = command->GetParameter<std::string>("state");
 	LOG(INFO) << "Received command to set the device state to " << state;
 
@@ -208,7 +315,12 @@ void DeviceDaemon::OnSetConfig(std::unique_ptr<weaved::Command> command)
 		return;
 	}
 	bool flag = !state.compare("on");
-	android::binder::Status status = on_off_service_->setState(flag);
+	android::binder::Status status;
+	{
+		METRICS_SCOPED_TIMER("binder.onOff.setState");
+		trace::Mark("onOff.send", id);
+		status = on_off_service_->setState(flag, id);
+	}
 	if (!status.isOk()) {
 		command->AbortWithCustomError(status, nullptr);
 		return;
@@ -221,175 +333,314 @@ void DeviceDaemon::OnSetConfig(std::unique_ptr<weaved::Command> command)
 void DeviceDaemon::SetDisplay(std::string msg)
 {
 	if (on_off_service_.get()) {
+		METRICS_SCOPED_TIMER("binder.onOff.setDisplay");
 		on_off_service_->setDisplay(::android::String16(msg.c_str()));
 	}
 }
 
-void DeviceDaemon::ConnectToMp3PlayerService()
+void DeviceDaemon::OnMp3PlayerServiceConnected()
 {
-	android::BinderWrapper* binder_wrapper = android::BinderWrapper::Get();
-	auto binder = binder_wrapper->GetService(mp3_player_service::kBinderServiceName);
-	if (!binder.get()) {
-		brillo::MessageLoop::current()->PostDelayedTask(
-			base::Bind(&DeviceDaemon::ConnectToMp3PlayerService, weak_ptr_factory_.GetWeakPtr()),
-			base::TimeDelta::FromMilliseconds(500));
-		return;
-	}
 	LOG(INFO) << "DeviceDaemon::Mp3PlayerServiceConnected";
-	binder_wrapper->RegisterForDeathNotifications(binder,
-		base::Bind(&DeviceDaemon::OnMp3PlayerServiceDisconnected, weak_ptr_factory_.GetWeakPtr()));
-	mp3_player_service_ = android::interface_cast<IMp3PlayerService>(binder);
-	TrackMp3PlayerReachedEOS();
+	startup::Milestone("peer.mp3.connected");
+	mp3_player_service_->registerListener(mp3_player_listener_);
 	UpdateMediaPlayerTraitState();
 }
 
-void DeviceDaemon::TrackMp3PlayerReachedEOS()
+void DeviceDaemon::OnMp3PlayerEndOfStream()
 {
-	if (mp3_player_service_.get()) {
-		bool eos = true;
-		android::binder::Status status = mp3_player_service_->reachedEOS(&eos);
-		if (status.isOk() && mp3_current_playing.compare("-") != 0 && eos) {
-			LOG(INFO) << "Advance to next track due to end of stream";
-			status = mp3_player_service_->stop();
-			if (status.isOk())
-				status = mp3_player_service_->play();
-			UpdateMediaPlayerTraitState();
-		}
+	if (!mp3_player_service_.get() || mp3_current_playing.compare("-") == 0)
+		return;
+	/* a stop or pause of the user, waiting or under way, wins over the
+	   advance */
+	if (mp3_player_queue_.Pending("stop") || mp3_player_queue_.Pending("pause")) {
+		LOG(INFO) << "End of stream while stopping, not advancing";
+		return;
 	}
-	brillo::MessageLoop::current()->PostDelayedTask(
-		base::Bind(&DeviceDaemon::TrackMp3PlayerReachedEOS, weak_ptr_factory_.GetWeakPtr()),
-		base::TimeDelta::FromSeconds(3));
+	LOG(INFO) << "Advance to next track due to end of stream";
+	/* queued behind the commands already sent, and ahead of those to come */
+	mp3_player_queue_.Push("advance", nullptr,
+		base::Bind(&DeviceDaemon::ExecuteMp3Advance, weak_ptr_factory_.GetWeakPtr()));
 }
 
 void DeviceDaemon::OnMp3PlayerServiceDisconnected()
 {
 	LOG(INFO) << "DeviceDaemon::OnMp3PlayerServiceDisconnected";
-	mp3_player_service_ = nullptr;
-	ConnectToMp3PlayerService();
+	AbortPendingMp3Commands();
 }
 
 void DeviceDaemon::UpdateMediaPlayerTraitState()
 {
 	LOG(INFO) << "DeviceDaemon::UpdateMediaPlayerTraitState";
 	if (mp3_player_service_.get()) {
-		::android::String16 player_info;
-		android::binder::Status status = mp3_player_service_->status(&player_info);
-		std::string player_state("unknown");
-		if (status.isOk()) {
-			std::wstring_convert<std::codecvt_utf8_utf16<char16_t>,char16_t> convert;
-			player_state = convert.to_bytes(player_info.string());
-			if (player_state.compare("idle") == 0) {
-				SetDisplay(::Welcome);
-				mp3_current_playing = "-";
-			} else if (player_state.compare("paused") != 0) {
-				mp3_current_playing = player_state;
-				SetDisplay("     Playing: " + mp3_current_playing);
-				player_state = "playing";
-			}
+		PlayerSnapshot snapshot;
+		android::binder::Status status;
+		{
+			METRICS_SCOPED_TIMER("binder.mp3.getSnapshot");
+			status = mp3_player_service_->getSnapshot(&snapshot);
 		}
+		if (status.isOk())
+			PublishMediaPlayerTraitState(snapshot);
+	}
+}
 
-		float volume = 0;
-		bool mute;
-		status = mp3_player_service_->isMuted(&mute);
-		if (status.isOk()) {
-			mp3_player_service_->getVolume(&volume);
-		}
+void DeviceDaemon::PublishMediaPlayerTraitState(const PlayerSnapshot& snapshot)
+{
+	if (snapshot.state == PlayerSnapshot::WARMING) {
+		SetDisplay(::Loading);
+		mp3_current_playing = "-";
+	} else if (snapshot.state == PlayerSnapshot::IDLE) {
+		SetDisplay(::Welcome);
+		mp3_current_playing = "-";
+	} else if (snapshot.state == PlayerSnapshot::PLAYING) {
+		mp3_current_playing = ::android::String8(snapshot.trackName).string();
+		SetDisplay("     Playing: " + mp3_current_playing);
+	}
 
-		auto weave_service = weave_service_.lock();
-		if (!weave_service)
-			return;
+	state_publisher_.SetString("_mediaplayer.status", snapshot.StateName());
+	state_publisher_.SetString("_mediaplayer.display", mp3_current_playing);
+	state_publisher_.SetInteger("_mediaplayer.positionMs", snapshot.positionMs);
+	state_publisher_.SetInteger("_mediaplayer.durationMs", snapshot.durationMs);
+	state_publisher_.SetInteger("_mediaplayer.crossfadeMs", snapshot.crossfadeMs);
+	state_publisher_.SetBoolean("_mediaplayer.shuffle", snapshot.shuffle);
+	state_publisher_.SetInteger("volume.volume", snapshot.volume * 100);
+	state_publisher_.SetBoolean("volume.isMuted", snapshot.muted);
+	SchedulePositionUpdate(snapshot.state == PlayerSnapshot::PLAYING);
+}
 
-		base::DictionaryValue state_change;
-		state_change.SetString("_mediaplayer.status", player_state);
-		state_change.SetString("_mediaplayer.display", mp3_current_playing);
-		state_change.SetInteger("volume.volume", volume * 100);
-		state_change.SetBoolean("volume.isMuted", mute);
-		weave_service->SetStateProperties(::kWeaveComponent, state_change, nullptr);
-	}
+/* every state change publishes the position, this only covers the time
+   in between */
+void DeviceDaemon::SchedulePositionUpdate(bool playing)
+{
+	if (mp3_position_task_ != brillo::MessageLoop::kTaskIdNull)
+		brillo::MessageLoop::current()->CancelTask(mp3_position_task_);
+	mp3_position_task_ = brillo::MessageLoop::kTaskIdNull;
+	if (!playing)
+		return;
+	mp3_position_task_ = brillo::MessageLoop::current()->PostDelayedTask(
+		base::Bind(&DeviceDaemon::UpdateMediaPlayerTraitState, weak_ptr_factory_.GetWeakPtr()),
+		base::TimeDelta::FromSeconds(::kPositionPublishIntervalSec));
 }
 
 void DeviceDaemon::OnMp3Play(std::unique_ptr<weaved::Command> command)
 {
 	LOG(INFO) << "Start MP3 playing...";
-	if (!mp3_player_service_.get()) {
-		command->Abort("_system_error", "MP3 player service unavailable", nullptr);
-		return;
-	}
-	android::binder::Status status = mp3_player_service_->play();
-	if (!status.isOk()) {
-		command->AbortWithCustomError(status, nullptr);
-		return;
-	}
-	command->Complete({}, nullptr);
-
-	UpdateMediaPlayerTraitState();
+	mp3_player_queue_.Push("play", std::move(command),
+		base::Bind(&DeviceDaemon::ExecuteMp3Play, weak_ptr_factory_.GetWeakPtr()));
 }
 
 void DeviceDaemon::OnMp3Pause(std::unique_ptr<weaved::Command> command)
 {
 	LOG(INFO) << "Pause MP3 playing...";
-	if (!mp3_player_service_.get()) {
-		command->Abort("_system_error", "MP3 player service unavailable", nullptr);
-		return;
-	}
-	android::binder::Status status = mp3_player_service_->pause();
-	if (!status.isOk()) {
-		command->AbortWithCustomError(status, nullptr);
-		return;
-	}
-	command->Complete({}, nullptr);
-
-	UpdateMediaPlayerTraitState();
+	mp3_player_queue_.Push("pause", std::move(command),
+		base::Bind(&DeviceDaemon::ExecuteMp3Pause, weak_ptr_factory_.GetWeakPtr()));
 }
 
 void DeviceDaemon::OnMp3Stop(std::unique_ptr<weaved::Command> command)
 {
 	LOG(INFO) << "Stop MP3 playing...";
-	if (!mp3_player_service_.get()) {
-		command->Abort("_system_error", "MP3 player service unavailable", nullptr);
-		return;
-	}
-	android::binder::Status status = mp3_player_service_->stop();
-	if (!status.isOk()) {
-		command->AbortWithCustomError(status, nullptr);
-		return;
-	}
-	command->Complete({}, nullptr);
+	mp3_player_queue_.Push("stop", std::move(command),
+		base::Bind(&DeviceDaemon::ExecuteMp3Stop, weak_ptr_factory_.GetWeakPtr()));
+}
 
-	UpdateMediaPlayerTraitState();
+void DeviceDaemon::OnMp3Seek(std::unique_ptr<weaved::Command> command)
+{
+	mp3_player_queue_.Push("seek", std::move(command),
+		base::Bind(&DeviceDaemon::ExecuteMp3Seek, weak_ptr_factory_.GetWeakPtr()));
+}
+
+void DeviceDaemon::OnMp3SetCrossfade(std::unique_ptr<weaved::Command> command)
+{
+	mp3_player_queue_.Push("setCrossfade", std::move(command),
+		base::Bind(&DeviceDaemon::ExecuteMp3SetCrossfade, weak_ptr_factory_.GetWeakPtr()));
+}
+
+void DeviceDaemon::OnMp3Next(std::unique_ptr<weaved::Command> command)
+{
+	mp3_player_queue_.Push("next", std::move(command),
+		base::Bind(&DeviceDaemon::ExecuteMp3Next, weak_ptr_factory_.GetWeakPtr()),
+		CommandQueue::Coalesce::kEach);
+}
+
+void DeviceDaemon::OnMp3Previous(std::unique_ptr<weaved::Command> command)
+{
+	mp3_player_queue_.Push("previous", std::move(command),
+		base::Bind(&DeviceDaemon::ExecuteMp3Previous, weak_ptr_factory_.GetWeakPtr()),
+		CommandQueue::Coalesce::kEach);
+}
+
+void DeviceDaemon::OnMp3SetShuffle(std::unique_ptr<weaved::Command> command)
+{
+	mp3_player_queue_.Push("setShuffle", std::move(command),
+		base::Bind(&DeviceDaemon::ExecuteMp3SetShuffle, weak_ptr_factory_.GetWeakPtr()));
+}
+
+void DeviceDaemon::OnMp3PlayByName(std::unique_ptr<weaved::Command> command)
+{
+	mp3_player_queue_.Push("playByName", std::move(command),
+		base::Bind(&DeviceDaemon::ExecuteMp3PlayByName, weak_ptr_factory_.GetWeakPtr()));
 }
 
 void DeviceDaemon::OnMp3SetVolume(std::unique_ptr<weaved::Command> command)
+{
+	mp3_volume_queue_.Push("setConfig", std::move(command),
+		base::Bind(&DeviceDaemon::ExecuteMp3SetVolume, weak_ptr_factory_.GetWeakPtr()));
+}
+
+/* the trait state is refreshed when the service reports the change */
+void DeviceDaemon::ExecuteMp3Play(weaved::Command* command, int32_t id)
+{
+	if (StartMp3Request(&mp3_player_queue_, id))
+		OnMp3RequestSent(id,
+			mp3_player_service_->playAsync(id, mp3_player_listener_));
+}
+
+/* the stop is not tracked, the play after it completes the advance */
+void DeviceDaemon::ExecuteMp3Advance(weaved::Command* command, int32_t id)
+{
+	if (!StartMp3Request(&mp3_player_queue_, id))
+		return;
+	mp3_player_service_->stopAsync(0, mp3_player_listener_);
+	OnMp3RequestSent(id, mp3_player_service_->playAsync(id, mp3_player_listener_));
+}
+
+void DeviceDaemon::ExecuteMp3Pause(weaved::Command* command, int32_t id)
+{
+	if (StartMp3Request(&mp3_player_queue_, id))
+		OnMp3RequestSent(id,
+			mp3_player_service_->pauseAsync(id, mp3_player_listener_));
+}
+
+void DeviceDaemon::ExecuteMp3Stop(weaved::Command* command, int32_t id)
+{
+	if (StartMp3Request(&mp3_player_queue_, id))
+		OnMp3RequestSent(id,
+			mp3_player_service_->stopAsync(id, mp3_player_listener_));
+}
+
+void DeviceDaemon::ExecuteMp3Seek(weaved::Command* command, int32_t id)
+{
+	int position = command->GetParameter<int>("positionMs");
+	LOG(INFO) << "Received command to seek to " << position << " ms";
+	if (StartMp3Request(&mp3_player_queue_, id))
+		OnMp3RequestSent(id, mp3_player_service_->seekAsync(
+			id, mp3_player_listener_, position));
+}
+
+void DeviceDaemon::ExecuteMp3SetCrossfade(weaved::Command* command, int32_t id)
+{
+	int duration = command->GetParameter<int>("durationMs");
+	LOG(INFO) << "Received command to set the crossfade to " << duration << " ms";
+	if (StartMp3Request(&mp3_player_queue_, id))
+		OnMp3RequestSent(id, mp3_player_service_->setCrossfadeAsync(
+			id, mp3_player_listener_, duration));
+}
+
+void DeviceDaemon::ExecuteMp3Next(weaved::Command* command, int32_t id)
+{
+	if (StartMp3Request(&mp3_player_queue_, id))
+		OnMp3RequestSent(id,
+			mp3_player_service_->nextAsync(id, mp3_player_listener_));
+}
+
+void DeviceDaemon::ExecuteMp3Previous(weaved::Command* command, int32_t id)
+{
+	if (StartMp3Request(&mp3_player_queue_, id))
+		OnMp3RequestSent(id,
+			mp3_player_service_->previousAsync(id, mp3_player_listener_));
+}
+
+void DeviceDaemon::ExecuteMp3SetShuffle(weaved::Command* command, int32_t id)
+{
+	bool enabled = command->GetParameter<bool>("enabled");
+	LOG(INFO) << "Received command to turn the shuffle " << (enabled ? "on" : "off");
+	if (StartMp3Request(&mp3_player_queue_, id))
+		OnMp3RequestSent(id, mp3_player_service_->setShuffleAsync(
+			id, mp3_player_listener_, enabled));
+}
+
+void DeviceDaemon::ExecuteMp3PlayByName(weaved::Command* command, int32_t id)
+{
+	std::string query = command->GetParameter<std::string>("query");
+	LOG(INFO) << "Received command to play \"" << query << "\"";
+	if (StartMp3Request(&mp3_player_queue_, id))
+		OnMp3RequestSent(id, mp3_player_service_->playByNameAsync(
+			id, mp3_player_listener_, ::android::String16(query.c_str())));
+}
+
+void DeviceDaemon::ExecuteMp3SetVolume(weaved::Command* command, int32_t id)
 {
 	int level = command->GetParameter<int>("volume");
 	bool mute = command->GetParameter<bool>("isMuted");
 	float volume = mute? 0 : (float)level/100;
 	LOG(INFO) << "Received command to set the audio volume to " << volume;
 
+	if (StartMp3Request(&mp3_volume_queue_, id))
+		OnMp3RequestSent(id, mp3_player_service_->applyVolumeAsync(
+			id, mp3_player_listener_, volume, mute));
+}
+
+/* the id of the command doubles as the request id */
+bool DeviceDaemon::StartMp3Request(CommandQueue* queue, int32_t request_id)
+{
 	if (!mp3_player_service_.get()) {
-		command->Abort("_system_error", "MP3 player service unavailable", nullptr);
-		return;
+		queue->Abort("_system_error", "MP3 player service unavailable");
+		return false;
 	}
-	android::binder::Status status = mp3_player_service_->mute(mute);
-	if (!status.isOk()) {
-		command->AbortWithCustomError(status, nullptr);
+	trace::Mark("mp3.send", request_id);
+	mp3_requests_[request_id] = queue;
+	return true;
+}
+
+void DeviceDaemon::OnMp3RequestSent(int32_t request_id, const android::binder::Status& status)
+{
+	METRICS_COUNT("binder.mp3.oneway");
+	/* a oneway call only fails if the transaction could not be delivered */
+	if (status.isOk())
 		return;
-	}
-	if (!mute)
-		status = mp3_player_service_->setVolume(volume);
-	if (!status.isOk()) {
-		command->AbortWithCustomError(status, nullptr);
+	auto it = mp3_requests_.find(request_id);
+	if (it == mp3_requests_.end())
+		return;
+	CommandQueue* queue = it->second;
+	mp3_requests_.erase(it);
+	queue->AbortWithCustomError(status);
+}
+
+void DeviceDaemon::OnMp3RequestCompleted(int32_t request_id, int32_t error,
+                                         const std::string& message)
+{
+	auto it = mp3_requests_.find(request_id);
+	if (it == mp3_requests_.end())
+		return;
+	trace::Mark("mp3.completed", request_id);
+	CommandQueue* queue = it->second;
+	mp3_requests_.erase(it);
+	if (error == 0) {
+		queue->Complete();
 		return;
 	}
-	command->Complete({}, nullptr);
+	queue->AbortWithCustomError(android::binder::Status::fromServiceSpecificError(
+		error, ::android::String8(message.c_str())));
+}
 
-	UpdateMediaPlayerTraitState();
+void DeviceDaemon::AbortPendingMp3Commands()
+{
+	mp3_requests_.clear();
+	mp3_player_queue_.AbortAll("_system_error", "MP3 player service died");
+	mp3_volume_queue_.AbortAll("_system_error", "MP3 player service died");
+}
+
+bool DeviceDaemon::OnDumpMetrics(const struct signalfd_siginfo& info)
+{
+	LOG(INFO) << "Metrics:\n" << metrics::Registry::Get()->ToString();
+	/* keep the handler registered */
+	return false;
 }
 
 int main(int argc, char* argv[])
 {
 	base::CommandLine::Init(argc, argv);
 	brillo::InitLog(brillo::kLogToSyslog | brillo::kLogHeader);
+	startup::Init("mydevice");
 	DeviceDaemon daemon;
 	return daemon.Run();
 }
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MYDEVICE_SERVICE_CLIENT_H_
+#define MYDEVICE_SERVICE_CLIENT_H_
+
+#include <algorithm>
+#include <string>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <base/rand_util.h>
+#include <base/time/time.h>
+#include <binder/IBinder.h>
+#include <binder/IInterface.h>
+#include <binderwrapper/binder_wrapper.h>
+#include <brillo/message_loops/message_loop.h>
+
+#include "metrics.h"
+
+/* Keeps a proxy to a binder service registered with the service manager.
+ *
+ * The lookup is retried with an exponential backoff and some jitter until
+ * the service shows up, starting over from the shortest delay whenever the
+ * service dies. The service manager has no registration notification, so
+ * the short initial delays are what keep the reconnection latency low. The
+ * callbacks are run on the message loop.
+ *
+ * The time each (re)connection took is recorded in binder.connect.<name>,
+ * and the lookups and the deaths of the service are counted in
+ * binder.lookups.<name> and binder.reconnects.<name>. */
+template <typename Interface>
+class ServiceClient final {
+public:
+	explicit ServiceClient(const char* service_name)
+		: service_name_(service_name),
+		  connect_time_histogram_(metrics::Registry::Get()->GetHistogram(
+			std::string("binder.connect.") + service_name)),
+		  lookup_counter_(metrics::Registry::Get()->GetCounter(
+			std::string("binder.lookups.") + service_name)),
+		  reconnect_counter_(metrics::Registry::Get()->GetCounter(
+			std::string("binder.reconnects.") + service_name)) {}
+
+	/* starts looking up the service */
+	void Connect(const base::Closure& on_connected, const base::Closure& on_disconnected) {
+		on_connected_ = on_connected;
+		on_disconnected_ = on_disconnected;
+		StartLookup();
+	}
+
+	Interface* get() const { return service_.get(); }
+	Interface* operator->() const { return service_.get(); }
+	const android::sp<Interface>& proxy() const { return service_; }
+
+	/* how long the last (re)connection took */
+	base::TimeDelta last_connect_time() const { return last_connect_time_; }
+	int reconnects() const { return reconnects_; }
+
+private:
+	static constexpr int kMinBackoffMs = 10;
+	/* a service back after a while is found within this, well under the
+	   500 ms the fixed poll took; a lookup is a cheap call to the service
+	   manager */
+	static constexpr int kMaxBackoffMs = 250;
+
+	void StartLookup() {
+		if (service_.get() || lookup_pending_)
+			return;
+		wait_started_ = base::TimeTicks::Now();
+		attempts_ = 0;
+		backoff_ = base::TimeDelta::FromMilliseconds(kMinBackoffMs);
+		Lookup();
+	}
+
+	void Lookup() {
+		lookup_pending_ = false;
+		attempts_++;
+		lookup_counter_->Increment();
+		android::BinderWrapper* binder_wrapper = android::BinderWrapper::Get();
+		android::sp<android::IBinder> binder = binder_wrapper->GetService(service_name_);
+		if (!binder.get()) {
+			/* wait between half and all of the current backoff */
+			int max_ms = static_cast<int>(backoff_.InMilliseconds());
+			base::TimeDelta delay = base::TimeDelta::FromMilliseconds(
+				base::RandInt(max_ms / 2, max_ms));
+			backoff_ = std::min(backoff_ * 2, base::TimeDelta::FromMilliseconds(kMaxBackoffMs));
+			lookup_pending_ = true;
+			brillo::MessageLoop::current()->PostDelayedTask(
+				base::Bind(&ServiceClient::Lookup, weak_ptr_factory_.GetWeakPtr()), delay);
+			return;
+		}
+
+		last_connect_time_ = base::TimeTicks::Now() - wait_started_;
+		connect_time_histogram_->Record(last_connect_time_.InMicroseconds());
+		LOG(INFO) << "Connected to " << service_name_ << " after "
+		          << last_connect_time_.InMilliseconds() << " ms, "
+		          << attempts_ << " lookup(s)";
+		binder_wrapper->RegisterForDeathNotifications(binder,
+			base::Bind(&ServiceClient::OnServiceDied, weak_ptr_factory_.GetWeakPtr()));
+		service_ = android::interface_cast<Interface>(binder);
+		on_connected_.Run();
+	}
+
+	void OnServiceDied() {
+		LOG(INFO) << service_name_ << " died";
+		service_ = nullptr;
+		reconnects_++;
+		reconnect_counter_->Increment();
+		on_disconnected_.Run();
+		StartLookup();
+	}
+
+	const char* const service_name_;
+	metrics::Histogram* const connect_time_histogram_;
+	metrics::Counter* const lookup_counter_;
+	metrics::Counter* const reconnect_counter_;
+	base::Closure on_connected_;
+	base::Closure on_disconnected_;
+
+	android::sp<Interface> service_;
+	bool lookup_pending_ = false;
+	int attempts_ = 0;
+	int reconnects_ = 0;
+	base::TimeDelta backoff_;
+	base::TimeTicks wait_started_;
+	base::TimeDelta last_connect_time_;
+
+	base::WeakPtrFactory<ServiceClient> weak_ptr_factory_{this};
+	DISALLOW_COPY_AND_ASSIGN(ServiceClient);
+};
+
+#endif
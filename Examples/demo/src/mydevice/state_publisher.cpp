@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "state_publisher.h"
+
+#include <algorithm>
+
+#include <base/bind.h>
+#include <base/logging.h>
+
+#include "metrics.h"
+#include "startup_profile.h"
+
+const int StatePublisher::kMinRetryMs;
+const int StatePublisher::kMaxRetryMs;
+
+StatePublisher::StatePublisher(const std::string& component)
+	: component_(component), retry_delay_(base::TimeDelta::FromMilliseconds(kMinRetryMs))
+{
+}
+
+void StatePublisher::SetService(const std::weak_ptr<weaved::Service>& service)
+{
+	service_ = service;
+	published_.clear();
+	pending_.clear();
+	/* the new instance is not made to wait for the backoff of the old one */
+	if (retry_task_ != brillo::MessageLoop::kTaskIdNull) {
+		brillo::MessageLoop::current()->CancelTask(retry_task_);
+		retry_task_ = brillo::MessageLoop::kTaskIdNull;
+		flush_scheduled_ = false;
+	}
+	retry_delay_ = base::TimeDelta::FromMilliseconds(kMinRetryMs);
+}
+
+void StatePublisher::SetString(const std::string& path, const std::string& value)
+{
+	Set(path, base::StringValue(value));
+}
+
+void StatePublisher::SetInteger(const std::string& path, int value)
+{
+	Set(path, base::FundamentalValue(value));
+}
+
+void StatePublisher::SetBoolean(const std::string& path, bool value)
+{
+	Set(path, base::FundamentalValue(value));
+}
+
+void StatePublisher::Set(const std::string& path, const base::Value& value)
+{
+	auto it = published_.find(path);
+	if (it != published_.end() && it->second->Equals(&value)) {
+		/* a change made earlier in this iteration may have been reverted */
+		pending_.erase(path);
+		return;
+	}
+	pending_[path].reset(value.DeepCopy());
+
+	if (!flush_scheduled_) {
+		flush_scheduled_ = true;
+		brillo::MessageLoop::current()->PostTask(
+			base::Bind(&StatePublisher::Flush, weak_ptr_factory_.GetWeakPtr()));
+	}
+}
+
+void StatePublisher::Flush()
+{
+	flush_scheduled_ = false;
+	retry_task_ = brillo::MessageLoop::kTaskIdNull;
+	if (pending_.empty())
+		return;
+	auto weave_service = service_.lock();
+	if (!weave_service)
+		return;
+
+	base::DictionaryValue state_change;
+	for (const auto& property : pending_)
+		state_change.Set(property.first, property.second->DeepCopy());
+	if (!weave_service->SetStateProperties(component_, state_change, nullptr)) {
+		LOG(ERROR) << "Failed to publish " << pending_.size() << " state properties, retrying in "
+		           << retry_delay_.InMilliseconds() << " ms";
+		METRICS_COUNT("weave.publishRetries");
+		/* the changes made until then go out with the retry */
+		flush_scheduled_ = true;
+		retry_task_ = brillo::MessageLoop::current()->PostDelayedTask(
+			base::Bind(&StatePublisher::Flush, weak_ptr_factory_.GetWeakPtr()), retry_delay_);
+		retry_delay_ = std::min(retry_delay_ * 2, base::TimeDelta::FromMilliseconds(kMaxRetryMs));
+		return;
+	}
+	retry_delay_ = base::TimeDelta::FromMilliseconds(kMinRetryMs);
+	startup::Milestone("weave.firstPublish");
+	for (auto& property : pending_)
+		published_[property.first] = std::move(property.second);
+	pending_.clear();
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MYDEVICE_STATE_PUBLISHER_H_
+#define MYDEVICE_STATE_PUBLISHER_H_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <base/time/time.h>
+#include <base/values.h>
+#include <brillo/message_loops/message_loop.h>
+#include <libweaved/service.h>
+
+/* Publishes the trait state properties of a Weave component.
+ *
+ * The last value sent for each property is remembered, so only the
+ * properties that actually changed are sent. All the changes made within
+ * the same message loop iteration are merged into one SetStateProperties()
+ * call. A call that fails is retried with an exponential backoff, along
+ * with whatever changed in the meantime. */
+class StatePublisher final {
+public:
+	explicit StatePublisher(const std::string& component);
+
+	/* Called upon each (re)connection to weaved. The new instance knows
+	   nothing about the state, so everything is published again. */
+	void SetService(const std::weak_ptr<weaved::Service>& service);
+
+	void SetString(const std::string& path, const std::string& value);
+	void SetInteger(const std::string& path, int value);
+	void SetBoolean(const std::string& path, bool value);
+
+private:
+	static const int kMinRetryMs = 100;
+	static const int kMaxRetryMs = 10000;
+
+	void Set(const std::string& path, const base::Value& value);
+	void Flush();
+
+	const std::string component_;
+	std::weak_ptr<weaved::Service> service_;
+	/* property path to the value last sent to weaved */
+	std::map<std::string, std::unique_ptr<base::Value>> published_;
+	/* property path to the value waiting for the next flush */
+	std::map<std::string, std::unique_ptr<base::Value>> pending_;
+	bool flush_scheduled_ = false;
+	/* the delay before the next retry of a failed flush */
+	base::TimeDelta retry_delay_;
+	brillo::MessageLoop::TaskId retry_task_ = brillo::MessageLoop::kTaskIdNull;
+
+	base::WeakPtrFactory<StatePublisher> weak_ptr_factory_{this};
+	DISALLOW_COPY_AND_ASSIGN(StatePublisher);
+};
+
+#endif
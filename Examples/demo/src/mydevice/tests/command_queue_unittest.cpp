@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "command_queue.h"
+
+#include <base/bind.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+class CommandQueueTest : public testing::Test {
+protected:
+	void Push(const std::string& kind, const std::string& name,
+	          CommandQueue::Coalesce coalesce = CommandQueue::Coalesce::kLatestWins) {
+		queue_.Push(kind, std::unique_ptr<weaved::Command>(new weaved::Command(name, &outcomes_)),
+		            base::Bind(&CommandQueueTest::Execute, base::Unretained(this)), coalesce);
+	}
+
+	/* a request of the daemon, without a command */
+	void PushInternal(const std::string& kind) {
+		queue_.Push(kind, nullptr,
+		            base::Bind(&CommandQueueTest::Execute, base::Unretained(this)));
+	}
+
+	void Execute(weaved::Command* command, int32_t id) {
+		executed_.push_back(command != nullptr ? command->GetName() : "internal");
+	}
+
+	CommandQueue queue_{"test"};
+	std::vector<std::string> executed_;
+	std::vector<std::string> outcomes_;
+};
+
+}  // namespace
+
+TEST_F(CommandQueueTest, RunsOneAtATime)
+{
+	Push("play", "play");
+	Push("stop", "stop");
+	EXPECT_TRUE(queue_.busy());
+	EXPECT_EQ(std::vector<std::string>({ "play" }), executed_);
+	queue_.Complete();
+	queue_.Complete();
+	EXPECT_FALSE(queue_.busy());
+	EXPECT_EQ(std::vector<std::string>({ "play", "stop" }), executed_);
+	EXPECT_EQ(std::vector<std::string>({ "play done", "stop done" }), outcomes_);
+}
+
+TEST_F(CommandQueueTest, LatestOfAKindWins)
+{
+	Push("play", "play");
+	Push("volume", "volume 1");
+	Push("stop", "stop");
+	Push("volume", "volume 2");
+	Push("volume", "volume 3");
+	while (queue_.busy())
+		queue_.Complete();
+	/* the last volume goes after the stop that arrived before it */
+	EXPECT_EQ(std::vector<std::string>({ "play", "stop", "volume 3" }), executed_);
+	EXPECT_EQ(std::vector<std::string>({ "play done", "stop done", "volume 1 done",
+	                                     "volume 2 done", "volume 3 done" }),
+	          outcomes_);
+}
+
+TEST_F(CommandQueueTest, EachCommandRunsInOrder)
+{
+	Push("play", "play");
+	Push("next", "next 1", CommandQueue::Coalesce::kEach);
+	Push("previous", "previous", CommandQueue::Coalesce::kEach);
+	Push("next", "next 2", CommandQueue::Coalesce::kEach);
+	Push("next", "next 3", CommandQueue::Coalesce::kEach);
+	/* does not replace the waiting next commands either */
+	Push("next", "next 4");
+	while (queue_.busy())
+		queue_.Complete();
+	EXPECT_EQ(std::vector<std::string>({ "play", "next 1", "previous", "next 2", "next 3",
+	                                     "next 4" }),
+	          executed_);
+	EXPECT_EQ(6u, outcomes_.size());
+}
+
+TEST_F(CommandQueueTest, AbortAllEndsTheWaitingCommands)
+{
+	Push("play", "play");
+	Push("next", "next 1", CommandQueue::Coalesce::kEach);
+	Push("next", "next 2", CommandQueue::Coalesce::kEach);
+	Push("volume", "volume 1");
+	Push("volume", "volume 2");
+	queue_.AbortAll("_system_error", "gone");
+	EXPECT_FALSE(queue_.busy());
+	EXPECT_EQ(std::vector<std::string>({ "play" }), executed_);
+	EXPECT_EQ(std::vector<std::string>({ "play aborted", "next 1 aborted", "next 2 aborted",
+	                                     "volume 1 aborted", "volume 2 aborted" }),
+	          outcomes_);
+}
+
+TEST_F(CommandQueueTest, RequestsWithoutACommand)
+{
+	Push("stop", "stop");
+	PushInternal("advance");
+	EXPECT_TRUE(queue_.Pending("stop"));
+	EXPECT_TRUE(queue_.Pending("advance"));
+	EXPECT_FALSE(queue_.Pending("pause"));
+	queue_.Complete();
+	EXPECT_FALSE(queue_.Pending("stop"));
+	EXPECT_TRUE(queue_.Pending("advance"));
+	/* a command that arrives after the request runs after it */
+	Push("pause", "pause");
+	queue_.Abort("_error", "failed");
+	queue_.Complete();
+	EXPECT_FALSE(queue_.busy());
+	EXPECT_EQ(std::vector<std::string>({ "stop", "internal", "pause" }), executed_);
+	EXPECT_EQ(std::vector<std::string>({ "stop done", "pause done" }), outcomes_);
+
+	/* replaced by a command, or replacing one, nothing is reported for it */
+	Push("play", "play");
+	PushInternal("advance");
+	PushInternal("advance");
+	Push("volume", "volume 1");
+	PushInternal("volume");
+	queue_.AbortAll("_system_error", "gone");
+	EXPECT_EQ(std::vector<std::string>({ "stop done", "pause done", "play aborted",
+	                                     "volume 1 aborted" }),
+	          outcomes_);
+}
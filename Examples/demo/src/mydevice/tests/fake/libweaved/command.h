@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MYDEVICE_TESTS_FAKE_LIBWEAVED_COMMAND_H_
+#define MYDEVICE_TESTS_FAKE_LIBWEAVED_COMMAND_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <binder/Status.h>
+
+/* Stands in for the command of libweaved in the tests, which only the
+ * weaved device can create: the outcome of each command is appended to a
+ * log, as "<name> done" or "<name> aborted". */
+namespace weaved {
+
+class Command final {
+public:
+	Command(const std::string& name, std::vector<std::string>* outcomes)
+		: name_(name), outcomes_(outcomes) {}
+
+	const std::string& GetName() const { return name_; }
+
+	bool Complete(const std::map<std::string, std::string>& results, void* error) {
+		outcomes_->push_back(name_ + " done");
+		return true;
+	}
+	bool Abort(const std::string& error_code, const std::string& error_message, void* error) {
+		outcomes_->push_back(name_ + " aborted");
+		return true;
+	}
+	bool AbortWithCustomError(android::binder::Status status, void* error) {
+		return Abort(status.exceptionMessage().string(), "", error);
+	}
+
+private:
+	const std::string name_;
+	std::vector<std::string>* const outcomes_;
+};
+
+}  // namespace weaved
+
+#endif
@@ -32,6 +32,7 @@ LOCAL_SHARED_LIBRARIES := \
 	libbrillo-binder \
 	libbrillo-stream \
 	libchrome \
+	libcutils \
 	libhardware \
 	libutils \
 	libmraa \
@@ -39,6 +40,7 @@ LOCAL_SHARED_LIBRARIES := \
 LOCAL_STATIC_LIBRARIES := \
 	libon-off-service \
 	libarduino-mraa \
+	libdemo-metrics \
 
 include $(BUILD_EXECUTABLE)
 
@@ -27,7 +27,10 @@
 
 #include <mraa.h>
 #include "brillo/demo/BnOnOffService.h"
+#include "metrics.h"
 #include "on-off-service.h"
+#include "startup_profile.h"
+#include "trace.h"
 #include "Arduino.h"
 
 #define IO_ON_OFF	25
@@ -40,21 +43,35 @@ public:
 		mraa_gpio_write(gpio, state = true);
 	}
 	std::string getDisplayText() { return display; }
-	android::binder::Status setState(bool flag) {
+	android::binder::Status setState(bool flag, int32_t traceId) {
+		METRICS_SCOPED_TIMER("binder.setState");
+		trace::Mark("onOff.receive", traceId);
 		LOG(INFO) << "OnOffService::setState(" << flag << ")";
-		mraa_gpio_write(gpio, state = flag);
+		WriteGpio(state = flag, traceId);
 		return android::binder::Status::ok();
 	}
 	android::binder::Status getState(bool* pFlag) {
+		METRICS_SCOPED_TIMER("binder.getState");
 		LOG(INFO) << "OnOffService::getState() return " << state;
 		*pFlag = state;
 		return android::binder::Status::ok();
 	}
 	android::binder::Status setDisplay(const ::android::String16& msg) {
+		METRICS_SCOPED_TIMER("binder.setDisplay");
 		display = ::android::String8(msg).string();
 		return android::binder::Status::ok();
 	}
+	android::status_t dump(int fd, const android::Vector<android::String16>& args) override {
+		metrics::Registry::Get()->Dump(fd);
+		return android::NO_ERROR;
+	}
 private:
+	void WriteGpio(bool value, int32_t traceId) {
+		METRICS_SCOPED_TIMER("gpio.write");
+		trace::Mark("gpio.write", traceId);
+		mraa_gpio_write(gpio, value);
+	}
+
 	bool state;
 	mraa_gpio_context gpio;
 	std::string display;
@@ -80,6 +97,7 @@ private:
 
 int MyDaemon::OnInit()
 {
+	startup::Milestone("oninit.begin");
 	int rc;
 	if ((rc = brillo::Daemon::OnInit()) != EX_OK)
 		return rc;
@@ -92,10 +110,12 @@ int MyDaemon::OnInit()
 	on_off_service_ = new OnOffService();
 	android::BinderWrapper::Get()->RegisterService(on_off_service::kBinderServiceName,
 	                                               on_off_service_);
+	startup::Milestone("binder.registered");
 
 	setup();
 	sketch_loop(20);
 
+	startup::Milestone("oninit.end");
 	return EX_OK;
 }
 
@@ -122,6 +142,7 @@ int main(int argc, char* argv[])
 {
 	base::CommandLine::Init(argc, argv);
 	brillo::InitLog(brillo::kLogToSyslog | brillo::kLogHeader);
+	startup::Init("on-off-service");
 	MyDaemon daemon;
 	return daemon.Run();
 }
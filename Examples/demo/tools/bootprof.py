@@ -0,0 +1,132 @@
+#!/usr/bin/env python
+#
+# Copyright 2015 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Aggregates the startup milestones of the demo daemons over many boots.
+
+Recording is enabled on the device with
+    adb shell setprop persist.demo.bootprof 1
+and every following boot appends its milestones to
+/data/misc/bootprof/milestones (see src/metrics/startup_profile.h).
+After a number of reboots, pull the file and run
+    adb pull /data/misc/bootprof/milestones
+    tools/bootprof.py milestones [more files...]
+
+The time origin of each boot is the earliest "exec" milestone, which
+approximates the start of the late_start class. For every milestone the
+tool prints its offset from the origin and the length of the phase since
+the previous milestone of the same process, as median/p90/max over the
+boots that reached it.
+"""
+
+from __future__ import print_function
+
+import argparse
+import collections
+import math
+import sys
+
+
+def parse(paths):
+    """Returns {boot id: {(process, milestone): us}}."""
+    boots = collections.OrderedDict()
+    for path in paths:
+        with open(path) as f:
+            for lineno, line in enumerate(f, 1):
+                fields = line.split()
+                if len(fields) != 4:
+                    print('%s:%d: malformed line ignored' % (path, lineno),
+                          file=sys.stderr)
+                    continue
+                boot_id, process, milestone, us = fields
+                milestones = boots.setdefault(boot_id, {})
+                # a daemon restarted within a boot keeps its first run
+                milestones.setdefault((process, milestone), int(us))
+    return boots
+
+
+def percentile(values, p):
+    """Nearest-rank percentile of a sorted list."""
+    rank = int(math.ceil(p / 100.0 * len(values))) - 1
+    return values[min(max(rank, 0), len(values) - 1)]
+
+
+def aggregate(boots):
+    """Returns {(process, milestone): ([offset ms], [phase ms])}."""
+    results = collections.defaultdict(lambda: ([], []))
+    for milestones in boots.values():
+        execs = [us for (_, name), us in milestones.items() if name == 'exec']
+        if not execs:
+            continue
+        origin = min(execs)
+        by_process = collections.defaultdict(list)
+        for (process, name), us in milestones.items():
+            by_process[process].append((us, name))
+        for process, points in by_process.items():
+            points.sort()
+            previous = None
+            for us, name in points:
+                offsets, phases = results[(process, name)]
+                offsets.append((us - origin) / 1000.0)
+                if previous is not None:
+                    phases.append((us - previous) / 1000.0)
+                previous = us
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('files', nargs='+',
+                        help='milestone files pulled from the device')
+    parser.add_argument('--ready', default='mydevice:weave.firstPublish',
+                        help='the process:milestone that marks the product '
+                             'ready (default: %(default)s)')
+    args = parser.parse_args()
+
+    boots = parse(args.files)
+    if not boots:
+        print('No milestones found', file=sys.stderr)
+        return 1
+    results = aggregate(boots)
+
+    print('%d boots\n' % len(boots))
+    print('%-20s %-22s %5s %9s %9s %9s %9s %9s' % (
+        'process', 'milestone', 'boots', 'at p50', 'at p90', 'at max',
+        'phase p50', 'phase p90'))
+    rows = sorted(results.items(),
+                  key=lambda item: (item[0][0], percentile(sorted(item[1][0]), 50)))
+    for (process, name), (offsets, phases) in rows:
+        offsets.sort()
+        phases.sort()
+        phase_columns = ('%9.1f %9.1f' % (percentile(phases, 50), percentile(phases, 90))
+                         if phases else '%9s %9s' % ('-', '-'))
+        print('%-20s %-22s %5d %9.1f %9.1f %9.1f %s' % (
+            process, name, len(offsets), percentile(offsets, 50),
+            percentile(offsets, 90), offsets[-1], phase_columns))
+
+    ready = tuple(args.ready.split(':', 1))
+    if ready in results:
+        offsets = sorted(results[ready][0])
+        print('\nboot-to-ready (%s): p50 %.1f ms, p90 %.1f ms, max %.1f ms, '
+              'reached in %d of %d boots' % (
+                  args.ready, percentile(offsets, 50), percentile(offsets, 90),
+                  offsets[-1], len(offsets), len(boots)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,117 @@
+#!/usr/bin/env python
+#
+# Copyright 2015 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Writes the MP3 files the scanner tests of mp3-player-service read.
+
+    tools/make_mp3_corpus.py src/mp3-player-service/tests/data
+
+The files are MPEG-1 layer III at 44.1 kHz with valid frame headers and
+silent payloads, which is all the scanner looks at:
+
+  vbr_xing.mp3       3 s from 128 to 256 kbit/s, with a Xing header and
+                     its table of contents, after an ID3v2.3 tag
+  id3v2_padding.mp3  2 s at 128 kbit/s after an ID3v2.4 tag in UTF-8,
+                     padded past the 16 KB window of the scanner
+  truncated.mp3      2 s at 128 kbit/s, the last frame cut short
+  free_format.mp3    2 s of free format frames, which the scanner does
+                     not support
+
+The expected values of mp3_scanner_unittest.cpp follow from these; keep
+them in step when changing this tool.
+"""
+
+from __future__ import print_function
+
+import os
+import struct
+import sys
+
+KBPS = [0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320]
+VBR_BITRATE_INDICES = [9, 11, 13, 10, 12, 9, 14, 11]
+SAMPLES_PER_FRAME = 1152
+SAMPLE_RATE = 44100
+
+
+def frame(bitrate_index, size=None):
+    """A frame header, stereo without CRC or padding, and a silent payload."""
+    if size is None:
+        size = 144 * KBPS[bitrate_index] * 1000 // SAMPLE_RATE
+    return bytearray([0xff, 0xfb, bitrate_index << 4, 0x00]) + bytearray(size - 4)
+
+
+def frames(seconds):
+    return seconds * SAMPLE_RATE // SAMPLES_PER_FRAME
+
+
+def syncsafe(value):
+    return bytearray([(value >> 21) & 0x7f, (value >> 14) & 0x7f,
+                      (value >> 7) & 0x7f, value & 0x7f])
+
+
+def id3v2(version, text_frames, padding=0):
+    """A tag of text frames given as (id, encoding, encoded text)."""
+    body = bytearray()
+    for frame_id, encoding, text in text_frames:
+        data = bytearray([encoding]) + text
+        size = syncsafe(len(data)) if version == 4 else struct.pack('>I', len(data))
+        body += frame_id + size + b'\0\0' + data
+    body += bytearray(padding)
+    return b'ID3' + bytearray([version, 0, 0]) + syncsafe(len(body)) + body
+
+
+def vbr_xing():
+    tag = id3v2(3, [(b'TIT2', 0, b'Xing Title'), (b'TPE1', 0, b'VBR Artist')])
+    count = frames(3)
+    stream = frame(9)
+    offsets = []
+    for i in range(count):
+        offsets.append(len(stream))
+        stream += frame(VBR_BITRATE_INDICES[i % len(VBR_BITRATE_INDICES)])
+    # after the 4 byte header and the 32 bytes of side information
+    xing = b'Xing' + struct.pack('>III', 7, count, len(stream))
+    xing += bytearray(offsets[count * i // 100] * 256 // len(stream) for i in range(100))
+    stream[36:36 + len(xing)] = xing
+    return tag + stream
+
+
+def id3v2_padding():
+    tag = id3v2(4, [(b'TIT2', 3, u'T\xedtulo'.encode('utf-8')),
+                    (b'TPE1', 3, u'K\xfcnstler'.encode('utf-8'))], padding=20000)
+    return tag + b''.join(frame(9) for _ in range(frames(2)))
+
+
+def truncated():
+    stream = b''.join(frame(9) for _ in range(frames(2)))
+    return stream[:-200]
+
+
+def free_format():
+    return b''.join(frame(0, 600) for _ in range(frames(2)))
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__, file=sys.stderr)
+        return 1
+    for name, data in [('vbr_xing.mp3', vbr_xing()), ('id3v2_padding.mp3', id3v2_padding()),
+                       ('truncated.mp3', truncated()), ('free_format.mp3', free_format())]:
+        with open(os.path.join(sys.argv[1], name), 'wb') as out:
+            out.write(data)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -70,7 +70,13 @@ LOCAL_AIDL_INCLUDES := $(LOCAL_PATH)/aidl
 LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)
 
 LOCAL_SRC_FILES := \
+	aidl/mydevice/mp3player/IMp3PlayerListener.aidl \
 	aidl/mydevice/mp3player/IMp3PlayerService.aidl \
 	binder_constants.cpp \
+	player_snapshot.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libbinder \
+	libutils \
 
 include $(BUILD_STATIC_LIBRARY)
@@ -38,12 +38,18 @@
 #include <include/MP3Extractor.h>
 
 #include "mydevice/mp3player/BnMp3PlayerService.h"
+#include "mydevice/mp3player/IMp3PlayerListener.h"
 #include "mp3-player-service.h"
+#include "player_snapshot.h"
 
 using namespace android;
+using mydevice::mp3player::IMp3PlayerListener;
+using mydevice::mp3player::PlayerSnapshot;
 
 class Mp3PlayerService : public mydevice::mp3player::BnMp3PlayerService {
 	const std::string SOUNDTRACKS_FORDER = "/data/soundtracks/";
+	/* EOS is checked in-process, so a short interval costs no IPC */
+	const int EOS_WATCH_INTERVAL_MS = 50;
 	enum PlayerState {
 		Idle,
 		Playing,
@@ -70,6 +76,7 @@ public:
 	}
 	android::binder::Status setVolume(float vol) {
 		AudioSystem::setMasterVolume(vol);
+		NotifyStateChanged();
 		return android::binder::Status::ok();
 	}
 	android::binder::Status isMuted(bool* pState) {
@@ -78,17 +85,35 @@ public:
 	}
 	android::binder::Status mute(bool state) {
 		AudioSystem::setMasterMute(state);
+		NotifyStateChanged();
 		return android::binder::Status::ok();
 	}
+	android::binder::Status getSnapshot(PlayerSnapshot* pSnapshot);
+	android::binder::Status applyVolume(float vol, bool state);
+	android::binder::Status registerListener(const sp<IMp3PlayerListener>& listener);
+	android::binder::Status unregisterListener(const sp<IMp3PlayerListener>& listener);
 private:
 	void reloadPlaylist();
 	status_t PlayStagefrightMp3(std::string filename);
+	String16 StatusString() const;
+	void FillSnapshot(PlayerSnapshot* pSnapshot) const;
+	void SetState(PlayerState new_state);
+	void NotifyStateChanged();
+	void StartEOSWatch();
+	void WatchEOS();
+	void OnListenerDied(sp<IBinder> binder);
 
 	OMXClient client;
 	AudioPlayer* player;
 	PlayerState state;
 	std::vector<std::string> playList;
 	size_t playIndex;
+
+	/* clients to be notified of state changes and end of stream */
+	std::vector<sp<IMp3PlayerListener>> listeners;
+	brillo::MessageLoop::TaskId eos_watch_task = brillo::MessageLoop::kTaskIdNull;
+
+	base::WeakPtrFactory<Mp3PlayerService> weak_ptr_factory_{this};
 };
 
 void Mp3PlayerService::reloadPlaylist()
@@ -155,12 +180,12 @@ android::binder::Status Mp3PlayerService::play()
 	case Idle:
 		if (playIndex < playList.size() &&
 		    PlayStagefrightMp3(SOUNDTRACKS_FORDER + playList[playIndex]) == OK)
-			state = Playing;
+			SetState(Playing);
 	case Playing:
 		break;
 	case Paused:
 		player->resume();
-		state = Playing;
+		SetState(Playing);
 	}
 	return android::binder::Status::ok();
 }
@@ -169,7 +194,7 @@ android::binder::Status Mp3PlayerService::pause()
 {
 	if (state == Playing) {
 		player->pause();
-		state = Paused;
+		SetState(Paused);
 	}
 	return android::binder::Status::ok();
 }
@@ -179,9 +204,9 @@ android::binder::Status Mp3PlayerService::stop()
 	if (state == Playing || state == Paused) {
 		delete player;
 		player = nullptr;
-		state  = Idle;
 		if (++playIndex >= playList.size())
 			playIndex = 0;
+		SetState(Idle);
 	}
 	return android::binder::Status::ok();
 }
@@ -194,21 +219,148 @@ android::binder::Status Mp3PlayerService::reachedEOS(bool* pEOS)
 }
 
 android::binder::Status Mp3PlayerService::status(String16* pInfo)
+{
+	pInfo->setTo(StatusString());
+	return android::binder::Status::ok();
+}
+
+String16 Mp3PlayerService::StatusString() const
 {
 	switch (state) {
+	case Playing:
+		return String16(playList[playIndex].c_str());
+	case Paused:
+		return String16("paused");
 	case Idle:
-		pInfo->setTo(String16("idle"));
+	default:
+		return String16("idle");
+	}
+}
+
+void Mp3PlayerService::SetState(PlayerState new_state)
+{
+	if (state == new_state)
+		return;
+	state = new_state;
+	if (state == Playing)
+		StartEOSWatch();
+	else if (eos_watch_task != brillo::MessageLoop::kTaskIdNull) {
+		brillo::MessageLoop::current()->CancelTask(eos_watch_task);
+		eos_watch_task = brillo::MessageLoop::kTaskIdNull;
+	}
+	NotifyStateChanged();
+}
+
+void Mp3PlayerService::NotifyStateChanged()
+{
+	if (listeners.empty())
+		return;
+	PlayerSnapshot snapshot;
+	FillSnapshot(&snapshot);
+	for (auto& listener : listeners)
+		listener->onStateChanged(snapshot);
+}
+
+void Mp3PlayerService::FillSnapshot(PlayerSnapshot* pSnapshot) const
+{
+	switch (state) {
+	case Idle:
+		pSnapshot->state = PlayerSnapshot::IDLE;
 		break;
 	case Playing:
-		pInfo->setTo(String16(playList[playIndex].c_str()));
+		pSnapshot->state = PlayerSnapshot::PLAYING;
 		break;
 	case Paused:
-		pInfo->setTo(String16("paused"));
+		pSnapshot->state = PlayerSnapshot::PAUSED;
 		break;
 	}
+	if (state != Idle) {
+		pSnapshot->trackId = playIndex;
+		pSnapshot->trackName.setTo(String16(playList[playIndex].c_str()));
+		pSnapshot->positionMs = player->getMediaTimeUs() / 1000;
+	}
+	if (AudioSystem::getMasterVolume(&pSnapshot->volume) != NO_ERROR)
+		pSnapshot->volume = 0.0f;
+	AudioSystem::getMasterMute(&pSnapshot->muted);
+}
+
+android::binder::Status Mp3PlayerService::getSnapshot(PlayerSnapshot* pSnapshot)
+{
+	FillSnapshot(pSnapshot);
 	return android::binder::Status::ok();
 }
 
+android::binder::Status Mp3PlayerService::applyVolume(float vol, bool state)
+{
+	AudioSystem::setMasterMute(state);
+	if (!state)
+		AudioSystem::setMasterVolume(vol);
+	NotifyStateChanged();
+	return android::binder::Status::ok();
+}
+
+void Mp3PlayerService::StartEOSWatch()
+{
+	if (eos_watch_task != brillo::MessageLoop::kTaskIdNull)
+		return;
+	eos_watch_task = brillo::MessageLoop::current()->PostDelayedTask(
+		base::Bind(&Mp3PlayerService::WatchEOS, weak_ptr_factory_.GetWeakPtr()),
+		base::TimeDelta::FromMilliseconds(EOS_WATCH_INTERVAL_MS));
+}
+
+void Mp3PlayerService::WatchEOS()
+{
+	eos_watch_task = brillo::MessageLoop::kTaskIdNull;
+	if (state != Playing)
+		return;
+	status_t s;
+	if (!player->reachedEOS(&s)) {
+		StartEOSWatch();
+		return;
+	}
+	/* the watch is re-armed by the next transition to Playing */
+	LOG(INFO) << "Reached end of stream: " << playList[playIndex];
+	for (auto& listener : listeners)
+		listener->onEndOfStream();
+}
+
+android::binder::Status Mp3PlayerService::registerListener(const sp<IMp3PlayerListener>& listener)
+{
+	sp<IBinder> binder = IInterface::asBinder(listener);
+	for (auto& l : listeners) {
+		if (IInterface::asBinder(l) == binder)
+			return android::binder::Status::ok();
+	}
+	android::BinderWrapper::Get()->RegisterForDeathNotifications(binder,
+		base::Bind(&Mp3PlayerService::OnListenerDied, weak_ptr_factory_.GetWeakPtr(), binder));
+	listeners.push_back(listener);
+	return android::binder::Status::ok();
+}
+
+android::binder::Status Mp3PlayerService::unregisterListener(const sp<IMp3PlayerListener>& listener)
+{
+	sp<IBinder> binder = IInterface::asBinder(listener);
+	for (auto it = listeners.begin(); it != listeners.end(); ++it) {
+		if (IInterface::asBinder(*it) == binder) {
+			android::BinderWrapper::Get()->UnregisterForDeathNotifications(binder);
+			listeners.erase(it);
+			break;
+		}
+	}
+	return android::binder::Status::ok();
+}
+
+void Mp3PlayerService::OnListenerDied(sp<IBinder> binder)
+{
+	LOG(INFO) << "Mp3PlayerService::OnListenerDied";
+	for (auto it = listeners.begin(); it != listeners.end(); ++it) {
+		if (IInterface::asBinder(*it) == binder) {
+			listeners.erase(it);
+			break;
+		}
+	}
+}
+
 class MyDaemon final : public brillo::Daemon {
 public:
 	MyDaemon() = default;
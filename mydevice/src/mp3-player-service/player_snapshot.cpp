@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "player_snapshot.h"
+
+using android::OK;
+using android::Parcel;
+using android::status_t;
+
+namespace mydevice {
+namespace mp3player {
+
+status_t PlayerSnapshot::writeToParcel(Parcel* parcel) const
+{
+	status_t status;
+	if ((status = parcel->writeInt32(state)) != OK ||
+	    (status = parcel->writeInt32(trackId)) != OK ||
+	    (status = parcel->writeString16(trackName)) != OK ||
+	    (status = parcel->writeFloat(volume)) != OK ||
+	    (status = parcel->writeBool(muted)) != OK ||
+	    (status = parcel->writeInt32(positionMs)) != OK)
+		return status;
+	return OK;
+}
+
+status_t PlayerSnapshot::readFromParcel(const Parcel* parcel)
+{
+	status_t status;
+	if ((status = parcel->readInt32(&state)) != OK ||
+	    (status = parcel->readInt32(&trackId)) != OK ||
+	    (status = parcel->readString16(&trackName)) != OK ||
+	    (status = parcel->readFloat(&volume)) != OK ||
+	    (status = parcel->readBool(&muted)) != OK ||
+	    (status = parcel->readInt32(&positionMs)) != OK)
+		return status;
+	return OK;
+}
+
+const char* PlayerSnapshot::StateName() const
+{
+	switch (state) {
+	case PLAYING:
+		return "playing";
+	case PAUSED:
+		return "paused";
+	case IDLE:
+	default:
+		return "idle";
+	}
+}
+
+}  // namespace mp3player
+}  // namespace mydevice
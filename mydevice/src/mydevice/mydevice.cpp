@@ -14,7 +14,6 @@
  * limitations under the License.
  */
 #include <unistd.h>
-#include <codecvt>
 #include <sysexits.h>
 
 #include <base/logging.h>
@@ -29,15 +28,39 @@
 
 #include <mraa.h>
 
+#include "mydevice/mp3player/BnMp3PlayerListener.h"
 #include "mydevice/mp3player/BnMp3PlayerService.h"
 #include "mp3-player-service.h"
+#include "player_snapshot.h"
 using mydevice::mp3player::IMp3PlayerService;
+using mydevice::mp3player::PlayerSnapshot;
 
 namespace {
 	const char kWeaveComponent[] = "mydevice";
 	const char kOnOffTrait[] = "onOff";
 }
 
+/* Receives the events pushed by the MP3 player service. The callbacks are
+   dispatched on the message loop by the binder watcher. */
+class Mp3PlayerListener : public mydevice::mp3player::BnMp3PlayerListener {
+public:
+	using StateChangedCallback = base::Callback<void(const PlayerSnapshot&)>;
+	Mp3PlayerListener(const StateChangedCallback& on_state_changed,
+	                  const base::Closure& on_end_of_stream)
+		: on_state_changed_(on_state_changed), on_end_of_stream_(on_end_of_stream) {}
+	android::binder::Status onStateChanged(const PlayerSnapshot& snapshot) {
+		on_state_changed_.Run(snapshot);
+		return android::binder::Status::ok();
+	}
+	android::binder::Status onEndOfStream() {
+		on_end_of_stream_.Run();
+		return android::binder::Status::ok();
+	}
+private:
+	StateChangedCallback on_state_changed_;
+	base::Closure on_end_of_stream_;
+};
+
 class DeviceDaemon final : public brillo::Daemon {
 public:
 	static int pinOnBoardLed;
@@ -51,7 +74,8 @@ protected:
 	void ConnectToMp3PlayerService();
 	void OnMp3PlayerServiceDisconnected();
 	void UpdateMediaPlayerTraitState();
-	void TrackMp3PlayerReachedEOS();
+	void PublishMediaPlayerTraitState(const PlayerSnapshot& snapshot);
+	void OnMp3PlayerEndOfStream();
 
 	// Command handlers
 	void OnSetConfig(std::unique_ptr<weaved::Command> command);
@@ -71,6 +95,8 @@ private:
 
 	/* the MP3 player service interface */
 	android::sp<IMp3PlayerService> mp3_player_service_;
+	/* the listener registered to the MP3 player service */
+	android::sp<Mp3PlayerListener> mp3_player_listener_;
 	std::string mp3_current_playing;
 
 	base::WeakPtrFactory<DeviceDaemon> weak_ptr_factory_{this};
@@ -98,6 +124,10 @@ int DeviceDaemon::OnInit()
 	ctxOnBoardLed = mraa_gpio_init(pinOnBoardLed);
 	mraa_gpio_dir(ctxOnBoardLed, MRAA_GPIO_OUT);
 
+	mp3_player_listener_ = new Mp3PlayerListener(
+		base::Bind(&DeviceDaemon::PublishMediaPlayerTraitState, weak_ptr_factory_.GetWeakPtr()),
+		base::Bind(&DeviceDaemon::OnMp3PlayerEndOfStream, weak_ptr_factory_.GetWeakPtr()));
+
 	ConnectToMp3PlayerService();
 
 	return EX_OK;
@@ -186,26 +216,18 @@ void DeviceDaemon::ConnectToMp3PlayerService()
 	binder_wrapper->RegisterForDeathNotifications(binder,
 		base::Bind(&DeviceDaemon::OnMp3PlayerServiceDisconnected, weak_ptr_factory_.GetWeakPtr()));
 	mp3_player_service_ = android::interface_cast<IMp3PlayerService>(binder);
-	TrackMp3PlayerReachedEOS();
+	mp3_player_service_->registerListener(mp3_player_listener_);
 	UpdateMediaPlayerTraitState();
 }
 
-void DeviceDaemon::TrackMp3PlayerReachedEOS()
+void DeviceDaemon::OnMp3PlayerEndOfStream()
 {
-	if (mp3_player_service_.get()) {
-		bool eos = true;
-		android::binder::Status status = mp3_player_service_->reachedEOS(&eos);
-		if (status.isOk() && mp3_current_playing.compare("-") != 0 && eos) {
-			LOG(INFO) << "Advance to next track due to end of stream";
-			status = mp3_player_service_->stop();
-			if (status.isOk())
-				status = mp3_player_service_->play();
-			UpdateMediaPlayerTraitState();
-		}
+	if (mp3_player_service_.get() && mp3_current_playing.compare("-") != 0) {
+		LOG(INFO) << "Advance to next track due to end of stream";
+		android::binder::Status status = mp3_player_service_->stop();
+		if (status.isOk())
+			mp3_player_service_->play();
 	}
-	brillo::MessageLoop::current()->PostDelayedTask(
-		base::Bind(&DeviceDaemon::TrackMp3PlayerReachedEOS, weak_ptr_factory_.GetWeakPtr()),
-		base::TimeDelta::FromSeconds(3));
 }
 
 void DeviceDaemon::OnMp3PlayerServiceDisconnected()
@@ -219,40 +241,32 @@ void DeviceDaemon::UpdateMediaPlayerTraitState()
 {
 	LOG(INFO) << "DeviceDaemon::UpdateMediaPlayerTraitState";
 	if (mp3_player_service_.get()) {
-		::android::String16 player_info;
-		android::binder::Status status = mp3_player_service_->status(&player_info);
-		std::string player_state("unknown");
-		if (status.isOk()) {
-			std::wstring_convert<std::codecvt_utf8_utf16<char16_t>,char16_t> convert;
-			player_state = convert.to_bytes(player_info.string());
-			if (player_state.compare("idle") == 0) {
-				mp3_current_playing = "-";
-			} else if (player_state.compare("paused") != 0) {
-				mp3_current_playing = player_state;
-				player_state = "playing";
-			}
-		}
-
-		float volume = 0;
-		bool mute;
-		status = mp3_player_service_->isMuted(&mute);
-		if (status.isOk()) {
-			mp3_player_service_->getVolume(&volume);
-		}
-
-		auto weave_service = weave_service_.lock();
-		if (!weave_service)
-			return;
-
-		base::DictionaryValue state_change;
-		state_change.SetString("_mediaplayer.status", player_state);
-		state_change.SetString("_mediaplayer.display", mp3_current_playing);
-		state_change.SetInteger("volume.volume", volume * 100);
-		state_change.SetBoolean("volume.isMuted", mute);
-		weave_service->SetStateProperties(::kWeaveComponent, state_change, nullptr);
+		PlayerSnapshot snapshot;
+		android::binder::Status status = mp3_player_service_->getSnapshot(&snapshot);
+		if (status.isOk())
+			PublishMediaPlayerTraitState(snapshot);
 	}
 }
 
+void DeviceDaemon::PublishMediaPlayerTraitState(const PlayerSnapshot& snapshot)
+{
+	if (snapshot.state == PlayerSnapshot::IDLE)
+		mp3_current_playing = "-";
+	else if (snapshot.state == PlayerSnapshot::PLAYING)
+		mp3_current_playing = ::android::String8(snapshot.trackName).string();
+
+	auto weave_service = weave_service_.lock();
+	if (!weave_service)
+		return;
+
+	base::DictionaryValue state_change;
+	state_change.SetString("_mediaplayer.status", snapshot.StateName());
+	state_change.SetString("_mediaplayer.display", mp3_current_playing);
+	state_change.SetInteger("volume.volume", snapshot.volume * 100);
+	state_change.SetBoolean("volume.isMuted", snapshot.muted);
+	weave_service->SetStateProperties(::kWeaveComponent, state_change, nullptr);
+}
+
 void DeviceDaemon::OnMp3Play(std::unique_ptr<weaved::Command> command)
 {
 	LOG(INFO) << "Start MP3 playing...";
@@ -265,9 +279,8 @@ void DeviceDaemon::OnMp3Play(std::unique_ptr<weaved::Command> command)
 		command->AbortWithCustomError(status, nullptr);
 		return;
 	}
+	/* the trait state is refreshed when the service reports the change */
 	command->Complete({}, nullptr);
-
-	UpdateMediaPlayerTraitState();
 }
 
 void DeviceDaemon::OnMp3Pause(std::unique_ptr<weaved::Command> command)
@@ -282,9 +295,8 @@ void DeviceDaemon::OnMp3Pause(std::unique_ptr<weaved::Command> command)
 		command->AbortWithCustomError(status, nullptr);
 		return;
 	}
+	/* the trait state is refreshed when the service reports the change */
 	command->Complete({}, nullptr);
-
-	UpdateMediaPlayerTraitState();
 }
 
 void DeviceDaemon::OnMp3Stop(std::unique_ptr<weaved::Command> command)
@@ -299,9 +311,8 @@ void DeviceDaemon::OnMp3Stop(std::unique_ptr<weaved::Command> command)
 		command->AbortWithCustomError(status, nullptr);
 		return;
 	}
+	/* the trait state is refreshed when the service reports the change */
 	command->Complete({}, nullptr);
-
-	UpdateMediaPlayerTraitState();
 }
 
 void DeviceDaemon::OnMp3SetVolume(std::unique_ptr<weaved::Command> command)
@@ -315,20 +326,13 @@ void DeviceDaemon::OnMp3SetVolume(std::unique_ptr<weaved::Command> command)
 		command->Abort("_system_error", "MP3 player service unavailable", nullptr);
 		return;
 	}
-	android::binder::Status status = mp3_player_service_->mute(mute);
-	if (!status.isOk()) {
-		command->AbortWithCustomError(status, nullptr);
-		return;
-	}
-	if (!mute)
-		status = mp3_player_service_->setVolume(volume);
+	android::binder::Status status = mp3_player_service_->applyVolume(volume, mute);
 	if (!status.isOk()) {
 		command->AbortWithCustomError(status, nullptr);
 		return;
 	}
+	/* the trait state is refreshed when the service reports the change */
 	command->Complete({}, nullptr);
-
-	UpdateMediaPlayerTraitState();
 }
 
 class Board {